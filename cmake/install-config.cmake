@@ -1,5 +1,6 @@
 include(CMakeFindDependencyMacro)
 find_dependency(fmt)
+find_dependency(Threads)
 
 if(fmt_FOUND)
   include("${CMAKE_CURRENT_LIST_DIR}/mfileTargets.cmake")
@@ -0,0 +1,172 @@
+// mfile - A modern C++20 file handling library
+// (https://github.com/range3/mfile)
+// Licensed under MIT License
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <new>
+#include <stdexcept>
+#include <utility>
+
+#include <sys/mman.h>
+
+#include "mfile/huge_pages.hpp"
+#include "mfile/mfile.hpp"
+
+namespace mfile {
+
+// Owning, zero-initialized byte buffer with a given power-of-two alignment,
+// suitable for O_DIRECT transfers. With huge pages (mfile/huge_pages.hpp)
+// the buffer is an anonymous mapping rounded up to whole huge pages, which
+// are faulted in up front.
+class aligned_buffer {
+ public:
+  aligned_buffer() noexcept = default;
+
+  aligned_buffer(std::size_t size,
+                 std::size_t alignment,
+                 huge_page_mode huge = huge_page_mode::off)
+      : size_{size}, alignment_{alignment} {
+    if (!std::has_single_bit(alignment)) {
+      throw std::invalid_argument{"alignment must be a power of two"};
+    }
+    if (size_ == 0) {
+      return;
+    }
+    if (huge != huge_page_mode::off && map_huge(huge)) {
+      return;
+    }
+    data_ = static_cast<std::byte*>(
+        ::operator new(size_, std::align_val_t{alignment_}));
+    std::fill_n(data_, size_, std::byte{});
+  }
+
+  aligned_buffer(const aligned_buffer&) = delete;
+  auto operator=(const aligned_buffer&) -> aligned_buffer& = delete;
+
+  aligned_buffer(aligned_buffer&& other) noexcept
+      : data_{std::exchange(other.data_, nullptr)},
+        size_{std::exchange(other.size_, 0)},
+        alignment_{other.alignment_},
+        mapped_{std::exchange(other.mapped_, 0)},
+        huge_{std::exchange(other.huge_, huge_page_mode::off)} {}
+
+  auto operator=(aligned_buffer&& other) noexcept -> aligned_buffer& {
+    aligned_buffer{std::move(other)}.swap(*this);
+    return *this;
+  }
+
+  ~aligned_buffer() noexcept {
+    if (mapped_ != 0) {
+      ::munmap(data_, mapped_);
+    } else if (data_ != nullptr) {
+      ::operator delete(data_, std::align_val_t{alignment_});
+    }
+  }
+
+  // Allocates a buffer usable for direct I/O on f: aligned to the memory
+  // alignment the kernel reports for the file and at least min_size bytes,
+  // rounded up to the offset alignment.
+  template <file_handle_like Handle, file_hooks Hooks, metadata_policy Metadata>
+  [[nodiscard]]
+  static auto for_direct_io(const file<Handle, Hooks, Metadata>& f,
+                            std::size_t min_size,
+                            huge_page_mode huge = huge_page_mode::off)
+      -> aligned_buffer {
+    auto const align = f.dio_alignment();
+    if (align.memory == 0) {
+      throw mfile_system_error{EINVAL, "direct I/O is not supported"};
+    }
+    auto const granule = std::max<std::size_t>(align.offset, align.memory);
+    auto const size = (min_size + granule - 1) / granule * granule;
+    return aligned_buffer{std::max(size, granule), align.memory, huge};
+  }
+
+  [[nodiscard]]
+  auto data() noexcept -> std::byte* {
+    return data_;
+  }
+  [[nodiscard]]
+  auto data() const noexcept -> const std::byte* {
+    return data_;
+  }
+  [[nodiscard]]
+  auto size() const noexcept -> std::size_t {
+    return size_;
+  }
+  [[nodiscard]]
+  auto alignment() const noexcept -> std::size_t {
+    return alignment_;
+  }
+
+  // Reads /proc/self/smaps.
+  [[nodiscard]]
+  auto huge_pages() const -> huge_page_stats {
+    return {huge_, huge_page_bytes({data_, size_})};
+  }
+
+  // NOLINTNEXTLINE
+  operator byte_view() noexcept { return {data_, size_}; }
+  // NOLINTNEXTLINE
+  operator cbyte_view() const noexcept { return {data_, size_}; }
+
+  void swap(aligned_buffer& other) noexcept {
+    using std::swap;
+    swap(data_, other.data_);
+    swap(size_, other.size_);
+    swap(alignment_, other.alignment_);
+    swap(mapped_, other.mapped_);
+    swap(huge_, other.huge_);
+  }
+
+ private:
+  std::byte* data_{};
+  std::size_t size_{};
+  std::size_t alignment_{alignof(std::max_align_t)};
+  // Length of the mapping backing data_; 0 when allocated with new
+  std::size_t mapped_{};
+  huge_page_mode huge_{huge_page_mode::off};
+
+  // Maps the buffer with huge pages, falling back from hugetlb to
+  // transparent. False if no mapping could be made.
+  auto map_huge(huge_page_mode huge) -> bool {
+    auto const page = detail::huge_page_size();
+    auto const align = std::max(page, alignment_);
+    auto const length = detail::round_up(size_, align);
+    if (huge == huge_page_mode::hugetlb && align == page) {
+      auto const size_flag = std::countr_zero(page) << MAP_HUGE_SHIFT;
+      auto* p = ::mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | size_flag,
+                       -1, 0);
+      if (p != MAP_FAILED) {
+        data_ = static_cast<std::byte*>(p);
+        mapped_ = length;
+        huge_ = huge_page_mode::hugetlb;
+        return true;
+      }
+    }
+    auto* p = detail::mmap_aligned(length, align, PROT_READ | PROT_WRITE,
+                                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+      return false;
+    }
+    data_ = static_cast<std::byte*>(p);
+    mapped_ = length;
+    if (::madvise(p, length, MADV_HUGEPAGE) == 0) {
+      huge_ = huge_page_mode::transparent;
+    }
+    // One fault per huge page instead of one per base page later
+    for (std::size_t i = 0; i < length; i += page) {
+      data_[i] = std::byte{};  // NOLINT
+    }
+    return true;
+  }
+};
+
+inline void swap(aligned_buffer& lhs, aligned_buffer& rhs) noexcept {
+  lhs.swap(rhs);
+}
+
+}  // namespace mfile
@@ -0,0 +1,703 @@
+// mfile - A modern C++20 file handling library
+// (https://github.com/range3/mfile)
+// Licensed under MIT License
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <concepts>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <optional>
+#include <span>
+#include <stop_token>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "mfile/io_context.hpp"
+#include "mfile/mfile.hpp"
+
+// Awaitable counterparts of the positional file API:
+//
+//   co_await mfile::async_pread_exact(ctx, file, buffer, offset);
+//
+// They complete and throw exactly like the synchronous file<Handle> methods
+// of the same name. The coroutine is resumed on the thread running ctx.
+//
+// Every function also accepts a registered_file in place of the file and a
+// registered_buffer in place of the byte view. Anything that converts to a
+// byte view, such as a buffer_lease, can be passed as the buffer.
+
+namespace mfile {
+
+// Deadline and cancellation of a single async_* call.
+struct async_options {
+  // Fails the call with errc::timed_out unless it completed within this
+  // time, including the resubmissions of partial transfers. Zero: no limit.
+  std::chrono::nanoseconds timeout{};
+  // Fails the call with errc::operation_cancelled once a stop is requested,
+  // from any thread.
+  std::stop_token stop{};
+};
+
+namespace detail {
+
+enum class transfer_mode : std::uint8_t {
+  once,   // a single read/write, like pread_once
+  full,   // until done or EOF/no space, like pread
+  exact,  // until done, throwing otherwise, like pread_exact
+};
+
+// What an io_request addresses: a descriptor or a fixed file slot.
+struct io_target {
+  int fd;
+  std::uint8_t flags;
+};
+
+template <file_handle_like Handle, file_hooks Hooks, metadata_policy Metadata>
+auto io_target_of(const file<Handle, Hooks, Metadata>& f) noexcept
+    -> io_target {
+  return {f.handle()->native(), 0};
+}
+
+inline auto io_target_of(registered_file f) noexcept -> io_target {
+  return {static_cast<int>(f.index()), io_request::fixed_file};
+}
+
+// A byte view or a registered_buffer, taken by the awaitable factories.
+template <bool Const>
+struct io_buffer {
+  using view_type = std::conditional_t<Const, cbyte_view, byte_view>;
+
+  std::byte* data{};
+  std::size_t size{};
+  std::uint8_t flags{};
+  std::uint16_t index{};
+
+  template <typename Buffer>
+    requires std::convertible_to<Buffer, view_type>
+  io_buffer(Buffer&& buffer) noexcept  // NOLINT
+  {
+    view_type const view = std::forward<Buffer>(buffer);
+    data = const_cast<std::byte*>(view.data());  // NOLINT
+    size = view.size();
+  }
+
+  io_buffer(registered_buffer buffer) noexcept  // NOLINT
+      : data{buffer.data().data()},
+        size{buffer.size()},
+        flags{io_request::fixed_buffer},
+        index{buffer.index()} {}
+};
+
+class awaitable_operation : public io_operation {
+ public:
+  awaitable_operation(io_context& ctx, const async_options& options)
+      : ctx_{&ctx}, stop_{options.stop} {
+    if (options.timeout.count() > 0) {
+      deadline_ = clock::now()
+                  + std::chrono::duration_cast<clock::duration>(
+                      options.timeout);
+    }
+  }
+
+  awaitable_operation(const awaitable_operation&) = delete;
+  awaitable_operation(awaitable_operation&&) = delete;
+  auto operator=(const awaitable_operation&) -> awaitable_operation& = delete;
+  auto operator=(awaitable_operation&&) -> awaitable_operation& = delete;
+  ~awaitable_operation() override = default;
+
+ protected:
+  using clock = std::chrono::steady_clock;
+
+  io_context* ctx_;
+  std::coroutine_handle<> waiter_;
+  std::exception_ptr error_;
+
+  // Returns false if the operation finished without being submitted, in
+  // which case the coroutine is not suspended.
+  auto start(std::coroutine_handle<> waiter) -> bool {
+    waiter_ = waiter;
+    if (auto error = interruption()) {
+      error_ = std::move(error);
+      return false;
+    }
+    if (stop_.stop_possible()) {
+      ctx_->enable_remote_wake();
+      stop_callback_.emplace(stop_, canceller{this});
+    }
+    try {
+      submit();
+    } catch (...) {
+      finish();
+      throw;
+    }
+    return true;
+  }
+
+  // Submits the request again after a partial transfer or EINTR/EAGAIN,
+  // unless the deadline passed or a stop was requested in the meantime.
+  void resubmit() {
+    if (auto error = interruption()) {
+      fail(std::move(error));
+      return;
+    }
+    try {
+      submit();
+    } catch (...) {
+      fail(std::current_exception());
+    }
+  }
+
+  // Fails the operation if it was aborted by its deadline or stop token.
+  // Returns true if it did.
+  auto interrupted(std::int32_t result) -> bool {
+    if (result != -ECANCELED && result != -EINTR) {
+      return false;
+    }
+    auto error = interruption();
+    if (!error) {
+      return false;
+    }
+    fail(std::move(error));
+    return true;
+  }
+
+  void complete() {
+    finish();
+    waiter_.resume();
+  }
+
+  void fail(std::exception_ptr error) {
+    finish();
+    error_ = std::move(error);
+    waiter_.resume();
+  }
+
+  void rethrow_if_failed() const {
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+  }
+
+  [[nodiscard]]
+  static auto retryable(std::int32_t result) noexcept -> bool {
+    return result == -EINTR || result == -EAGAIN;
+  }
+
+ private:
+  struct canceller {
+    awaitable_operation* self;
+
+    void operator()() const noexcept {
+      try {
+        self->ctx_->post_cancel(*self);
+      } catch (...) {  // NOLINT(bugprone-empty-catch)
+        // Out of memory; the operation runs to completion instead
+      }
+    }
+  };
+
+  clock::time_point deadline_{clock::time_point::max()};
+  std::stop_token stop_;
+  std::optional<std::stop_callback<canceller>> stop_callback_;
+
+  void submit() {
+    if (deadline_ != clock::time_point::max()) {
+      request.timeout = std::max<std::chrono::nanoseconds>(
+          deadline_ - clock::now(), std::chrono::nanoseconds{1});
+    }
+    ctx_->submit(*this);
+  }
+
+  [[nodiscard]]
+  auto interruption() const -> std::exception_ptr {
+    if (stop_.stop_requested()) {
+      return std::make_exception_ptr(mfile_error{
+          make_error_code(errc::operation_cancelled), "I/O cancelled"});
+    }
+    if (clock::now() >= deadline_) {
+      return std::make_exception_ptr(
+          mfile_error{make_error_code(errc::timed_out), "I/O timed out"});
+    }
+    return {};
+  }
+
+  // Blocks until a concurrently running stop callback returned, so no
+  // cancellation can be posted for this operation afterwards.
+  void finish() noexcept {
+    stop_callback_.reset();
+    ctx_->withdraw_cancel(*this);
+  }
+};
+
+template <bool Write, transfer_mode Mode>
+class rw_awaitable final : public awaitable_operation {
+ public:
+  rw_awaitable(io_context& ctx,
+               io_target target,
+               io_buffer<Write> buffer,
+               std::uint64_t offset,
+               const async_options& options)
+      : awaitable_operation{ctx, options},
+        data_{buffer.data},
+        size_{buffer.size},
+        offset_{offset} {
+    request.opcode = Write ? io_opcode::write : io_opcode::read;
+    request.fd = target.fd;
+    request.flags = static_cast<std::uint8_t>(target.flags | buffer.flags);
+    request.buf_index = buffer.index;
+  }
+
+  [[nodiscard]]
+  auto await_ready() const noexcept -> bool {
+    return Mode != transfer_mode::once && size_ == 0;
+  }
+
+  auto await_suspend(std::coroutine_handle<> waiter) -> bool {
+    prepare_next();
+    return start(waiter);
+  }
+
+  auto await_resume() {
+    rethrow_if_failed();
+    if constexpr (Mode != transfer_mode::exact) {
+      return done_;
+    }
+  }
+
+  void on_complete(std::int32_t result) override {
+    if (interrupted(result)) {
+      return;
+    }
+    if (retryable(result)) {
+      resubmit();
+      return;
+    }
+    if (result < 0) {
+      fail(std::make_exception_ptr(mfile_system_error{
+          -result, Write ? "pwrite failed" : "pread failed"}));
+      return;
+    }
+
+    done_ += static_cast<std::size_t>(result);
+    if (Mode != transfer_mode::once && result != 0 && done_ < size_) {
+      prepare_next();
+      resubmit();
+      return;
+    }
+    if (Mode == transfer_mode::exact && done_ != size_) {
+      if constexpr (Write) {
+        fail(std::make_exception_ptr(
+            insufficient_space_error{done_, "pwrite_exact failed"}));
+      } else {
+        fail(std::make_exception_ptr(
+            end_of_file_error{done_, "pread_exact failed"}));
+      }
+      return;
+    }
+    complete();
+  }
+
+ private:
+  std::byte* data_;
+  std::size_t size_;
+  std::uint64_t offset_;
+  std::size_t done_{};
+
+  void prepare_next() noexcept {
+    request.data = data_ + done_;
+    request.size = static_cast<std::uint32_t>(
+        std::min(size_ - done_, io_request::max_transfer));
+    request.offset = offset_ + done_;
+  }
+};
+
+class sync_awaitable final : public awaitable_operation {
+ public:
+  sync_awaitable(io_context& ctx,
+                 io_target target,
+                 io_opcode opcode,
+                 const async_options& options)
+      : awaitable_operation{ctx, options} {
+    request.opcode = opcode;
+    request.fd = target.fd;
+    request.flags = target.flags;
+  }
+
+  [[nodiscard]]
+  auto await_ready() const noexcept -> bool {
+    return false;
+  }
+
+  auto await_suspend(std::coroutine_handle<> waiter) -> bool {
+    return start(waiter);
+  }
+
+  void await_resume() const { rethrow_if_failed(); }
+
+  void on_complete(std::int32_t result) override {
+    if (interrupted(result)) {
+      return;
+    }
+    if (retryable(result)) {
+      resubmit();
+      return;
+    }
+    if (result < 0) {
+      fail(std::make_exception_ptr(mfile_system_error{-result, "sync failed"}));
+      return;
+    }
+    complete();
+  }
+};
+
+}  // namespace detail
+
+// A file<Handle> or a registered_file.
+template <typename File>
+concept async_file = requires(const File& f) {
+  { detail::io_target_of(f) } -> std::same_as<detail::io_target>;
+};
+
+// Thrown by async_chain() for the first link that failed. Links after it
+// were cancelled without running.
+class link_error : public mfile_error {
+ public:
+  link_error(std::size_t link, std::error_code ec, std::string_view what_arg)
+      : mfile_error{ec, what_arg}, link_{link} {}
+
+  // Zero-based position of the failed link in the chain.
+  [[nodiscard]]
+  auto link() const noexcept -> std::size_t {
+    return link_;
+  }
+
+ private:
+  std::size_t link_;
+};
+
+// A dependent sequence of operations, submitted at once and executed in
+// order, e.g. "pwrite record, pwrite footer, fdatasync":
+//
+//   auto chain = mfile::io_chain{};
+//   chain.pwrite(f, record, off).pwrite(f, footer, off + n).fdatasync(f);
+//   co_await mfile::async_chain(ctx, chain);
+//
+// Each link must transfer its whole buffer; a short transfer breaks the
+// chain like an error.
+class io_chain {
+ public:
+  template <async_file File>
+  auto pread(const File& f, detail::io_buffer<false> data, std::uint64_t offset)
+      -> io_chain& {
+    return add_transfer(io_opcode::read, detail::io_target_of(f), data, offset);
+  }
+
+  template <async_file File>
+  auto pwrite(const File& f, detail::io_buffer<true> data, std::uint64_t offset)
+      -> io_chain& {
+    return add_transfer(io_opcode::write, detail::io_target_of(f), data,
+                        offset);
+  }
+
+  template <async_file File>
+  auto fsync(const File& f) -> io_chain& {
+    return add(io_opcode::fsync, detail::io_target_of(f));
+  }
+
+  template <async_file File>
+  auto fdatasync(const File& f) -> io_chain& {
+    return add(io_opcode::fdatasync, detail::io_target_of(f));
+  }
+
+  // Starts the chain only after every operation submitted before it has
+  // completed (IOSQE_IO_DRAIN).
+  auto drain() noexcept -> io_chain& {
+    drain_ = true;
+    return *this;
+  }
+
+  [[nodiscard]]
+  auto requests() const noexcept -> std::span<const io_request> {
+    return requests_;
+  }
+
+  [[nodiscard]]
+  auto drained() const noexcept -> bool {
+    return drain_;
+  }
+
+ private:
+  std::vector<io_request> requests_;
+  bool drain_{};
+
+  auto add(io_opcode opcode, detail::io_target target) -> io_chain& {
+    auto& req = requests_.emplace_back();
+    req.opcode = opcode;
+    req.fd = target.fd;
+    req.flags = target.flags;
+    return *this;
+  }
+
+  template <bool Const>
+  auto add_transfer(io_opcode opcode,
+                    detail::io_target target,
+                    detail::io_buffer<Const> data,
+                    std::uint64_t offset) -> io_chain& {
+    if (data.size > io_request::max_transfer) {
+      throw mfile_system_error{EINVAL, "linked transfer is too large"};
+    }
+    add(opcode, target);
+    auto& req = requests_.back();
+    req.flags = static_cast<std::uint8_t>(req.flags | data.flags);
+    req.buf_index = data.index;
+    req.data = data.data;
+    req.size = static_cast<std::uint32_t>(data.size);
+    req.offset = offset;
+    return *this;
+  }
+};
+
+namespace detail {
+
+class chain_awaitable final {
+ public:
+  chain_awaitable(io_context& ctx,
+                  const io_chain& chain,
+                  std::stop_token stop)
+      : ctx_{&ctx}, stop_{std::move(stop)} {
+    auto const requests = chain.requests();
+    links_.reserve(requests.size());
+    for (std::size_t i = 0; i < requests.size(); ++i) {
+      links_.emplace_back(this).request = requests[i];
+    }
+    if (chain.drained() && !links_.empty()) {
+      auto& flags = links_.front().request.flags;
+      flags = static_cast<std::uint8_t>(flags | io_request::drain);
+    }
+  }
+
+  chain_awaitable(const chain_awaitable&) = delete;
+  chain_awaitable(chain_awaitable&&) = delete;
+  auto operator=(const chain_awaitable&) -> chain_awaitable& = delete;
+  auto operator=(chain_awaitable&&) -> chain_awaitable& = delete;
+  ~chain_awaitable() = default;
+
+  [[nodiscard]]
+  auto await_ready() const noexcept -> bool {
+    return links_.empty();
+  }
+
+  // Returns false without submitting if a stop was requested already.
+  auto await_suspend(std::coroutine_handle<> waiter) -> bool {
+    waiter_ = waiter;
+    if (stop_.stop_requested()) {
+      stopped_early_ = true;
+      return false;
+    }
+    auto ops = std::vector<io_operation*>{};
+    ops.reserve(links_.size());
+    for (auto& link : links_) {
+      ops.push_back(&link);
+    }
+    if (stop_.stop_possible()) {
+      ctx_->enable_remote_wake();
+      stop_callback_.emplace(stop_, canceller{this});
+    }
+    remaining_ = links_.size();
+    try {
+      ctx_->submit_linked(ops);
+    } catch (...) {
+      finish();
+      throw;
+    }
+    return true;
+  }
+
+  void await_resume() const {
+    if (stopped_early_) {
+      throw_cancelled(0);
+    }
+    // Links after the one that broke the chain report -ECANCELED
+    for (std::size_t i = 0; i < links_.size(); ++i) {
+      auto const& req = links_[i].request;
+      auto const result = links_[i].result;
+      auto const write = req.opcode == io_opcode::write;
+      auto const read = req.opcode == io_opcode::read;
+      if ((result == -ECANCELED || result == -EINTR)
+          && stop_.stop_requested()) {
+        throw_cancelled(i);
+      }
+      if (result < 0) {
+        throw link_error{i, std::error_code{-result, std::system_category()},
+                         write  ? "linked pwrite failed"
+                         : read ? "linked pread failed"
+                                : "linked sync failed"};
+      }
+      if ((write || read) && static_cast<std::uint32_t>(result) != req.size) {
+        throw link_error{
+            i,
+            make_error_code(write ? errc::insufficient_space
+                                  : errc::end_of_file),
+            write ? "linked pwrite was short" : "linked pread was short"};
+      }
+    }
+  }
+
+ private:
+  struct link_operation final : io_operation {
+    explicit link_operation(chain_awaitable* chain) noexcept
+        : parent{chain} {}
+
+    chain_awaitable* parent;
+    std::int32_t result{};
+
+    void on_complete(std::int32_t res) override {
+      result = res;
+      if (--parent->remaining_ == 0) {
+        parent->finish();
+        parent->waiter_.resume();
+      }
+    }
+  };
+
+  struct canceller {
+    chain_awaitable* self;
+
+    // Cancelling the running link cancels the rest of the chain with it
+    void operator()() const noexcept {
+      try {
+        for (auto& link : self->links_) {
+          self->ctx_->post_cancel(link);
+        }
+      } catch (...) {  // NOLINT(bugprone-empty-catch)
+        // Out of memory; the chain runs to completion instead
+      }
+    }
+  };
+
+  io_context* ctx_;
+  std::vector<link_operation> links_;
+  std::size_t remaining_{};
+  std::coroutine_handle<> waiter_;
+  std::stop_token stop_;
+  std::optional<std::stop_callback<canceller>> stop_callback_;
+  bool stopped_early_{};
+
+  [[noreturn]]
+  static void throw_cancelled(std::size_t link) {
+    throw link_error{link, make_error_code(errc::operation_cancelled),
+                     "linked I/O cancelled"};
+  }
+
+  // Blocks until a concurrently running stop callback returned, so no
+  // cancellation can be posted for the links afterwards.
+  void finish() noexcept {
+    stop_callback_.reset();
+    for (auto const& link : links_) {
+      ctx_->withdraw_cancel(link);
+    }
+  }
+};
+
+}  // namespace detail
+
+// Low-level API
+template <async_file File>
+[[nodiscard]]
+auto async_pread_once(io_context& ctx,
+                      const File& f,
+                      detail::io_buffer<false> data,
+                      std::uint64_t offset,
+                      async_options options = {}) {
+  return detail::rw_awaitable<false, detail::transfer_mode::once>{
+      ctx, detail::io_target_of(f), data, offset, options};
+}
+
+template <async_file File>
+[[nodiscard]]
+auto async_pwrite_once(io_context& ctx,
+                       const File& f,
+                       detail::io_buffer<true> data,
+                       std::uint64_t offset,
+                       async_options options = {}) {
+  return detail::rw_awaitable<true, detail::transfer_mode::once>{
+      ctx, detail::io_target_of(f), data, offset, options};
+}
+
+// Mid-level API
+template <async_file File>
+[[nodiscard]]
+auto async_pread(io_context& ctx,
+                 const File& f,
+                 detail::io_buffer<false> data,
+                 std::uint64_t offset,
+                 async_options options = {}) {
+  return detail::rw_awaitable<false, detail::transfer_mode::full>{
+      ctx, detail::io_target_of(f), data, offset, options};
+}
+
+template <async_file File>
+[[nodiscard]]
+auto async_pwrite(io_context& ctx,
+                  const File& f,
+                  detail::io_buffer<true> data,
+                  std::uint64_t offset,
+                  async_options options = {}) {
+  return detail::rw_awaitable<true, detail::transfer_mode::full>{
+      ctx, detail::io_target_of(f), data, offset, options};
+}
+
+// High-level API
+template <async_file File>
+[[nodiscard]]
+auto async_pread_exact(io_context& ctx,
+                       const File& f,
+                       detail::io_buffer<false> data,
+                       std::uint64_t offset,
+                       async_options options = {}) {
+  return detail::rw_awaitable<false, detail::transfer_mode::exact>{
+      ctx, detail::io_target_of(f), data, offset, options};
+}
+
+template <async_file File>
+[[nodiscard]]
+auto async_pwrite_exact(io_context& ctx,
+                        const File& f,
+                        detail::io_buffer<true> data,
+                        std::uint64_t offset,
+                        async_options options = {}) {
+  return detail::rw_awaitable<true, detail::transfer_mode::exact>{
+      ctx, detail::io_target_of(f), data, offset, options};
+}
+
+template <async_file File>
+[[nodiscard]]
+auto async_sync(io_context& ctx,
+                const File& f,
+                async_options options = {}) {
+  return detail::sync_awaitable{ctx, detail::io_target_of(f),
+                                io_opcode::fsync, options};
+}
+
+// Runs the chain and completes when its last link did. Throws link_error
+// naming the first link that failed, with errc::operation_cancelled once a
+// stop is requested on stop, from any thread. Chains take no timeout: the
+// kernel does not arm a link's IORING_OP_LINK_TIMEOUT when the link before
+// it ran in an io-wq worker, so a deadline would not be kept. Request a stop
+// when it passes instead.
+[[nodiscard]]
+inline auto async_chain(io_context& ctx,
+                        const io_chain& chain,
+                        std::stop_token stop = {}) {
+  return detail::chain_awaitable{ctx, chain, std::move(stop)};
+}
+
+}  // namespace mfile
@@ -0,0 +1,450 @@
+// mfile - A modern C++20 file handling library
+// (https://github.com/range3/mfile)
+// Licensed under MIT License
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <span>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mfile/io_context.hpp"
+#include "mfile/mfile.hpp"
+
+// Bulk loading of many small files:
+//
+//   auto files = mfile::load_files(ctx, paths);
+//   for (std::size_t i = 0; i < files.size(); ++i) {
+//     if (!files.error(i)) consume(files.data(i));
+//   }
+//
+// Every file is opened with openat, sized with fstat on the new descriptor
+// and read with its close linked behind the read, all submitted through
+// the io_context, so on io_uring hundreds of files share one io_uring_enter
+// and each path is resolved once. Contents are packed back to back into a
+// few large blocks.
+
+namespace mfile {
+
+namespace detail {
+class file_loader;
+}  // namespace detail
+
+struct load_options {
+  // Files processed concurrently; each holds one descriptor at most.
+  std::size_t max_in_flight = 256;
+  // Directory relative paths are resolved against, or AT_FDCWD.
+  int dirfd = AT_FDCWD;
+  int open_flags = O_RDONLY | O_CLOEXEC;
+  // Larger files fail with EFBIG instead of being loaded.
+  std::uint64_t max_file_size = std::numeric_limits<std::uint32_t>::max();
+  // Contents are packed into blocks of this size; larger files get a block
+  // of their own.
+  std::size_t block_size = std::size_t{64} << 20U;
+};
+
+// The contents of a batch of files, in the order of the paths given.
+class loaded_files {
+ public:
+  [[nodiscard]]
+  auto size() const noexcept -> std::size_t {
+    return entries_.size();
+  }
+
+  // Contents of file i; empty if loading it failed.
+  [[nodiscard]]
+  auto data(std::size_t i) const noexcept -> cbyte_view {
+    auto const& e = entries_[i];
+    return {e.data, e.size};
+  }
+
+  // Why file i could not be loaded; empty on success.
+  [[nodiscard]]
+  auto error(std::size_t i) const noexcept -> std::error_code {
+    auto const err = entries_[i].error;
+    return err == 0 ? std::error_code{}
+                    : std::error_code{err, std::system_category()};
+  }
+
+  // Bytes loaded from all files.
+  [[nodiscard]]
+  auto total_size() const noexcept -> std::size_t {
+    return total_size_;
+  }
+
+ private:
+  friend class detail::file_loader;
+
+  struct entry {
+    const std::byte* data{};
+    std::size_t size{};
+    int error{};
+  };
+
+  std::vector<std::unique_ptr<std::byte[]>> blocks_;  // NOLINT
+  std::size_t total_size_{};
+  std::vector<entry> entries_;
+};
+
+namespace detail {
+
+// Drives one batch in a single pass over the paths. A file costs two
+// round trips through the context: openat, then a read of the size fstat
+// reports with the close linked behind it. Up to max_in_flight files are in
+// progress; finishing one immediately starts the next. Regular files
+// reporting size 0, such as those in /proc, are read to EOF into a buffer
+// and then copied into a block.
+class file_loader {
+ public:
+  file_loader(io_context& ctx,
+              std::span<const char* const> paths,
+              const load_options& options)
+      : ctx_{&ctx}, paths_{paths}, options_{options} {}
+
+  // Runs ctx until the batch's own operations are done, leaving other work
+  // on the context alone. ops_ must outlive every submitted operation, so
+  // on failure the rest are still waited for before rethrowing.
+  auto run() -> loaded_files {
+    auto result = loaded_files{};
+    result_ = &result;
+    result.entries_.resize(paths_.size());
+    auto const window = std::clamp<std::size_t>(options_.max_in_flight, 1,
+                                                std::max<std::size_t>(
+                                                    paths_.size(), 1));
+    ops_ = std::make_unique<file_operation[]>(window);  // NOLINT
+    try {
+      for (std::size_t i = 0; i < window; ++i) {
+        ops_[i].loader = this;
+        ops_[i].closer.owner = &ops_[i];
+        start_next(ops_[i]);
+      }
+      while (in_flight_ > 0) {
+        ctx_->run_one();
+      }
+    } catch (...) {
+      next_ = paths_.size();
+      drain();
+      throw;
+    }
+    return result;
+  }
+
+ private:
+  enum class stage : std::uint8_t { open, read, read_close, close };
+
+  static constexpr std::size_t unsized_chunk = 4096;
+
+  struct file_operation;
+
+  struct close_operation final : io_operation {
+    file_operation* owner{};
+
+    void on_complete(std::int32_t result) override {
+      owner->close_result = result;
+      owner->loader->completed(*owner);
+    }
+  };
+
+  struct file_operation final : io_operation {
+    file_loader* loader{};
+    close_operation closer;
+    std::size_t file{};
+    stage step{};
+    // Operations of step still to complete, and their results
+    int pending{};
+    std::int32_t result{};
+    std::int32_t close_result{};
+    // The descriptor, while no close for it is submitted
+    int fd = -1;
+    // Size fstat reported; 0 reads to EOF into buffer
+    std::uint64_t size{};
+    std::uint64_t done{};
+    std::byte* dest{};
+    std::vector<std::byte> buffer;
+
+    void on_complete(std::int32_t res) override {
+      result = res;
+      loader->completed(*this);
+    }
+  };
+
+  io_context* ctx_;
+  std::span<const char* const> paths_;
+  load_options options_;
+  loaded_files* result_{};
+  std::unique_ptr<file_operation[]> ops_;  // NOLINT(*-avoid-c-arrays)
+  std::size_t next_{};
+  std::size_t in_flight_{};
+  // Free space of the current block
+  std::byte* block_next_{};
+  std::size_t block_left_{};
+
+  void drain() noexcept {
+    // run_one() returns 0 only once nothing at all is outstanding
+    while (in_flight_ > 0) {
+      try {
+        if (ctx_->run_one() == 0) {
+          return;
+        }
+      } catch (...) {  // NOLINT(bugprone-empty-catch)
+      }
+    }
+  }
+
+  void submit(file_operation& op, io_operation& io) {
+    ctx_->submit(io);
+    op.pending = 1;
+    ++in_flight_;
+  }
+
+  void completed(file_operation& op) {
+    --in_flight_;
+    if (--op.pending > 0) {
+      return;
+    }
+    try {
+      settle(op);
+    } catch (...) {
+      // Nothing took the descriptor over
+      if (op.fd != -1) {
+        ::close(op.fd);
+        op.fd = -1;
+      }
+      throw;
+    }
+  }
+
+  // Starts the next file on op, if any.
+  void start_next(file_operation& op) {
+    if (next_ == paths_.size()) {
+      return;
+    }
+    op.file = next_++;
+    op.step = stage::open;
+    op.request = {};
+    op.request.opcode = io_opcode::openat;
+    op.request.fd = options_.dirfd;
+    op.request.path = paths_[op.file];
+    op.request.path_flags = options_.open_flags;
+    submit(op, op);
+  }
+
+  // Moves op on once everything of its step has completed.
+  void settle(file_operation& op) {
+    switch (op.step) {
+      case stage::open:
+        if (op.result < 0) {
+          fail(op, -op.result);
+          start_next(op);
+          return;
+        }
+        op.fd = op.result;
+        opened(op);
+        return;
+      case stage::read_close:
+        if (op.close_result != -ECANCELED) {
+          // The close only runs after a complete read
+          op.done = op.size;
+          keep(op);
+          start_next(op);
+          return;
+        }
+        // The read failed or came up short; the file is still open
+        op.fd = op.closer.request.fd;
+        [[fallthrough]];
+      case stage::read:
+        if (op.result == -EINTR || op.result == -EAGAIN) {
+          read_more(op);
+          return;
+        }
+        if (op.result < 0) {
+          fail(op, -op.result);
+          close(op);
+          return;
+        }
+        op.done += static_cast<std::uint64_t>(op.result);
+        if (op.size == 0 && op.done > options_.max_file_size) {
+          fail(op, EFBIG);
+          close(op);
+          return;
+        }
+        // A file that grew since fstat is cut at the size it had then
+        if (op.result != 0 && (op.size == 0 || op.done < op.size)) {
+          read_more(op);
+          return;
+        }
+        keep(op);
+        close(op);
+        return;
+      case stage::close:
+        start_next(op);
+        return;
+    }
+  }
+
+  void opened(file_operation& op) {
+    struct stat st {};
+    if (::fstat(op.fd, &st) == -1) {
+      fail(op, errno);
+      close(op);
+      return;
+    }
+    op.size = static_cast<std::uint64_t>(st.st_size);
+    op.done = 0;
+    op.dest = nullptr;
+    if (S_ISDIR(st.st_mode)) {
+      fail(op, EISDIR);
+      close(op);
+      return;
+    }
+    if (op.size > options_.max_file_size) {
+      fail(op, EFBIG);
+      close(op);
+      return;
+    }
+    if (op.size == 0) {
+      if (!S_ISREG(st.st_mode)) {
+        keep(op);
+        close(op);
+        return;
+      }
+      // Possibly generated on read: its size is only known at EOF
+      op.buffer.clear();
+      read_more(op);
+      return;
+    }
+    op.dest = place(static_cast<std::size_t>(op.size));
+    if (op.size > io_request::max_transfer) {
+      read_more(op);
+      return;
+    }
+    op.step = stage::read_close;
+    op.request = {};
+    op.request.opcode = io_opcode::read;
+    op.request.fd = op.fd;
+    op.request.data = op.dest;
+    op.request.size = static_cast<std::uint32_t>(op.size);
+    op.closer.request = {};
+    op.closer.request.opcode = io_opcode::close;
+    op.closer.request.fd = op.fd;
+    auto const chain = std::array<io_operation*, 2>{&op, &op.closer};
+    ctx_->submit_linked(chain);
+    op.pending = 2;
+    in_flight_ += 2;
+    op.fd = -1;
+  }
+
+  void read_more(file_operation& op) {
+    op.step = stage::read;
+    op.request = {};
+    op.request.opcode = io_opcode::read;
+    op.request.fd = op.fd;
+    op.request.offset = op.done;
+    if (op.size == 0) {
+      // Grows the buffer geometrically; one byte past max_file_size tells
+      // a file that is too large
+      auto& buffer = op.buffer;
+      if (buffer.size() == op.done) {
+        constexpr auto max = std::numeric_limits<std::uint64_t>::max();
+        auto const limit =
+            options_.max_file_size + (options_.max_file_size < max ? 1 : 0);
+        buffer.resize(static_cast<std::size_t>(std::min<std::uint64_t>(
+            std::max<std::size_t>(buffer.size() * 2, unsized_chunk), limit)));
+      }
+      op.request.data = buffer.data() + op.done;
+      op.request.size = static_cast<std::uint32_t>(std::min<std::uint64_t>(
+          buffer.size() - op.done, io_request::max_transfer));
+    } else {
+      op.request.data = op.dest + op.done;
+      op.request.size = static_cast<std::uint32_t>(std::min<std::uint64_t>(
+          op.size - op.done, io_request::max_transfer));
+    }
+    submit(op, op);
+  }
+
+  void close(file_operation& op) {
+    op.step = stage::close;
+    op.closer.request = {};
+    op.closer.request.opcode = io_opcode::close;
+    op.closer.request.fd = op.fd;
+    submit(op, op.closer);
+    op.fd = -1;
+  }
+
+  // Room for size bytes in the current block, or in a block of their own
+  // when they would not fit in an empty one.
+  auto place(std::size_t size) -> std::byte* {
+    auto& blocks = result_->blocks_;
+    if (size > options_.block_size) {
+      blocks.push_back(
+          std::make_unique_for_overwrite<std::byte[]>(size));  // NOLINT
+      return blocks.back().get();
+    }
+    if (size > block_left_) {
+      blocks.push_back(std::make_unique_for_overwrite<std::byte[]>(  // NOLINT
+          options_.block_size));
+      block_next_ = blocks.back().get();
+      block_left_ = options_.block_size;
+    }
+    auto* p = block_next_;
+    block_next_ += size;  // NOLINT
+    block_left_ -= size;
+    return p;
+  }
+
+  // Records the op.done bytes read as the contents of op.file.
+  void keep(file_operation& op) {
+    auto const size = static_cast<std::size_t>(op.done);
+    if (op.size == 0 && size != 0) {
+      op.dest = place(size);
+      std::memcpy(op.dest, op.buffer.data(), size);
+    }
+    auto& e = result_->entries_[op.file];
+    e.data = op.dest;
+    e.size = size;
+    result_->total_size_ += size;
+  }
+
+  void fail(file_operation& op, int err) {
+    result_->entries_[op.file].error = err;
+  }
+};
+
+}  // namespace detail
+
+// Loads every file in paths into one arena. Runs ctx until the batch is
+// done. Per-file failures (missing files, directories, permission errors)
+// are reported through loaded_files::error(); only failures of the engine
+// itself throw.
+[[nodiscard]]
+inline auto load_files(io_context& ctx,
+                       std::span<const char* const> paths,
+                       const load_options& options = {}) -> loaded_files {
+  return detail::file_loader{ctx, paths, options}.run();
+}
+
+[[nodiscard]]
+inline auto load_files(io_context& ctx,
+                       std::span<const std::string> paths,
+                       const load_options& options = {}) -> loaded_files {
+  auto pointers = std::vector<const char*>{};
+  pointers.reserve(paths.size());
+  for (auto const& path : paths) {
+    pointers.push_back(path.c_str());
+  }
+  return load_files(ctx, pointers, options);
+}
+
+}  // namespace mfile
@@ -0,0 +1,540 @@
+// mfile - A modern C++20 file handling library
+// (https://github.com/range3/mfile)
+// Licensed under MIT License
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <new>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "mfile/aligned_buffer.hpp"
+#include "mfile/huge_pages.hpp"
+#include "mfile/mfile.hpp"
+
+// Fixed-size, aligned I/O buffers carved from one allocation and handed out
+// as RAII leases, so that reader threads stop going through malloc:
+//
+//   auto pool = mfile::buffer_pool{{.buffer_size = 1 << 20, .count = 64}};
+//   auto lease = pool.pread(f, 1 << 20, offset);  // instead of a vector
+//   auto reader = mfile::buffered_reader{f, 0, mfile::no_digest{},
+//                                        pool.lease()};
+//
+// Each thread keeps a few free buffers in a cache of its own; the rest sit
+// on a list shared by all threads. Both are lock-free stacks, so a thread
+// that finds the shared list empty takes from the others' caches without
+// locking. Leases convert to byte_view, so they are accepted wherever a
+// buffer is, including the async_* functions.
+
+namespace mfile {
+
+struct buffer_pool_options {
+  std::size_t buffer_size = std::size_t{128} << 10U;
+  // Of every buffer. The default suits O_DIRECT on most devices.
+  std::size_t alignment = 4096;
+  std::size_t count = 64;
+  // Free buffers a thread keeps before returning them to the shared list.
+  // Other threads take from these caches only when the list runs dry.
+  std::size_t thread_cache = 8;
+  huge_page_mode huge_pages = huge_page_mode::off;
+};
+
+namespace detail {
+
+class buffer_pool_core
+    : public std::enable_shared_from_this<buffer_pool_core> {
+ public:
+  static constexpr auto nil = std::numeric_limits<std::uint32_t>::max();
+
+  explicit buffer_pool_core(const buffer_pool_options& options)
+      : buffer_size_{options.buffer_size},
+        stride_{checked_stride(options)},
+        count_{checked_count(options.count)},
+        cache_limit_{options.thread_cache},
+        memory_{stride_ * options.count, options.alignment,
+                options.huge_pages},
+        next_{std::make_unique<std::atomic<std::uint32_t>[]>(  // NOLINT
+            options.count)} {
+    if (count_ != 0) {
+      for (std::uint32_t i = 0; i + 1 < count_; ++i) {
+        next_[i].store(i + 1, std::memory_order_relaxed);
+      }
+      next_[count_ - 1].store(nil, std::memory_order_relaxed);
+      head_.store(pack(0, 0), std::memory_order_release);
+    }
+  }
+
+  buffer_pool_core(const buffer_pool_core&) = delete;
+  buffer_pool_core(buffer_pool_core&&) = delete;
+  auto operator=(const buffer_pool_core&) -> buffer_pool_core& = delete;
+  auto operator=(buffer_pool_core&&) -> buffer_pool_core& = delete;
+
+  ~buffer_pool_core() {
+    for (auto* cache = caches_.load(std::memory_order_acquire);
+         cache != nullptr;) {
+      delete std::exchange(cache, cache->next);  // NOLINT
+    }
+  }
+
+  // A free buffer's index, or nil if every buffer is leased.
+  auto acquire() noexcept -> std::uint32_t {
+    auto* cache = local_cache();
+    if (cache != nullptr) {
+      if (auto const index = take(*cache); index != nil) {
+        return index;
+      }
+    }
+    auto const index = pop(head_);
+    if (index == nil) {
+      // Free buffers may still sit in other threads' caches
+      return steal(cache);
+    }
+    if (cache != nullptr) {
+      // Refills half the cache
+      for (auto n = cache_limit_ / 2; n > 0; --n) {
+        auto const extra = pop(head_);
+        if (extra == nil) {
+          break;
+        }
+        put(*cache, extra);
+      }
+    }
+    return index;
+  }
+
+  void release(std::uint32_t index) noexcept {
+    auto* cache = local_cache();
+    if (cache == nullptr) {
+      push_list(head_, index, index);
+      return;
+    }
+    if (auto const size = cache->size.load(std::memory_order_relaxed);
+        size >= cache_limit_) {
+      // Keeps half, so a thread alternating lease/release stays local
+      spill(*cache, size - (cache_limit_ / 2));
+    }
+    put(*cache, index);
+  }
+
+  [[nodiscard]]
+  auto buffer(std::uint32_t index) const noexcept -> std::byte* {
+    return const_cast<std::byte*>(memory_.data())  // NOLINT
+           + (static_cast<std::size_t>(index) * stride_);
+  }
+
+  [[nodiscard]]
+  auto buffer_size() const noexcept -> std::size_t {
+    return buffer_size_;
+  }
+  [[nodiscard]]
+  auto stride() const noexcept -> std::size_t {
+    return stride_;
+  }
+  [[nodiscard]]
+  auto count() const noexcept -> std::size_t {
+    return count_;
+  }
+  [[nodiscard]]
+  auto memory() const noexcept -> const aligned_buffer& {
+    return memory_;
+  }
+
+ private:
+  // Free buffers of one thread. Only that thread pushes; others pop when
+  // the shared list is empty. Caches are never freed before the core, so
+  // they are walked without locking, and a cache whose thread exited is
+  // reused by the next new thread.
+  struct cache_type {
+    std::atomic<std::uint64_t> head{pack(0, nil)};
+    // At least the number of buffers on head
+    std::atomic<std::size_t> size{};
+    std::atomic<bool> claimed{true};
+    // Immutable once the cache is published
+    cache_type* next{};
+  };
+
+  struct cache_entry {
+    const buffer_pool_core* core;
+    std::weak_ptr<buffer_pool_core> owner;
+    // nullptr if none could be set up
+    cache_type* cache;
+  };
+
+  struct thread_caches {
+    std::vector<cache_entry> entries;
+
+    thread_caches() = default;
+    thread_caches(const thread_caches&) = delete;
+    thread_caches(thread_caches&&) = delete;
+    auto operator=(const thread_caches&) -> thread_caches& = delete;
+    auto operator=(thread_caches&&) -> thread_caches& = delete;
+
+    ~thread_caches() {
+      for (auto& entry : entries) {
+        if (auto core = entry.owner.lock(); core && entry.cache != nullptr) {
+          core->retire(*entry.cache);
+        }
+      }
+    }
+  };
+
+  std::size_t buffer_size_;
+  std::size_t stride_;
+  std::size_t count_;
+  std::size_t cache_limit_;
+  aligned_buffer memory_;
+  // Successor of each free buffer on the list it is on
+  std::unique_ptr<std::atomic<std::uint32_t>[]> next_;  // NOLINT
+  // Heads of the lists have a tag in the high half against ABA and the
+  // index of the first free buffer in the low half
+  std::atomic<std::uint64_t> head_{pack(0, nil)};
+  std::atomic<cache_type*> caches_{};
+
+  static_assert(std::atomic<std::uint64_t>::is_always_lock_free);
+
+  static auto checked_stride(const buffer_pool_options& options)
+      -> std::size_t {
+    if (!std::has_single_bit(options.alignment)) {
+      throw std::invalid_argument{"alignment must be a power of two"};
+    }
+    return round_up(std::max<std::size_t>(options.buffer_size, 1),
+                    options.alignment);
+  }
+
+  static auto checked_count(std::size_t count) -> std::size_t {
+    if (count >= nil) {
+      throw mfile_system_error{EINVAL, "too many buffers in pool"};
+    }
+    return count;
+  }
+
+  static constexpr auto pack(std::uint64_t tag, std::uint32_t index) noexcept
+      -> std::uint64_t {
+    return (tag << 32U) | index;
+  }
+  static constexpr auto index_of(std::uint64_t head) noexcept
+      -> std::uint32_t {
+    return static_cast<std::uint32_t>(head);
+  }
+  static constexpr auto tag_of(std::uint64_t head) noexcept -> std::uint64_t {
+    return head >> 32U;
+  }
+
+  auto pop(std::atomic<std::uint64_t>& list) noexcept -> std::uint32_t {
+    auto head = list.load(std::memory_order_acquire);
+    while (index_of(head) != nil) {
+      // May read the successor of a buffer another thread just took; the
+      // tag then makes the exchange fail
+      auto const next = next_[index_of(head)].load(std::memory_order_relaxed);
+      if (list.compare_exchange_weak(head, pack(tag_of(head) + 1, next),
+                                     std::memory_order_acquire,
+                                     std::memory_order_acquire)) {
+        return index_of(head);
+      }
+    }
+    return nil;
+  }
+
+  // Pushes the buffers linked from first to last with a single exchange.
+  void push_list(std::atomic<std::uint64_t>& list,
+                 std::uint32_t first,
+                 std::uint32_t last) noexcept {
+    auto head = list.load(std::memory_order_relaxed);
+    do {
+      next_[last].store(index_of(head), std::memory_order_relaxed);
+    } while (!list.compare_exchange_weak(head, pack(tag_of(head) + 1, first),
+                                         std::memory_order_release,
+                                         std::memory_order_relaxed));
+  }
+
+  void put(cache_type& cache, std::uint32_t index) noexcept {
+    // Counted first, so that size never drops below the buffers on head
+    cache.size.fetch_add(1, std::memory_order_relaxed);
+    push_list(cache.head, index, index);
+  }
+
+  auto take(cache_type& cache) noexcept -> std::uint32_t {
+    auto const index = pop(cache.head);
+    if (index != nil) {
+      cache.size.fetch_sub(1, std::memory_order_relaxed);
+    }
+    return index;
+  }
+
+  // Moves up to n buffers from cache to the shared list.
+  void spill(cache_type& cache, std::size_t n) noexcept {
+    auto first = nil;
+    auto last = nil;
+    for (; n > 0; --n) {
+      auto const index = take(cache);
+      if (index == nil) {
+        break;
+      }
+      next_[index].store(first, std::memory_order_relaxed);
+      first = index;
+      if (last == nil) {
+        last = index;
+      }
+    }
+    if (first != nil) {
+      push_list(head_, first, last);
+    }
+  }
+
+  // The calling thread's cache, set up the first time it is used; nullptr
+  // when thread caches are disabled or could not be set up. At thread exit
+  // its buffers go back to the shared list if the core is still alive.
+  auto local_cache() noexcept -> cache_type* {
+    if (cache_limit_ == 0) {
+      return nullptr;
+    }
+    thread_local thread_caches caches;
+    for (auto const& entry : caches.entries) {
+      if (entry.core == this && !entry.owner.expired()) {
+        return entry.cache;
+      }
+    }
+    try {
+      std::erase_if(caches.entries,
+                    [](const cache_entry& e) { return e.owner.expired(); });
+      caches.entries.reserve(caches.entries.size() + 1);
+    } catch (...) {
+      return nullptr;
+    }
+    auto* cache = claim_cache();
+    caches.entries.push_back({this, weak_from_this(), cache});
+    return cache;
+  }
+
+  // A cache no thread is using, or a new one.
+  auto claim_cache() noexcept -> cache_type* {
+    for (auto* cache = caches_.load(std::memory_order_acquire);
+         cache != nullptr; cache = cache->next) {
+      auto unclaimed = false;
+      if (cache->claimed.compare_exchange_strong(unclaimed, true,
+                                                 std::memory_order_acquire)) {
+        return cache;
+      }
+    }
+    auto* cache = new (std::nothrow) cache_type{};  // NOLINT
+    if (cache == nullptr) {
+      return nullptr;
+    }
+    cache->next = caches_.load(std::memory_order_relaxed);
+    while (!caches_.compare_exchange_weak(cache->next, cache,
+                                          std::memory_order_release,
+                                          std::memory_order_relaxed)) {
+    }
+    return cache;
+  }
+
+  // Takes one buffer from another thread's cache.
+  auto steal(const cache_type* own) noexcept -> std::uint32_t {
+    for (auto* cache = caches_.load(std::memory_order_acquire);
+         cache != nullptr; cache = cache->next) {
+      if (cache != own) {
+        if (auto const index = take(*cache); index != nil) {
+          return index;
+        }
+      }
+    }
+    return nil;
+  }
+
+  // Returns the buffers of an exiting thread's cache and frees the cache
+  // for another thread.
+  void retire(cache_type& cache) noexcept {
+    spill(cache, std::numeric_limits<std::size_t>::max());
+    cache.claimed.store(false, std::memory_order_release);
+  }
+};
+
+}  // namespace detail
+
+class buffer_pool;
+
+// A buffer leased from a buffer_pool, returned to it on destruction. Its
+// size starts at the pool's buffer size and can be shrunk to the bytes in
+// use. Leases must be returned before the pool is destroyed.
+class buffer_lease {
+ public:
+  buffer_lease() noexcept = default;
+
+  buffer_lease(const buffer_lease&) = delete;
+  auto operator=(const buffer_lease&) -> buffer_lease& = delete;
+
+  buffer_lease(buffer_lease&& other) noexcept
+      : core_{std::exchange(other.core_, nullptr)},
+        index_{other.index_},
+        size_{std::exchange(other.size_, 0)} {}
+
+  auto operator=(buffer_lease&& other) noexcept -> buffer_lease& {
+    buffer_lease{std::move(other)}.swap(*this);
+    return *this;
+  }
+
+  ~buffer_lease() noexcept { reset(); }
+
+  // Returns the buffer to the pool now.
+  void reset() noexcept {
+    if (core_ != nullptr) {
+      std::exchange(core_, nullptr)->release(index_);
+      size_ = 0;
+    }
+  }
+
+  [[nodiscard]]
+  auto data() const noexcept -> std::byte* {
+    return core_ != nullptr ? core_->buffer(index_) : nullptr;
+  }
+  [[nodiscard]]
+  auto size() const noexcept -> std::size_t {
+    return size_;
+  }
+  [[nodiscard]]
+  auto capacity() const noexcept -> std::size_t {
+    return core_ != nullptr ? core_->buffer_size() : 0;
+  }
+
+  // Sets size() to at most capacity() bytes.
+  void resize(std::size_t size) noexcept { size_ = std::min(size, capacity()); }
+
+  // Position in buffer_pool::memory(), e.g. to address the buffer inside
+  // the pool's memory registered with an io_context.
+  [[nodiscard]]
+  auto offset() const noexcept -> std::size_t {
+    return core_ != nullptr ? core_->stride() * index_ : 0;
+  }
+
+  [[nodiscard]]
+  explicit operator bool() const noexcept {
+    return core_ != nullptr;
+  }
+
+  // NOLINTNEXTLINE
+  operator byte_view() const noexcept { return {data(), size_}; }
+  // NOLINTNEXTLINE
+  operator cbyte_view() const noexcept { return {data(), size_}; }
+
+  void swap(buffer_lease& other) noexcept {
+    using std::swap;
+    swap(core_, other.core_);
+    swap(index_, other.index_);
+    swap(size_, other.size_);
+  }
+
+ private:
+  friend class buffer_pool;
+
+  detail::buffer_pool_core* core_{};
+  std::uint32_t index_{};
+  std::size_t size_{};
+
+  buffer_lease(detail::buffer_pool_core* core, std::uint32_t index) noexcept
+      : core_{core}, index_{index}, size_{core->buffer_size()} {}
+};
+
+inline void swap(buffer_lease& lhs, buffer_lease& rhs) noexcept {
+  lhs.swap(rhs);
+}
+
+class buffer_pool {
+ public:
+  explicit buffer_pool(const buffer_pool_options& options = {})
+      : core_{std::make_shared<detail::buffer_pool_core>(options)} {}
+
+  buffer_pool(const buffer_pool&) = delete;
+  auto operator=(const buffer_pool&) -> buffer_pool& = delete;
+  buffer_pool(buffer_pool&&) = delete;
+  auto operator=(buffer_pool&&) -> buffer_pool& = delete;
+  ~buffer_pool() = default;
+
+  // std::nullopt when every buffer is leased.
+  [[nodiscard]]
+  auto try_lease() -> std::optional<buffer_lease> {
+    auto const index = core_->acquire();
+    if (index == detail::buffer_pool_core::nil) {
+      return std::nullopt;
+    }
+    return buffer_lease{core_.get(), index};
+  }
+
+  // Throws ENOBUFS when try_lease() would return std::nullopt.
+  [[nodiscard]]
+  auto lease() -> buffer_lease {
+    auto lease = try_lease();
+    if (!lease) {
+      throw mfile_system_error{ENOBUFS, "buffer pool is exhausted"};
+    }
+    return std::move(*lease);
+  }
+
+  // Like f.read(size), into a leased buffer instead of a new vector. The
+  // lease's size is the number of bytes read.
+  template <file_handle_like Handle, file_hooks Hooks, metadata_policy Metadata>
+  [[nodiscard]]
+  auto read(const file<Handle, Hooks, Metadata>& f, std::size_t size)
+      -> buffer_lease {
+    auto lease = sized_lease(size);
+    lease.resize(f.read(lease));
+    return lease;
+  }
+
+  // Like f.pread(size, offset), into a leased buffer.
+  template <file_handle_like Handle, file_hooks Hooks, metadata_policy Metadata>
+  [[nodiscard]]
+  auto pread(const file<Handle, Hooks, Metadata>& f,
+             std::size_t size,
+             std::uint64_t offset) -> buffer_lease {
+    auto lease = sized_lease(size);
+    lease.resize(f.pread(lease, offset));
+    return lease;
+  }
+
+  [[nodiscard]]
+  auto buffer_size() const noexcept -> std::size_t {
+    return core_->buffer_size();
+  }
+  [[nodiscard]]
+  auto count() const noexcept -> std::size_t {
+    return core_->count();
+  }
+
+  // The memory all buffers are carved from, e.g. to register it with an
+  // io_context once and address leases as registered.subspan(
+  // lease.offset(), lease.size()).
+  [[nodiscard]]
+  auto memory() const noexcept -> byte_view {
+    auto const& memory = core_->memory();
+    return {const_cast<std::byte*>(memory.data()),  // NOLINT
+            memory.size()};
+  }
+
+  [[nodiscard]]
+  auto huge_pages() const -> huge_page_stats {
+    return core_->memory().huge_pages();
+  }
+
+ private:
+  std::shared_ptr<detail::buffer_pool_core> core_;
+
+  auto sized_lease(std::size_t size) -> buffer_lease {
+    if (size > buffer_size()) {
+      throw mfile_system_error{EINVAL, "read is larger than pool buffers"};
+    }
+    auto lease = this->lease();
+    lease.resize(size);
+    return lease;
+  }
+};
+
+}  // namespace mfile
@@ -0,0 +1,278 @@
+// mfile - A modern C++20 file handling library
+// (https://github.com/range3/mfile)
+// Licensed under MIT License
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <utility>
+
+#include "mfile/buffer_pool.hpp"
+#include "mfile/checksum.hpp"
+#include "mfile/mfile.hpp"
+
+// Sequential buffered I/O on top of the positional API. Both directions
+// take an optional digest (mfile/checksum.hpp) that is updated while the
+// data passes through, while it is still in cache:
+//
+//   auto reader = mfile::buffered_reader{f, 0, mfile::crc32c_digest{}};
+//   reader.read_exact(header);
+//   reader.read_exact(body);
+//   if (reader.digest().value() != expected) ...
+//
+// Instead of allocating, either can use a buffer leased from a buffer_pool
+// (mfile/buffer_pool.hpp), held until it is destroyed.
+
+namespace mfile {
+
+inline constexpr std::size_t default_buffer_size = std::size_t{128} << 10U;
+
+// Reads a file sequentially from a starting offset through a buffer. The
+// file must outlive the reader. Reads at least as large as the buffer
+// bypass it.
+template <typename File, digest Digest = no_digest>
+class buffered_reader {
+ public:
+  using file_type = File;
+  using digest_type = Digest;
+
+  explicit buffered_reader(const File& f,
+                           std::uint64_t offset = 0,
+                           Digest digest = {},
+                           std::size_t buffer_size = default_buffer_size)
+      : file_{&f},
+        owned_{std::make_unique_for_overwrite<std::byte[]>(  // NOLINT
+            buffer_size)},
+        buffer_{owned_.get()},
+        capacity_{buffer_size},
+        offset_{offset},
+        digest_{std::move(digest)} {}
+
+  buffered_reader(const File& f,
+                  std::uint64_t offset,
+                  Digest digest,
+                  buffer_lease buffer)
+      : file_{&f},
+        leased_{std::move(buffer)},
+        buffer_{leased_.data()},
+        capacity_{leased_.capacity()},
+        offset_{offset},
+        digest_{std::move(digest)} {}
+
+  // Reads until data is full or EOF.
+  [[nodiscard]]
+  auto read(byte_view data) -> std::size_t {
+    std::size_t done = 0;
+    while (done < data.size()) {
+      auto const out = data.subspan(done);
+      if (begin_ == end_ && out.size() >= capacity_) {
+        auto const n = file_->pread(out, offset_);
+        digest_.update(out.first(n));
+        offset_ += n;
+        done += n;
+        break;
+      }
+      auto const available = fill();
+      if (available.empty()) {
+        break;
+      }
+      auto const n = std::min(available.size(), out.size());
+      std::memcpy(out.data(), available.data(), n);
+      consume(n);
+      done += n;
+    }
+    return done;
+  }
+
+  void read_exact(byte_view data) {
+    auto const n = read(data);
+    if (n != data.size()) {
+      throw end_of_file_error{n, "Failed to read exact amount of bytes"};
+    }
+  }
+
+  // The unconsumed buffered bytes, reading more first if there are none.
+  // Empty at EOF.
+  auto fill() -> cbyte_view {
+    if (begin_ == end_) {
+      begin_ = 0;
+      end_ = file_->pread(byte_view{buffer_, capacity_}, offset_);
+    }
+    return buffered();
+  }
+
+  // Moves the unconsumed bytes to the front of the buffer and appends as
+  // much as fits. For parsers whose token straddles the end of the buffer.
+  // Returns the number of bytes added; 0 at EOF or when the buffer is full.
+  auto refill() -> std::size_t {
+    // buffer_[end_] lands at file offset offset_ + (end_ - begin_)
+    if (begin_ != 0) {
+      std::memmove(buffer_, buffer_ + begin_, end_ - begin_);
+      end_ -= begin_;
+      begin_ = 0;
+    }
+    if (end_ == capacity_) {
+      return 0;
+    }
+    auto const n = file_->pread(
+        byte_view{buffer_ + end_, capacity_ - end_}, offset_ + end_);
+    end_ += n;
+    return n;
+  }
+
+  [[nodiscard]]
+  auto buffered() const noexcept -> cbyte_view {
+    return {buffer_ + begin_, end_ - begin_};
+  }
+
+  // Marks n buffered bytes as read.
+  void consume(std::size_t n) noexcept {
+    digest_.update({buffer_ + begin_, n});
+    begin_ += n;
+    offset_ += n;
+  }
+
+  // File offset of the next unconsumed byte.
+  [[nodiscard]]
+  auto offset() const noexcept -> std::uint64_t {
+    return offset_;
+  }
+
+  [[nodiscard]]
+  auto capacity() const noexcept -> std::size_t {
+    return capacity_;
+  }
+
+  [[nodiscard]]
+  auto digest() const noexcept -> const Digest& {
+    return digest_;
+  }
+  [[nodiscard]]
+  auto digest() noexcept -> Digest& {
+    return digest_;
+  }
+
+ private:
+  const File* file_;
+  std::unique_ptr<std::byte[]> owned_;  // NOLINT(*-avoid-c-arrays)
+  buffer_lease leased_;
+  std::byte* buffer_;
+  std::size_t capacity_;
+  std::size_t begin_{};
+  std::size_t end_{};
+  std::uint64_t offset_;
+  [[no_unique_address]] Digest digest_;
+};
+
+// Writes a file sequentially from a starting offset through a buffer. The
+// file must outlive the writer. Writes at least as large as the buffer
+// bypass it. The destructor flushes, ignoring errors; call flush() to see
+// them.
+template <typename File, digest Digest = no_digest>
+class buffered_writer {
+ public:
+  using file_type = File;
+  using digest_type = Digest;
+
+  explicit buffered_writer(const File& f,
+                           std::uint64_t offset = 0,
+                           Digest digest = {},
+                           std::size_t buffer_size = default_buffer_size)
+      : file_{&f},
+        owned_{std::make_unique_for_overwrite<std::byte[]>(  // NOLINT
+            buffer_size)},
+        buffer_{owned_.get()},
+        capacity_{buffer_size},
+        offset_{offset},
+        digest_{std::move(digest)} {}
+
+  buffered_writer(const File& f,
+                  std::uint64_t offset,
+                  Digest digest,
+                  buffer_lease buffer)
+      : file_{&f},
+        leased_{std::move(buffer)},
+        buffer_{leased_.data()},
+        capacity_{leased_.capacity()},
+        offset_{offset},
+        digest_{std::move(digest)} {}
+
+  buffered_writer(const buffered_writer&) = delete;
+  buffered_writer(buffered_writer&& other) noexcept
+      : file_{other.file_},
+        owned_{std::move(other.owned_)},
+        leased_{std::move(other.leased_)},
+        buffer_{std::exchange(other.buffer_, nullptr)},
+        capacity_{other.capacity_},
+        used_{std::exchange(other.used_, 0)},
+        offset_{other.offset_},
+        digest_{std::move(other.digest_)} {}
+  auto operator=(const buffered_writer&) -> buffered_writer& = delete;
+  auto operator=(buffered_writer&&) -> buffered_writer& = delete;
+
+  ~buffered_writer() noexcept {
+    if (buffer_) {
+      try {
+        flush();
+      } catch (...) {  // NOLINT(bugprone-empty-catch)
+      }
+    }
+  }
+
+  // Throws insufficient_space_error like write_exact().
+  void write(cbyte_view data) {
+    digest_.update(data);
+    if (used_ + data.size() <= capacity_) {
+      std::memcpy(buffer_ + used_, data.data(), data.size());
+      used_ += data.size();
+      return;
+    }
+    flush();
+    if (data.size() >= capacity_) {
+      file_->pwrite_exact(data, offset_);
+      offset_ += data.size();
+      return;
+    }
+    std::memcpy(buffer_, data.data(), data.size());
+    used_ = data.size();
+  }
+
+  void flush() {
+    if (used_ == 0) {
+      return;
+    }
+    file_->pwrite_exact(cbyte_view{buffer_, used_}, offset_);
+    offset_ += used_;
+    used_ = 0;
+  }
+
+  // File offset the next write lands at.
+  [[nodiscard]]
+  auto offset() const noexcept -> std::uint64_t {
+    return offset_ + used_;
+  }
+
+  [[nodiscard]]
+  auto digest() const noexcept -> const Digest& {
+    return digest_;
+  }
+  [[nodiscard]]
+  auto digest() noexcept -> Digest& {
+    return digest_;
+  }
+
+ private:
+  const File* file_;
+  std::unique_ptr<std::byte[]> owned_;  // NOLINT(*-avoid-c-arrays)
+  buffer_lease leased_;
+  std::byte* buffer_;
+  std::size_t capacity_;
+  std::size_t used_{};
+  std::uint64_t offset_;
+  [[no_unique_address]] Digest digest_;
+};
+
+}  // namespace mfile
@@ -0,0 +1,278 @@
+// mfile - A modern C++20 file handling library
+// (https://github.com/range3/mfile)
+// Licensed under MIT License
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cerrno>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "mfile/crc32c.hpp"
+#include "mfile/mfile.hpp"
+
+// Streaming digests, computed while data passes through the buffered
+// reader and writer (mfile/buffered.hpp) instead of in a second sweep over
+// memory, and helpers for files stored as fixed-size checksummed blocks.
+
+namespace mfile {
+
+// update() may be called with consecutive pieces of the data; value() is
+// the digest of everything seen so far.
+template <typename T>
+concept digest = std::default_initializable<T> && requires(T& d,
+                                                           const T& cd,
+                                                           cbyte_view data) {
+  d.update(data);
+  { cd.value() } -> std::unsigned_integral;
+};
+
+template <digest Digest>
+using digest_value_t = decltype(std::declval<const Digest&>().value());
+
+// Digest that does nothing; the default of the buffered layer.
+struct no_digest {
+  constexpr void update(cbyte_view /*data*/) const noexcept {}
+  [[nodiscard]]
+  constexpr auto value() const noexcept -> std::uint32_t {
+    return 0;
+  }
+};
+
+class crc32c_digest {
+ public:
+  void update(cbyte_view data) noexcept { crc_ = crc32c(data, crc_); }
+
+  [[nodiscard]]
+  auto value() const noexcept -> std::uint32_t {
+    return crc_;
+  }
+
+  void reset() noexcept { crc_ = 0; }
+
+ private:
+  std::uint32_t crc_{};
+};
+
+// XXH64 (https://github.com/Cyan4973/xxHash), much faster than CRC-32C
+// where the hardware CRC instruction is unavailable.
+class xxh64_digest {
+ public:
+  xxh64_digest() noexcept { reset(); }
+  explicit xxh64_digest(std::uint64_t seed) noexcept : seed_{seed} {
+    reset();
+  }
+
+  void update(cbyte_view data) noexcept {
+    auto const* p = data.data();
+    auto n = data.size();
+    total_ += n;
+    if (pending_ != 0) {
+      auto const take = std::min(n, stripe - pending_);
+      std::memcpy(buffer_.data() + pending_, p, take);
+      pending_ += take;
+      p += take;  // NOLINT
+      n -= take;
+      if (pending_ < stripe) {
+        return;
+      }
+      consume(buffer_.data());
+      pending_ = 0;
+    }
+    for (; n >= stripe; n -= stripe, p += stripe) {  // NOLINT
+      consume(p);
+    }
+    std::memcpy(buffer_.data(), p, n);
+    pending_ = n;
+  }
+
+  [[nodiscard]]
+  auto value() const noexcept -> std::uint64_t {
+    std::uint64_t h{};
+    if (total_ >= stripe) {
+      h = std::rotl(acc_[0], 1) + std::rotl(acc_[1], 7)
+          + std::rotl(acc_[2], 12) + std::rotl(acc_[3], 18);
+      for (auto const a : acc_) {
+        h = ((h ^ round(0, a)) * prime1) + prime4;
+      }
+    } else {
+      h = seed_ + prime5;
+    }
+    h += total_;
+
+    auto const* p = buffer_.data();
+    auto n = pending_;
+    for (; n >= 8; n -= 8, p += 8) {  // NOLINT
+      h ^= round(0, load<std::uint64_t>(p));
+      h = (std::rotl(h, 27) * prime1) + prime4;
+    }
+    if (n >= 4) {
+      h ^= load<std::uint32_t>(p) * prime1;
+      h = (std::rotl(h, 23) * prime2) + prime3;
+      p += 4;  // NOLINT
+      n -= 4;
+    }
+    for (; n > 0; --n, ++p) {  // NOLINT
+      h ^= static_cast<std::uint64_t>(*p) * prime5;
+      h = std::rotl(h, 11) * prime1;
+    }
+
+    h ^= h >> 33U;
+    h *= prime2;
+    h ^= h >> 29U;
+    h *= prime3;
+    h ^= h >> 32U;
+    return h;
+  }
+
+  void reset() noexcept {
+    acc_ = {seed_ + prime1 + prime2, seed_ + prime2, seed_, seed_ - prime1};
+    total_ = 0;
+    pending_ = 0;
+  }
+
+ private:
+  static constexpr std::uint64_t prime1 = 0x9e3779b185ebca87ULL;
+  static constexpr std::uint64_t prime2 = 0xc2b2ae3d27d4eb4fULL;
+  static constexpr std::uint64_t prime3 = 0x165667b19e3779f9ULL;
+  static constexpr std::uint64_t prime4 = 0x85ebca77c2b2ae63ULL;
+  static constexpr std::uint64_t prime5 = 0x27d4eb2f165667c5ULL;
+  static constexpr std::size_t stripe = 32;
+
+  std::uint64_t seed_{};
+  std::array<std::uint64_t, 4> acc_{};
+  std::uint64_t total_{};
+  std::array<std::byte, stripe> buffer_{};
+  std::size_t pending_{};
+
+  template <typename T>
+  static auto load(const std::byte* p) noexcept -> T {
+    T v{};
+    std::memcpy(&v, p, sizeof(v));
+    if constexpr (std::endian::native == std::endian::big) {
+      if constexpr (sizeof(T) == 8) {
+        v = __builtin_bswap64(v);
+      } else {
+        v = __builtin_bswap32(v);
+      }
+    }
+    return v;
+  }
+
+  static constexpr auto round(std::uint64_t acc, std::uint64_t input) noexcept
+      -> std::uint64_t {
+    return std::rotl(acc + (input * prime2), 31) * prime1;
+  }
+
+  void consume(const std::byte* p) noexcept {
+    for (std::size_t i = 0; i < 4; ++i) {
+      acc_[i] = round(acc_[i], load<std::uint64_t>(p + (8 * i)));  // NOLINT
+    }
+  }
+};
+
+// Thrown when data does not match its stored checksum.
+class checksum_error : public mfile_error {
+ public:
+  checksum_error(std::size_t block, std::string_view what_arg)
+      : mfile_error{make_error_code(errc::checksum_mismatch), what_arg},
+        block_{block} {}
+
+  // Zero-based index of the first block that failed verification.
+  [[nodiscard]]
+  auto block() const noexcept -> std::size_t {
+    return block_;
+  }
+
+ private:
+  std::size_t block_;
+};
+
+namespace detail {
+inline void check_block_size(std::size_t block_size) {
+  if (block_size == 0) {
+    throw mfile_system_error{EINVAL, "block size must not be zero"};
+  }
+}
+}  // namespace detail
+
+// Digest of each block_size piece of data; the last one may be shorter.
+template <digest Digest = crc32c_digest>
+[[nodiscard]]
+auto block_digests(cbyte_view data, std::size_t block_size)
+    -> std::vector<digest_value_t<Digest>> {
+  detail::check_block_size(block_size);
+  auto result = std::vector<digest_value_t<Digest>>{};
+  result.reserve((data.size() + block_size - 1) / block_size);
+  for (std::size_t pos = 0; pos < data.size(); pos += block_size) {
+    auto d = Digest{};
+    d.update(data.subspan(pos, std::min(block_size, data.size() - pos)));
+    result.push_back(d.value());
+  }
+  return result;
+}
+
+// Index of the first block of data whose digest differs from expected, or
+// nullopt if all match.
+template <digest Digest = crc32c_digest>
+[[nodiscard]]
+auto find_mismatched_block(cbyte_view data,
+                           std::size_t block_size,
+                           std::span<const digest_value_t<Digest>> expected)
+    -> std::optional<std::size_t> {
+  detail::check_block_size(block_size);
+  std::size_t block = 0;
+  for (std::size_t pos = 0; pos < data.size(); pos += block_size, ++block) {
+    auto d = Digest{};
+    d.update(data.subspan(pos, std::min(block_size, data.size() - pos)));
+    if (block >= expected.size() || d.value() != expected[block]) {
+      return block;
+    }
+  }
+  return std::nullopt;
+}
+
+namespace detail {
+// Bytes read per system call by pread_verified(); small enough that each
+// piece is still in cache when it is checksummed.
+inline constexpr std::size_t verify_chunk = std::size_t{256} << 10U;
+}  // namespace detail
+
+// pread_exact() of whole blocks, verifying each against expected right
+// after it arrived. Throws checksum_error naming the first bad block,
+// counted from offset.
+template <digest Digest = crc32c_digest,
+          file_handle_like Handle,
+          file_hooks Hooks,
+          metadata_policy Metadata>
+void pread_verified(const file<Handle, Hooks, Metadata>& f,
+                    byte_view data,
+                    std::uint64_t offset,
+                    std::size_t block_size,
+                    std::span<const digest_value_t<Digest>> expected) {
+  detail::check_block_size(block_size);
+  auto const chunk = std::max(block_size,
+                              detail::verify_chunk / block_size * block_size);
+  for (std::size_t pos = 0; pos < data.size(); pos += chunk) {
+    auto const piece = data.subspan(pos, std::min(chunk, data.size() - pos));
+    f.pread_exact(piece, offset + pos);
+    auto const first = pos / block_size;
+    auto const bad = find_mismatched_block<Digest>(
+        piece, block_size,
+        expected.subspan(std::min(first, expected.size())));
+    if (bad) {
+      throw checksum_error{first + *bad, "block checksum mismatch"};
+    }
+  }
+}
+
+}  // namespace mfile
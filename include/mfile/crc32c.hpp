@@ -0,0 +1,217 @@
+// mfile - A modern C++20 file handling library
+// (https://github.com/range3/mfile)
+// Licensed under MIT License
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "mfile/mfile.hpp"
+
+#if defined(__x86_64__)
+#  include <nmmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#  include <arm_acle.h>
+#endif
+
+// CRC-32C (Castagnoli), as used by iSCSI, ext4 and most record formats.
+// Uses the SSE4.2 crc32 instruction when the CPU has it (checked once at
+// run time), the ARMv8 CRC extension when compiled for it, and
+// slicing-by-8 tables otherwise.
+//
+// The instruction has a latency of three cycles but a throughput of one,
+// so large inputs are split into three interleaved streams whose CRCs are
+// merged with a precomputed "append crc32c_stream_block zero bytes"
+// operator.
+
+namespace mfile {
+
+namespace detail {
+
+inline constexpr std::uint32_t crc32c_poly = 0x82f63b78U;  // reflected
+
+consteval auto make_crc32c_tables()
+    -> std::array<std::array<std::uint32_t, 256>, 8> {
+  auto tables = std::array<std::array<std::uint32_t, 256>, 8>{};
+  for (std::uint32_t i = 0; i < 256; ++i) {
+    auto crc = i;
+    for (int bit = 0; bit < 8; ++bit) {
+      crc = (crc >> 1U) ^ ((crc & 1U) != 0 ? crc32c_poly : 0U);
+    }
+    tables[0][i] = crc;
+  }
+  for (std::size_t t = 1; t < 8; ++t) {
+    for (std::size_t i = 0; i < 256; ++i) {
+      auto const prev = tables[t - 1][i];
+      tables[t][i] = (prev >> 8U) ^ tables[0][prev & 0xffU];
+    }
+  }
+  return tables;
+}
+
+inline constexpr auto crc32c_tables = make_crc32c_tables();
+
+// Bytes per stream and round of the three-way hardware loop.
+inline constexpr std::size_t crc32c_stream_block = 4096;
+
+// GF(2) 32x32 matrix acting on a CRC register; column i is the image of
+// bit i.
+using crc32c_matrix = std::array<std::uint32_t, 32>;
+
+constexpr auto crc32c_apply(const crc32c_matrix& m, std::uint32_t v) noexcept
+    -> std::uint32_t {
+  std::uint32_t result = 0;
+  for (std::size_t i = 0; v != 0; ++i, v >>= 1U) {
+    if ((v & 1U) != 0) {
+      result ^= m[i];
+    }
+  }
+  return result;
+}
+
+// Tables applying the operator that feeds crc32c_stream_block zero bytes
+// through a register, one table per register byte.
+consteval auto make_crc32c_shift_tables()
+    -> std::array<std::array<std::uint32_t, 256>, 4> {
+  // One zero bit, then squared up to 8 * crc32c_stream_block bits
+  auto op = crc32c_matrix{};
+  op[0] = crc32c_poly;
+  for (std::size_t i = 1; i < 32; ++i) {
+    op[i] = std::uint32_t{1} << (i - 1);
+  }
+  for (auto bits = std::size_t{1}; bits < 8 * crc32c_stream_block;
+       bits *= 2) {
+    auto squared = crc32c_matrix{};
+    for (std::size_t i = 0; i < 32; ++i) {
+      squared[i] = crc32c_apply(op, op[i]);
+    }
+    op = squared;
+  }
+  auto tables = std::array<std::array<std::uint32_t, 256>, 4>{};
+  for (std::uint32_t k = 0; k < 4; ++k) {
+    for (std::uint32_t b = 0; b < 256; ++b) {
+      tables[k][b] = crc32c_apply(op, b << (8U * k));
+    }
+  }
+  return tables;
+}
+
+inline constexpr auto crc32c_shift_tables = make_crc32c_shift_tables();
+
+// The register after feeding crc32c_stream_block zero bytes to crc.
+constexpr auto crc32c_shift(std::uint32_t crc) noexcept -> std::uint32_t {
+  auto const& t = crc32c_shift_tables;
+  return t[0][crc & 0xffU] ^ t[1][(crc >> 8U) & 0xffU]
+         ^ t[2][(crc >> 16U) & 0xffU] ^ t[3][crc >> 24U];
+}
+
+// Operates on the inverted CRC register, like the hardware instruction.
+inline auto crc32c_sw(std::uint32_t crc,
+                      const std::byte* p,
+                      std::size_t n) noexcept -> std::uint32_t {
+  auto const& t = crc32c_tables;
+  for (; n >= 8; n -= 8, p += 8) {  // NOLINT
+    std::uint64_t word{};
+    std::memcpy(&word, p, sizeof(word));
+    word ^= crc;
+    crc = t[7][word & 0xffU] ^ t[6][(word >> 8U) & 0xffU]
+          ^ t[5][(word >> 16U) & 0xffU] ^ t[4][(word >> 24U) & 0xffU]
+          ^ t[3][(word >> 32U) & 0xffU] ^ t[2][(word >> 40U) & 0xffU]
+          ^ t[1][(word >> 48U) & 0xffU] ^ t[0][word >> 56U];
+  }
+  for (; n > 0; --n, ++p) {  // NOLINT
+    crc = (crc >> 8U)
+          ^ t[0][(crc ^ static_cast<std::uint32_t>(*p)) & 0xffU];
+  }
+  return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2"))) inline auto crc32c_hw(
+    std::uint32_t crc,
+    const std::byte* p,
+    std::size_t n) noexcept -> std::uint32_t {
+  std::uint64_t crc64 = crc;
+  constexpr auto block = crc32c_stream_block;
+  for (; n >= 3 * block; n -= 3 * block, p += 3 * block) {  // NOLINT
+    std::uint64_t b{};
+    std::uint64_t c{};
+    for (std::size_t i = 0; i < block; i += 8) {
+      std::uint64_t wa{};
+      std::uint64_t wb{};
+      std::uint64_t wc{};
+      std::memcpy(&wa, p + i, sizeof(wa));  // NOLINT
+      std::memcpy(&wb, p + block + i, sizeof(wb));  // NOLINT
+      std::memcpy(&wc, p + (2 * block) + i, sizeof(wc));  // NOLINT
+      crc64 = _mm_crc32_u64(crc64, wa);
+      b = _mm_crc32_u64(b, wb);
+      c = _mm_crc32_u64(c, wc);
+    }
+    // feeding B after A equals shifting A's register by |B| zero bytes and
+    // adding B's register from zero
+    auto const ab = crc32c_shift(static_cast<std::uint32_t>(crc64))
+                    ^ static_cast<std::uint32_t>(b);
+    crc64 = crc32c_shift(ab) ^ static_cast<std::uint32_t>(c);
+  }
+  for (; n >= 8; n -= 8, p += 8) {  // NOLINT
+    std::uint64_t word{};
+    std::memcpy(&word, p, sizeof(word));
+    crc64 = _mm_crc32_u64(crc64, word);
+  }
+  crc = static_cast<std::uint32_t>(crc64);
+  for (; n > 0; --n, ++p) {  // NOLINT
+    crc = _mm_crc32_u8(crc, static_cast<std::uint8_t>(*p));
+  }
+  return crc;
+}
+
+inline auto crc32c_hw_available() noexcept -> bool {
+  static bool const available = __builtin_cpu_supports("sse4.2");
+  return available;
+}
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+inline auto crc32c_hw(std::uint32_t crc,
+                      const std::byte* p,
+                      std::size_t n) noexcept -> std::uint32_t {
+  for (; n >= 8; n -= 8, p += 8) {  // NOLINT
+    std::uint64_t word{};
+    std::memcpy(&word, p, sizeof(word));
+    crc = __crc32cd(crc, word);
+  }
+  for (; n > 0; --n, ++p) {  // NOLINT
+    crc = __crc32cb(crc, static_cast<std::uint8_t>(*p));
+  }
+  return crc;
+}
+
+constexpr auto crc32c_hw_available() noexcept -> bool {
+  return true;
+}
+#else
+inline auto crc32c_hw(std::uint32_t crc,
+                      const std::byte* p,
+                      std::size_t n) noexcept -> std::uint32_t {
+  return crc32c_sw(crc, p, n);
+}
+
+constexpr auto crc32c_hw_available() noexcept -> bool {
+  return false;
+}
+#endif
+
+}  // namespace detail
+
+// Extends crc, the CRC-32C of preceding data, with data:
+//   crc32c(ab) == crc32c(b, crc32c(a))
+[[nodiscard]]
+inline auto crc32c(cbyte_view data, std::uint32_t crc = 0) noexcept
+    -> std::uint32_t {
+  auto const reg = ~crc;
+  return ~(detail::crc32c_hw_available()
+               ? detail::crc32c_hw(reg, data.data(), data.size())
+               : detail::crc32c_sw(reg, data.data(), data.size()));
+}
+
+}  // namespace mfile
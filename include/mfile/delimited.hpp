@@ -0,0 +1,328 @@
+// mfile - A modern C++20 file handling library
+// (https://github.com/range3/mfile)
+// Licensed under MIT License
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <optional>
+#include <vector>
+
+#include <sys/mman.h>
+
+#include "mfile/mapped_file.hpp"
+#include "mfile/mfile.hpp"
+
+#if defined(__x86_64__)
+#  include <immintrin.h>
+#endif
+
+// Splitting data into newline- or NUL-delimited records. Delimiters are
+// found with AVX2 when the CPU has it (checked once at run time), SSE2
+// otherwise on x86-64, and eight bytes at a time elsewhere. Records are
+// views without the delimiter; a last record without one is still yielded.
+//
+//   auto lines = mfile::delimited_records{f};  // maps f
+//   for (auto line : lines) consume(line);
+//
+//   auto reader = mfile::buffered_reader{f};
+//   auto records = mfile::delimited_reader{reader, std::byte{0}};
+//   while (auto record = records.next()) consume(*record);
+
+namespace mfile {
+
+namespace detail {
+
+inline auto find_byte_sw(const std::byte* p,
+                         std::size_t n,
+                         std::byte c) noexcept -> std::size_t {
+  constexpr auto lows = std::uint64_t{0x7f7f7f7f7f7f7f7f};
+  auto const pattern = std::uint64_t{0x0101010101010101}
+                       * static_cast<std::uint64_t>(c);
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    std::uint64_t word{};
+    std::memcpy(&word, p + i, sizeof(word));  // NOLINT
+    word ^= pattern;
+    // High bit set in exactly the bytes of word that are zero
+    auto const zeros = ~(((word & lows) + lows) | word | lows);
+    if (zeros != 0) {
+      if constexpr (std::endian::native == std::endian::little) {
+        return i + (static_cast<std::size_t>(std::countr_zero(zeros)) / 8);
+      } else {
+        return i + (static_cast<std::size_t>(std::countl_zero(zeros)) / 8);
+      }
+    }
+  }
+  for (; i < n; ++i) {
+    if (p[i] == c) {  // NOLINT
+      return i;
+    }
+  }
+  return n;
+}
+
+#if defined(__x86_64__)
+inline auto find_byte_sse2(const std::byte* p,
+                           std::size_t n,
+                           std::byte c) noexcept -> std::size_t {
+  auto const needle = _mm_set1_epi8(static_cast<char>(c));
+  std::size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    auto const v = _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(p + i));  // NOLINT
+    auto const mask = static_cast<unsigned>(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(v, needle)));
+    if (mask != 0) {
+      return i + static_cast<std::size_t>(std::countr_zero(mask));
+    }
+  }
+  return i + find_byte_sw(p + i, n - i, c);  // NOLINT
+}
+
+__attribute__((target("avx2"))) inline auto find_byte_avx2(
+    const std::byte* p,
+    std::size_t n,
+    std::byte c) noexcept -> std::size_t {
+  auto const needle = _mm256_set1_epi8(static_cast<char>(c));
+  std::size_t i = 0;
+  // Two vectors per round with a single test in the common no-match case
+  for (; i + 64 <= n; i += 64) {
+    auto const a = _mm256_cmpeq_epi8(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i)),  // NOLINT
+        needle);
+    auto const b = _mm256_cmpeq_epi8(
+        _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(p + i + 32)),  // NOLINT
+        needle);
+    if (_mm256_movemask_epi8(_mm256_or_si256(a, b)) != 0) {
+      auto const mask =
+          static_cast<std::uint32_t>(_mm256_movemask_epi8(a))
+          | (static_cast<std::uint64_t>(
+                 static_cast<std::uint32_t>(_mm256_movemask_epi8(b)))
+             << 32U);
+      return i + static_cast<std::size_t>(std::countr_zero(mask));
+    }
+  }
+  for (; i + 32 <= n; i += 32) {
+    auto const mask = static_cast<std::uint32_t>(
+        _mm256_movemask_epi8(_mm256_cmpeq_epi8(
+            _mm256_loadu_si256(
+                reinterpret_cast<const __m256i*>(p + i)),  // NOLINT
+            needle)));
+    if (mask != 0) {
+      return i + static_cast<std::size_t>(std::countr_zero(mask));
+    }
+  }
+  return i + find_byte_sse2(p + i, n - i, c);  // NOLINT
+}
+
+inline auto find_byte_avx2_available() noexcept -> bool {
+  static bool const available = __builtin_cpu_supports("avx2");
+  return available;
+}
+#endif
+
+}  // namespace detail
+
+// Index of the first c in data, or data.size() if there is none.
+[[nodiscard]]
+inline auto find_delimiter(cbyte_view data, std::byte c) noexcept
+    -> std::size_t {
+#if defined(__x86_64__)
+  return detail::find_byte_avx2_available()
+             ? detail::find_byte_avx2(data.data(), data.size(), c)
+             : detail::find_byte_sse2(data.data(), data.size(), c);
+#else
+  return detail::find_byte_sw(data.data(), data.size(), c);
+#endif
+}
+
+// The records of a block of memory, e.g. a mapped file, without copying.
+class delimited_records {
+ public:
+  class iterator {
+   public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = cbyte_view;
+    using difference_type = std::ptrdiff_t;
+
+    iterator() noexcept = default;
+    iterator(cbyte_view data, std::byte delimiter) noexcept
+        : rest_{data}, delimiter_{delimiter} {
+      advance();
+    }
+
+    [[nodiscard]]
+    auto operator*() const noexcept -> const cbyte_view& {
+      return current_;
+    }
+    [[nodiscard]]
+    auto operator->() const noexcept -> const cbyte_view* {
+      return &current_;
+    }
+
+    auto operator++() noexcept -> iterator& {
+      advance();
+      return *this;
+    }
+    void operator++(int) noexcept { ++*this; }
+
+    [[nodiscard]]
+    friend auto operator==(const iterator& it,
+                           std::default_sentinel_t /*end*/) noexcept -> bool {
+      return it.done_;
+    }
+
+   private:
+    cbyte_view rest_;
+    cbyte_view current_;
+    std::byte delimiter_{};
+    bool done_{true};
+
+    void advance() noexcept {
+      done_ = rest_.empty();
+      if (done_) {
+        return;
+      }
+      auto const pos = find_delimiter(rest_, delimiter_);
+      current_ = rest_.first(pos);
+      rest_ = pos == rest_.size() ? cbyte_view{} : rest_.subspan(pos + 1);
+    }
+  };
+
+  // Splits memory the caller keeps alive.
+  explicit delimited_records(cbyte_view data,
+                             std::byte delimiter = std::byte{'\n'}) noexcept
+      : data_{data}, delimiter_{delimiter} {}
+
+  // Maps the whole file.
+  template <file_handle_like Handle, file_hooks Hooks, metadata_policy Metadata>
+  explicit delimited_records(const file<Handle, Hooks, Metadata>& f,
+                             std::byte delimiter = std::byte{'\n'})
+      : mapping_{f}, data_{mapping_}, delimiter_{delimiter} {
+    mapping_.advise(MADV_SEQUENTIAL);
+  }
+
+  [[nodiscard]]
+  auto begin() const noexcept -> iterator {
+    return {data_, delimiter_};
+  }
+
+  [[nodiscard]]
+  static auto end() noexcept -> std::default_sentinel_t {
+    return {};
+  }
+
+ private:
+  mapped_file mapping_;
+  cbyte_view data_;
+  std::byte delimiter_;
+};
+
+// The records read through a buffered_reader (mfile/buffered.hpp), which
+// must outlive this. Records inside the reader's buffer are returned as
+// views into it; a record that straddles the end of the buffer is gathered
+// into an internal buffer, copying each of its bytes once. A returned view
+// is valid until the next call.
+template <typename Reader>
+class delimited_reader {
+ public:
+  class iterator {
+   public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = cbyte_view;
+    using difference_type = std::ptrdiff_t;
+
+    iterator() noexcept = default;
+    explicit iterator(delimited_reader* reader) : reader_{reader} {
+      ++*this;
+    }
+
+    [[nodiscard]]
+    auto operator*() const noexcept -> const cbyte_view& {
+      return current_;
+    }
+    [[nodiscard]]
+    auto operator->() const noexcept -> const cbyte_view* {
+      return &current_;
+    }
+
+    auto operator++() -> iterator& {
+      if (auto const record = reader_->next()) {
+        current_ = *record;
+      } else {
+        reader_ = nullptr;
+      }
+      return *this;
+    }
+    void operator++(int) { ++*this; }
+
+    [[nodiscard]]
+    friend auto operator==(const iterator& it,
+                           std::default_sentinel_t /*end*/) noexcept -> bool {
+      return it.reader_ == nullptr;
+    }
+
+   private:
+    delimited_reader* reader_{};
+    cbyte_view current_;
+  };
+
+  explicit delimited_reader(Reader& reader,
+                            std::byte delimiter = std::byte{'\n'}) noexcept
+      : reader_{&reader}, delimiter_{delimiter} {}
+
+  // The next record, or std::nullopt at EOF.
+  auto next() -> std::optional<cbyte_view> {
+    auto chunk = reader_->fill();
+    if (chunk.empty()) {
+      return std::nullopt;
+    }
+    auto pos = find_delimiter(chunk, delimiter_);
+    if (pos != chunk.size()) {
+      reader_->consume(pos + 1);
+      return chunk.first(pos);
+    }
+
+    spill_.assign(chunk.begin(), chunk.end());
+    reader_->consume(chunk.size());
+    while (!(chunk = reader_->fill()).empty()) {
+      pos = find_delimiter(chunk, delimiter_);
+      spill_.insert(spill_.end(), chunk.begin(),
+                    chunk.begin() + static_cast<std::ptrdiff_t>(pos));
+      if (pos != chunk.size()) {
+        reader_->consume(pos + 1);
+        break;
+      }
+      reader_->consume(pos);
+    }
+    return cbyte_view{spill_};
+  }
+
+  [[nodiscard]]
+  auto begin() -> iterator {
+    return iterator{this};
+  }
+
+  [[nodiscard]]
+  static auto end() noexcept -> std::default_sentinel_t {
+    return {};
+  }
+
+  // File offset of the next record.
+  [[nodiscard]]
+  auto offset() const noexcept -> std::uint64_t {
+    return reader_->offset();
+  }
+
+ private:
+  Reader* reader_;
+  std::byte delimiter_;
+  std::vector<std::byte> spill_;
+};
+
+}  // namespace mfile
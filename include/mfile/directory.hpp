@@ -0,0 +1,303 @@
+// mfile - A modern C++20 file handling library
+// (https://github.com/range3/mfile)
+// Licensed under MIT License
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <iterator>
+#include <memory>
+#include <string_view>
+#include <utility>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "mfile/mfile.hpp"
+
+// Directory handles. Paths are resolved relative to an open directory, so
+// the kernel walks only the components below it:
+//
+//   auto dir = mfile::open_directory("/data/shard/17/objects");
+//   auto f = dir.open_at("a1/b2", mfile::open_flags::r());
+//   for (auto const& entry : dir.entries()) { ... }
+
+namespace mfile {
+
+// d_type of a directory entry.
+enum class entry_type : std::uint8_t {
+  unknown = DT_UNKNOWN,  // the file system does not report it; use stat_at()
+  fifo = DT_FIFO,
+  character_device = DT_CHR,
+  directory = DT_DIR,
+  block_device = DT_BLK,
+  regular = DT_REG,
+  symlink = DT_LNK,
+  socket = DT_SOCK,
+};
+
+struct dir_entry {
+  std::uint64_t ino;
+  entry_type type;
+  // Points into the reader's buffer; valid until the iterator is advanced.
+  std::string_view name;
+};
+
+// Reads the entries of a directory with getdents64(2) into one large
+// buffer, so that a directory of thousands of entries costs a handful of
+// system calls. "." and ".." are skipped. Iteration starts from the
+// beginning of the directory and shares the position of its descriptor.
+class dir_entries {
+ public:
+  static constexpr std::size_t default_buffer_size = 64 * 1024;
+
+  class iterator {
+   public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = dir_entry;
+    using difference_type = std::ptrdiff_t;
+
+    iterator() noexcept = default;
+    explicit iterator(dir_entries* reader) noexcept : reader_{reader} {}
+
+    [[nodiscard]]
+    auto operator*() const noexcept -> const dir_entry& {
+      return reader_->current_;
+    }
+    [[nodiscard]]
+    auto operator->() const noexcept -> const dir_entry* {
+      return &reader_->current_;
+    }
+
+    auto operator++() -> iterator& {
+      if (!reader_->advance()) {
+        reader_ = nullptr;
+      }
+      return *this;
+    }
+    void operator++(int) { ++*this; }
+
+    [[nodiscard]]
+    friend auto operator==(const iterator& it,
+                           std::default_sentinel_t /*end*/) noexcept -> bool {
+      return it.reader_ == nullptr;
+    }
+
+   private:
+    dir_entries* reader_{};
+  };
+
+  explicit dir_entries(int fd, std::size_t buffer_size = default_buffer_size)
+      : fd_{fd},
+        owned_{std::make_unique_for_overwrite<std::byte[]>(  // NOLINT
+            buffer_size)},
+        buffer_{owned_.get(), buffer_size} {}
+
+  // Reads into a caller-owned buffer, e.g. one reused across directories.
+  dir_entries(int fd, byte_view buffer) noexcept : fd_{fd}, buffer_{buffer} {}
+
+  [[nodiscard]]
+  auto begin() -> iterator {
+    if (::lseek(fd_, 0, SEEK_SET) == -1) {
+      throw mfile_system_error{errno, "Failed to rewind directory"};
+    }
+    used_ = pos_ = 0;
+    return advance() ? iterator{this} : iterator{};
+  }
+
+  [[nodiscard]]
+  static auto end() noexcept -> std::default_sentinel_t {
+    return {};
+  }
+
+  // Number of getdents64 calls made so far.
+  [[nodiscard]]
+  auto reads() const noexcept -> std::size_t {
+    return reads_;
+  }
+
+ private:
+  // Layout of struct linux_dirent64 up to the name
+  static constexpr std::size_t ino_offset = 0;
+  static constexpr std::size_t reclen_offset = 16;
+  static constexpr std::size_t type_offset = 18;
+  static constexpr std::size_t name_offset = 19;
+
+  int fd_;
+  std::unique_ptr<std::byte[]> owned_;  // NOLINT(*-avoid-c-arrays)
+  byte_view buffer_;
+  std::size_t used_{};
+  std::size_t pos_{};
+  std::size_t reads_{};
+  dir_entry current_{};
+
+  // Moves to the next entry other than "." and "..". Returns false at the
+  // end of the directory.
+  auto advance() -> bool {
+    while (true) {
+      if (pos_ == used_ && !fill()) {
+        return false;
+      }
+      auto const* record = buffer_.data() + pos_;
+      std::uint16_t reclen{};
+      std::memcpy(&reclen, record + reclen_offset, sizeof(reclen));
+      pos_ += reclen;
+
+      auto const* name = reinterpret_cast<const char*>(  // NOLINT
+          record + name_offset);
+      auto const entry_name = std::string_view{name};
+      if (entry_name == "." || entry_name == "..") {
+        continue;
+      }
+      std::memcpy(&current_.ino, record + ino_offset, sizeof(current_.ino));
+      current_.type = static_cast<entry_type>(record[type_offset]);
+      current_.name = entry_name;
+      return true;
+    }
+  }
+
+  auto fill() -> bool {
+    long result = -1;
+    do {  // NOLINT
+      result = ::syscall(SYS_getdents64, fd_, buffer_.data(), buffer_.size());
+    } while (result == -1 && errno == EINTR);
+    ++reads_;
+    if (result == -1) {
+      throw mfile_system_error{errno, "getdents64 failed"};
+    }
+    used_ = static_cast<std::size_t>(result);
+    pos_ = 0;
+    return used_ != 0;
+  }
+};
+
+// An open directory (O_DIRECTORY), owned through the same file_handle as
+// file<file_handle>. Every *_at() call resolves path relative to it; an
+// absolute path ignores the directory, as with the *at(2) calls.
+class directory {
+ public:
+  static constexpr int default_flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+
+  directory() noexcept = default;
+
+  explicit directory(file_handle handle) noexcept
+      : handle_{std::move(handle)} {}
+
+  [[nodiscard]]
+  auto handle() const noexcept -> const file_handle& {
+    return handle_;
+  }
+
+  [[nodiscard]]
+  auto native() const noexcept -> int {
+    return handle_->native();
+  }
+
+  [[nodiscard]]
+  explicit operator bool() const noexcept {
+    return static_cast<bool>(handle_);
+  }
+
+  [[nodiscard]]
+  auto release() noexcept -> file_handle {
+    return std::move(handle_);
+  }
+
+  [[nodiscard]]
+  auto open_at(const char* path, open_flags flags, mode_t mode = 0666) const
+      -> file<file_handle> {
+    auto fd = ::openat(native(), path, flags.flags(), mode);  // NOLINT
+    if (fd == -1) {
+      throw mfile_system_error{errno,
+                               std::format("Failed to open file: {}", path)};
+    }
+    return file{file_handle{weak_file_handle{fd}}};
+  }
+
+  // Opens a subdirectory.
+  [[nodiscard]]
+  auto open_directory_at(const char* path) const -> directory {
+    auto fd = ::openat(native(), path, default_flags);  // NOLINT
+    if (fd == -1) {
+      throw mfile_system_error{
+          errno, std::format("Failed to open directory: {}", path)};
+    }
+    return directory{file_handle{weak_file_handle{fd}}};
+  }
+
+  // statx(2) of path. at_flags takes AT_SYMLINK_NOFOLLOW and friends.
+  [[nodiscard]]
+  auto stat_at(const char* path,
+               std::uint32_t mask = statx_mask::basic_stats,
+               int at_flags = 0) const -> statx_result {
+    auto stx = statx_result{};
+    if (::statx(native(), path, at_flags | AT_STATX_SYNC_AS_STAT, mask,
+                reinterpret_cast<struct statx*>(&stx))  // NOLINT
+        == -1) {
+      throw mfile_system_error{errno,
+                               std::format("statx failed: {}", path)};
+    }
+    return stx;
+  }
+
+  void make_directory_at(const char* path, mode_t mode = 0777) const {
+    if (::mkdirat(native(), path, mode) == -1) {
+      throw mfile_system_error{
+          errno, std::format("Failed to create directory: {}", path)};
+    }
+  }
+
+  // Removes a file; with AT_REMOVEDIR, an empty directory.
+  void unlink_at(const char* path, int at_flags = 0) const {
+    if (::unlinkat(native(), path, at_flags) == -1) {
+      throw mfile_system_error{errno,
+                               std::format("Failed to unlink: {}", path)};
+    }
+  }
+
+  // Renames from, relative to this directory, to to, relative to to_dir.
+  void rename_at(const char* from,
+                 const directory& to_dir,
+                 const char* to) const {
+    if (::renameat(native(), from, to_dir.native(), to) == -1) {
+      throw mfile_system_error{
+          errno, std::format("Failed to rename {} to {}", from, to)};
+    }
+  }
+
+  void rename_at(const char* from, const char* to) const {
+    rename_at(from, *this, to);
+  }
+
+  [[nodiscard]]
+  auto entries(std::size_t buffer_size = dir_entries::default_buffer_size) const
+      -> dir_entries {
+    return dir_entries{native(), buffer_size};
+  }
+
+  [[nodiscard]]
+  auto entries(byte_view buffer) const noexcept -> dir_entries {
+    return dir_entries{native(), buffer};
+  }
+
+ private:
+  file_handle handle_;
+};
+
+[[nodiscard]]
+inline auto open_directory(const char* path) -> directory {
+  auto fd = ::open(path, directory::default_flags);  // NOLINT
+  if (fd == -1) {
+    throw mfile_system_error{
+        errno, std::format("Failed to open directory: {}", path)};
+  }
+  return directory{file_handle{weak_file_handle{fd}}};
+}
+
+}  // namespace mfile
@@ -0,0 +1,37 @@
+// mfile - A modern C++20 file handling library
+// (https://github.com/range3/mfile)
+// Licensed under MIT License
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Little-endian integer encoding shared by the on-disk formats.
+
+namespace mfile::detail {
+
+inline void store_le32(std::byte* p, std::uint32_t v) noexcept {
+  for (int i = 0; i < 4; ++i) {
+    p[i] = static_cast<std::byte>(v >> (8 * i));  // NOLINT
+  }
+}
+
+inline auto load_le32(const std::byte* p) noexcept -> std::uint32_t {
+  std::uint32_t v = 0;
+  for (int i = 0; i < 4; ++i) {
+    v |= static_cast<std::uint32_t>(p[i]) << (8 * i);  // NOLINT
+  }
+  return v;
+}
+
+inline void store_le64(std::byte* p, std::uint64_t v) noexcept {
+  store_le32(p, static_cast<std::uint32_t>(v));
+  store_le32(p + 4, static_cast<std::uint32_t>(v >> 32U));  // NOLINT
+}
+
+inline auto load_le64(const std::byte* p) noexcept -> std::uint64_t {
+  return load_le32(p)
+         | (static_cast<std::uint64_t>(load_le32(p + 4)) << 32U);  // NOLINT
+}
+
+}  // namespace mfile::detail
@@ -0,0 +1,169 @@
+// mfile - A modern C++20 file handling library
+// (https://github.com/range3/mfile)
+// Licensed under MIT License
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cerrno>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "mfile/mfile.hpp"
+
+// Huge-page backing for aligned_buffer and mapped_file. Memory is set up
+// with the requested mode or the next one down when it is not available:
+//
+//   hugetlb      MAP_HUGETLB pages from the reserved pool (hugetlbfs files
+//                for mappings)
+//   transparent  a huge-page-aligned range marked MADV_HUGEPAGE, which the
+//                kernel backs with huge pages as it can
+//   off          regular pages
+//
+// Whether the kernel actually used huge pages shows in huge_pages().
+
+namespace mfile {
+
+enum class huge_page_mode : std::uint8_t {
+  off,
+  transparent,
+  hugetlb,
+};
+
+struct huge_page_stats {
+  // The mode the memory was set up with, after any fallback.
+  huge_page_mode mode = huge_page_mode::off;
+  // Bytes of it currently mapped with huge pages.
+  std::size_t huge_bytes = 0;
+};
+
+namespace detail {
+
+// Fallback when sysfs does not report the PMD size.
+inline constexpr std::size_t default_huge_page_size = std::size_t{2} << 20U;
+
+inline auto parse_size(std::string_view s, int base = 10) noexcept
+    -> std::size_t {
+  std::size_t v = 0;
+  std::from_chars(s.data(), s.data() + s.size(), v, base);  // NOLINT
+  return v;
+}
+
+// The size of a transparent huge page, which is also the size requested
+// for MAP_HUGETLB.
+inline auto huge_page_size() -> std::size_t {
+  static std::size_t const size = [] {
+    try {
+      auto const text =
+          open("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size",
+               open_flags::r())
+              .read();
+      auto const v = parse_size(
+          {reinterpret_cast<const char*>(text.data()),  // NOLINT
+           text.size()});
+      return std::has_single_bit(v) ? v : default_huge_page_size;
+    } catch (const mfile_system_error&) {
+      return default_huge_page_size;
+    }
+  }();
+  return size;
+}
+
+inline auto round_up(std::size_t n, std::size_t granule) noexcept
+    -> std::size_t {
+  return (n + granule - 1) / granule * granule;
+}
+
+// mmap(2) at an address congruent to offset modulo align, so that aligned
+// file ranges line up with huge pages. length is a multiple of the page
+// size. Returns MAP_FAILED with errno set on failure.
+inline auto mmap_aligned(std::size_t length,
+                         std::size_t align,
+                         int prot,
+                         int flags,
+                         int fd,
+                         off_t offset) noexcept -> void* {
+  auto const reserved = length + align;
+  auto* reservation =
+      ::mmap(nullptr, reserved, PROT_NONE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (reservation == MAP_FAILED) {
+    return MAP_FAILED;
+  }
+  auto const base = reinterpret_cast<std::uintptr_t>(reservation);  // NOLINT
+  auto const skew = (static_cast<std::uintptr_t>(offset) - base) % align;
+  auto* const want = static_cast<std::byte*>(reservation) + skew;
+  auto* p = ::mmap(want, length, prot, flags | MAP_FIXED, fd, offset);
+  if (p == MAP_FAILED) {
+    auto const saved = errno;
+    ::munmap(reservation, reserved);
+    errno = saved;
+    return MAP_FAILED;
+  }
+  if (skew != 0) {
+    ::munmap(reservation, skew);
+  }
+  ::munmap(want + length, align - skew);  // NOLINT
+  return p;
+}
+
+}  // namespace detail
+
+// Bytes of range that are mapped with huge pages, transparent or hugetlb,
+// as reported by /proc/self/smaps for the mappings covering it.
+// Counts are per mapping, so a range sharing a mapping with other memory
+// may be overestimated, up to its size.
+[[nodiscard]]
+inline auto huge_page_bytes(cbyte_view range) -> std::size_t {
+  if (range.empty()) {
+    return 0;
+  }
+  static constexpr auto fields = std::array<std::string_view, 5>{
+      "AnonHugePages:", "ShmemPmdMapped:", "FilePmdMapped:",
+      "Shared_Hugetlb:", "Private_Hugetlb:"};
+  auto const lo = reinterpret_cast<std::uintptr_t>(range.data());  // NOLINT
+  auto const hi = lo + range.size();
+
+  auto const text = open("/proc/self/smaps", open_flags::r()).read();
+  auto rest = std::string_view{
+      reinterpret_cast<const char*>(text.data()), text.size()};  // NOLINT
+  std::size_t total = 0;
+  std::size_t overlap = 0;
+  std::size_t in_mapping = 0;
+  while (!rest.empty()) {
+    auto const eol = std::min(rest.find('\n'), rest.size());
+    auto const line = rest.substr(0, eol);
+    rest.remove_prefix(std::min(eol + 1, rest.size()));
+
+    auto const name = line.substr(0, line.find(' '));
+    auto const dash = name.find('-');
+    if (dash != std::string_view::npos && !name.ends_with(':')) {
+      // "start-end perms offset dev inode path" begins the next mapping
+      total += std::min(in_mapping, overlap);
+      in_mapping = 0;
+      auto const start = detail::parse_size(name.substr(0, dash), 16);
+      auto const end = detail::parse_size(name.substr(dash + 1), 16);
+      auto const from = std::max<std::uintptr_t>(start, lo);
+      auto const to = std::min<std::uintptr_t>(end, hi);
+      overlap = to > from ? to - from : 0;
+      continue;
+    }
+    if (overlap == 0
+        || std::find(fields.begin(), fields.end(), name) == fields.end()) {
+      continue;
+    }
+    // "Name:   <n> kB"
+    auto value = line.substr(name.size());
+    value.remove_prefix(std::min(value.find_first_not_of(' '), value.size()));
+    in_mapping += detail::parse_size(value) * 1024;
+  }
+  return total + std::min(in_mapping, overlap);
+}
+
+}  // namespace mfile
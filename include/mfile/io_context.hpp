@@ -0,0 +1,1009 @@
+// mfile - A modern C++20 file handling library
+// (https://github.com/range3/mfile)
+// Licensed under MIT License
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "mfile/io_uring.hpp"
+#include "mfile/mfile.hpp"
+
+namespace mfile {
+
+enum class io_opcode : std::uint8_t {
+  nop,
+  read,
+  write,
+  fsync,
+  fdatasync,
+  openat,  // result is the new descriptor
+  statx,
+  close,
+};
+
+// One kernel operation, described independently of the engine executing it.
+struct io_request {
+  // Largest transfer the kernel performs in one read/write (MAX_RW_COUNT).
+  static constexpr std::size_t max_transfer = 0x7ffff000;
+
+  // fd is an index into the io_context's fixed file table.
+  static constexpr std::uint8_t fixed_file = 1U << 0U;
+  // data lies inside registered buffer buf_index (READ_FIXED/WRITE_FIXED).
+  static constexpr std::uint8_t fixed_buffer = 1U << 1U;
+  // Start only after every previously submitted request completed.
+  static constexpr std::uint8_t drain = 1U << 2U;
+
+  io_opcode opcode{io_opcode::nop};
+  std::uint8_t flags{};
+  std::uint16_t buf_index{};
+  // openat/statx: the directory path is relative to, or AT_FDCWD
+  int fd{invalid_file_handle::value};
+  // statx: the statx_result to fill
+  std::byte* data{};
+  // openat: creation mode; statx: statx_mask bits
+  std::uint32_t size{};
+  std::uint64_t offset{};
+  // openat/statx: the path and its open(2) or AT_* flags
+  const char* path{};
+  int path_flags{};
+  // Completes the request with -ECANCELED unless it finished in time
+  // (IORING_OP_LINK_TIMEOUT). Zero means no timeout.
+  std::chrono::nanoseconds timeout{};
+};
+
+// Slot of a file registered with io_context::register_file().
+class registered_file {
+ public:
+  registered_file() noexcept = default;
+
+  [[nodiscard]]
+  auto index() const noexcept -> unsigned {
+    return index_;
+  }
+
+ private:
+  friend class io_context;
+  explicit registered_file(unsigned index) noexcept : index_{index} {}
+
+  unsigned index_{~0U};
+};
+
+// A range inside a buffer registered with io_context::register_buffers().
+// Transfers into or out of it skip the per-operation page pinning.
+class registered_buffer {
+ public:
+  registered_buffer() noexcept = default;
+  registered_buffer(std::uint16_t index, byte_view data) noexcept
+      : index_{index}, data_{data} {}
+
+  [[nodiscard]]
+  auto index() const noexcept -> std::uint16_t {
+    return index_;
+  }
+  [[nodiscard]]
+  auto data() const noexcept -> byte_view {
+    return data_;
+  }
+  [[nodiscard]]
+  auto size() const noexcept -> std::size_t {
+    return data_.size();
+  }
+
+  [[nodiscard]]
+  auto subspan(std::size_t offset,
+               std::size_t count = std::dynamic_extent) const noexcept
+      -> registered_buffer {
+    if (count == std::dynamic_extent) {
+      count = data_.size() - offset;
+    }
+    return {index_, data_.subspan(offset, count)};
+  }
+
+ private:
+  std::uint16_t index_{};
+  byte_view data_;
+};
+
+// Base of every in-flight operation. The operation object must stay alive
+// and in place until on_complete() has been called.
+class io_operation {
+ public:
+  io_request request{};
+  // Following operation of a chain; maintained by io_context::submit_linked().
+  io_operation* next_link{};
+
+  // result is the kernel's return value: >= 0 on success, -errno on failure.
+  // Called on the thread running the io_context.
+  virtual void on_complete(std::int32_t result) = 0;
+
+ private:
+  friend class io_context;
+  // Read by the kernel when the linked timeout is submitted
+  __kernel_timespec timeout_spec_{};
+
+ protected:
+  io_operation() = default;
+  io_operation(const io_operation&) = default;
+  io_operation(io_operation&&) = default;
+  auto operator=(const io_operation&) -> io_operation& = default;
+  auto operator=(io_operation&&) -> io_operation& = default;
+  virtual ~io_operation() = default;
+};
+
+enum class io_backend : std::uint8_t {
+  automatic,    // io_uring if the kernel allows it, else thread_pool
+  io_uring,
+  thread_pool,  // synchronous pread/pwrite calls on a bounded worker pool
+};
+
+// Kernel-side submission polling (IORING_SETUP_SQPOLL): a kernel thread
+// picks up submissions, trading a busy core for syscall-free submission.
+// The thread sleeps after idle without work; the next submission then
+// needs one io_uring_enter to wake it (see uring::counters).
+struct sqpoll_options {
+  bool enabled = false;
+  std::chrono::milliseconds idle{1000};
+  int cpu = -1;  // CPU to pin the poller to; -1 leaves it unpinned
+};
+
+struct io_context_options {
+  unsigned entries = 256;  // submission queue depth
+  io_backend backend = io_backend::automatic;
+  unsigned threads = 4;  // worker count of the thread_pool backend
+  unsigned fixed_files = 0;  // capacity of the fixed file table
+  sqpoll_options sqpoll{};   // io_uring backend only
+};
+
+namespace detail {
+
+// Executes io_requests with the synchronous file API on a fixed set of
+// worker threads. Completions are queued back and dispatched by the thread
+// running the io_context, exactly as with io_uring.
+class thread_pool_backend {
+ public:
+  using clock = std::chrono::steady_clock;
+
+  // The request is copied with fixed files already resolved to descriptors.
+  struct job {
+    io_operation* op;
+    io_request request;
+    clock::time_point deadline{clock::time_point::max()};
+  };
+
+  struct completion {
+    io_operation* op;
+    std::int32_t result;
+  };
+
+  explicit thread_pool_backend(unsigned threads) {
+    workers_.reserve(std::max(threads, 1U));
+    for (unsigned i = 0; i < std::max(threads, 1U); ++i) {
+      workers_.emplace_back([this] { work(); });
+    }
+  }
+
+  thread_pool_backend(const thread_pool_backend&) = delete;
+  auto operator=(const thread_pool_backend&) -> thread_pool_backend& = delete;
+  thread_pool_backend(thread_pool_backend&&) = delete;
+  auto operator=(thread_pool_backend&&) -> thread_pool_backend& = delete;
+
+  ~thread_pool_backend() {
+    {
+      auto lock = std::scoped_lock{mutex_};
+      stopping_ = true;
+    }
+    work_cv_.notify_all();
+    for (auto& worker : workers_) {
+      worker.join();
+    }
+  }
+
+  void submit(std::vector<job>& jobs) {
+    if (jobs.empty()) {
+      return;
+    }
+    {
+      auto lock = std::scoped_lock{mutex_};
+      queue_.insert(queue_.end(), jobs.begin(), jobs.end());
+    }
+    jobs.clear();
+    work_cv_.notify_all();
+  }
+
+  // Moves finished operations into out, waiting for at least one (or a
+  // wake()) if wait.
+  void reap(std::vector<completion>& out, bool wait) {
+    auto lock = std::unique_lock{mutex_};
+    if (wait) {
+      done_cv_.wait(lock, [this] { return !done_.empty() || woken_; });
+    }
+    woken_ = false;
+    out.swap(done_);
+  }
+
+  // Signals the eventfd whenever an operation finishes; -1 disables it.
+  void notify_through(int eventfd) {
+    auto lock = std::scoped_lock{mutex_};
+    notify_fd_ = eventfd;
+  }
+
+  // Interrupts a waiting reap(). Callable from any thread.
+  void wake() {
+    {
+      auto lock = std::scoped_lock{mutex_};
+      woken_ = true;
+    }
+    done_cv_.notify_one();
+  }
+
+  // Completes op with -ECANCELED if it has not started yet. A request that
+  // is already executing cannot be interrupted.
+  auto cancel(const io_operation* op) -> bool {
+    auto lock = std::scoped_lock{mutex_};
+    auto const it = std::find_if(queue_.begin(), queue_.end(),
+                                 [op](const job& j) { return j.op == op; });
+    if (it == queue_.end()) {
+      return false;
+    }
+    done_.push_back({it->op, -ECANCELED});
+    queue_.erase(it);
+    notify();
+    return true;
+  }
+
+  static auto execute(const io_request& req) noexcept -> std::int32_t {
+    auto const f = file{weak_file_handle{req.fd}};
+    try {
+      switch (req.opcode) {
+        case io_opcode::nop:
+          return 0;
+        case io_opcode::read:
+          return static_cast<std::int32_t>(
+              f.pread_once(byte_view{req.data, req.size}, req.offset));
+        case io_opcode::write:
+          return static_cast<std::int32_t>(
+              f.pwrite_once(cbyte_view{req.data, req.size}, req.offset));
+        case io_opcode::fsync:
+          f.sync();
+          return 0;
+        case io_opcode::fdatasync:
+          return ::fdatasync(req.fd) == -1 ? -errno : 0;
+        case io_opcode::openat: {
+          auto const fd = ::openat(req.fd, req.path, req.path_flags,  // NOLINT
+                                   static_cast<mode_t>(req.size));
+          return fd == -1 ? -errno : fd;
+        }
+        case io_opcode::statx:
+          return ::statx(req.fd, req.path, req.path_flags, req.size,
+                         reinterpret_cast<struct statx*>(req.data))  // NOLINT
+                         == -1
+                     ? -errno
+                     : 0;
+        case io_opcode::close:
+          return ::close(req.fd) == -1 ? -errno : 0;
+      }
+    } catch (const mfile_error& e) {
+      return -e.code().value();
+    }
+    return -EINVAL;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable work_cv_;
+  std::condition_variable done_cv_;
+  std::deque<job> queue_;
+  std::vector<completion> done_;
+  bool stopping_{};
+  bool woken_{};
+  int notify_fd_{-1};
+  std::vector<std::thread> workers_;
+
+  // Requires mutex_
+  void notify() {
+    done_cv_.notify_one();
+    if (notify_fd_ != -1) {
+      ::eventfd_write(notify_fd_, 1);
+    }
+  }
+
+  void work() {
+    auto lock = std::unique_lock{mutex_};
+    while (true) {
+      work_cv_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+      if (stopping_) {
+        return;
+      }
+      auto const next = queue_.front();
+      queue_.pop_front();
+      lock.unlock();
+      // Requests that waited past their deadline are not started
+      auto const result = clock::now() >= next.deadline
+                              ? -ECANCELED
+                              : execute(next.request);
+      lock.lock();
+      done_.push_back({next.op, result});
+      notify();
+    }
+  }
+};
+
+}  // namespace detail
+
+// Single-threaded completion engine. Submissions are batched until the next
+// run_one()/poll(), which hands them to the backend at once (one
+// io_uring_enter) and dispatches completions on the calling thread. Use one
+// io_context per thread.
+//
+// With io_backend::automatic, hosts where io_uring is unavailable
+// (kernel.io_uring_disabled, seccomp sandboxes, old kernels) transparently
+// get the thread_pool backend.
+//
+// Files and buffers used by every request can be registered once, so the
+// kernel skips the per-operation fd lookup and page pinning. The context
+// owns registered files; they are closed only after unregister_file() hands
+// them back, which is refused while operations on them are in flight.
+class io_context {
+ public:
+  explicit io_context(io_context_options options = {})
+      : backend_{options.backend}, files_(options.fixed_files) {
+    if (backend_ != io_backend::thread_pool) {
+      try {
+        ring_ = uring{options.entries, make_params(options.sqpoll)};
+        backend_ = io_backend::io_uring;
+      } catch (const mfile_system_error& e) {
+        if (backend_ == io_backend::io_uring
+            || !io_uring_unavailable(e.code().value())) {
+          throw;
+        }
+        backend_ = io_backend::thread_pool;
+      }
+    }
+    if (backend_ == io_backend::thread_pool) {
+      pool_ = std::make_unique<detail::thread_pool_backend>(options.threads);
+    } else if (!files_.empty()) {
+      // A sparse table; slots are filled by register_file()
+      auto const fds = std::vector<int>(files_.size(), -1);
+      ring_.register_op(IORING_REGISTER_FILES, fds.data(),
+                        static_cast<unsigned>(fds.size()));
+    }
+  }
+
+  io_context(const io_context&) = delete;
+  auto operator=(const io_context&) -> io_context& = delete;
+  io_context(io_context&&) = delete;
+  auto operator=(io_context&&) -> io_context& = delete;
+  ~io_context() = default;
+
+  // The backend actually in use.
+  [[nodiscard]]
+  auto backend() const noexcept -> io_backend {
+    return backend_;
+  }
+
+  // Moves f into a free slot of the fixed file table. Throws ENFILE if the
+  // table (io_context_options::fixed_files) is full.
+  auto register_file(file<file_handle> f) -> registered_file {
+    auto const it = std::find_if(files_.begin(), files_.end(),
+                                 [](const auto& slot) { return !slot.used; });
+    if (it == files_.end()) {
+      throw mfile_system_error{ENFILE, "fixed file table is full"};
+    }
+    auto const index = static_cast<unsigned>(it - files_.begin());
+    if (ring_) {
+      update_fixed_file(index, f.handle()->native());
+    }
+    it->owned = std::move(f);
+    it->used = true;
+    return registered_file{index};
+  }
+
+  // Removes the file from the table and returns ownership of it. Throws
+  // EBUSY while operations on it are in flight.
+  auto unregister_file(registered_file slot) -> file<file_handle> {
+    auto& entry = fixed_slot(slot.index());
+    if (entry.in_flight > 0) {
+      throw mfile_system_error{EBUSY,
+                               "registered file has operations in flight"};
+    }
+    if (ring_) {
+      update_fixed_file(slot.index(), -1);
+    }
+    entry.used = false;
+    return std::exchange(entry.owned, {});
+  }
+
+  // The file behind a slot, for synchronous calls such as size().
+  [[nodiscard]]
+  auto registered(registered_file slot) const -> const file<file_handle>& {
+    return fixed_slot(slot.index()).owned;
+  }
+
+  // Registers the buffers for READ_FIXED/WRITE_FIXED transfers. The memory
+  // must stay valid until unregister_buffers() or the context is destroyed.
+  // Only one set can be registered at a time.
+  auto register_buffers(std::span<const byte_view> buffers)
+      -> std::vector<registered_buffer> {
+    if (!buffers_.empty()) {
+      throw mfile_system_error{EBUSY, "buffers are already registered"};
+    }
+    if (buffers.size() > max_registered_buffers) {
+      throw mfile_system_error{EINVAL, "too many buffers to register"};
+    }
+    if (ring_ && !buffers.empty()) {
+      auto iov = std::vector<::iovec>{};
+      iov.reserve(buffers.size());
+      for (auto const& b : buffers) {
+        iov.push_back({b.data(), b.size()});
+      }
+      ring_.register_op(IORING_REGISTER_BUFFERS, iov.data(),
+                        static_cast<unsigned>(iov.size()));
+    }
+    auto result = std::vector<registered_buffer>{};
+    result.reserve(buffers.size());
+    for (std::size_t i = 0; i < buffers.size(); ++i) {
+      result.emplace_back(static_cast<std::uint16_t>(i), buffers[i]);
+    }
+    buffers_.assign(buffers.begin(), buffers.end());
+    return result;
+  }
+
+  // Throws EBUSY while fixed-buffer operations are in flight.
+  void unregister_buffers() {
+    if (buffer_ops_ > 0) {
+      throw mfile_system_error{EBUSY,
+                               "registered buffers have operations in flight"};
+    }
+    if (ring_ && !buffers_.empty()) {
+      ring_.register_op(IORING_UNREGISTER_BUFFERS, nullptr, 0);
+    }
+    buffers_.clear();
+  }
+
+  void submit(io_operation& op) {
+    acquire(op.request);
+    op.next_link = nullptr;
+    if (pool_) {
+      pool_pending_.push_back(make_job(op));
+      ++outstanding_;
+      return;
+    }
+    auto const timed = op.request.timeout.count() > 0;
+    try {
+      reserve_sqes(timed ? 2 : 1);
+    } catch (...) {
+      release(op.request);
+      throw;
+    }
+    auto& sqe = next_sqe();
+    prepare(sqe, op.request);
+    sqe.user_data = tag(op);
+    if (timed) {
+      sqe.flags |= IOSQE_IO_LINK;
+      prepare_timeout(next_sqe(), op);
+    }
+    ++outstanding_;
+  }
+
+  // Asks for a submitted operation to be cancelled. It then completes with
+  // -ECANCELED, or with its result if it finished first. Must be called on
+  // the thread running the context. With the thread_pool backend only
+  // requests that have not started yet can be cancelled.
+  void cancel(io_operation& op) {
+    if (pool_) {
+      pool_->submit(pool_pending_);
+      pool_->cancel(&op);
+      return;
+    }
+    reserve_sqes(1);
+    auto& sqe = next_sqe();
+    sqe.opcode = IORING_OP_ASYNC_CANCEL;
+    sqe.addr = tag(op);
+    sqe.user_data = ignored_completion;
+  }
+
+  // Thread-safe cancel(): the request is queued for the thread running the
+  // context, which is woken up if it is waiting. enable_remote_wake() must
+  // have been called on that thread first.
+  void post_cancel(io_operation& op) {
+    {
+      auto lock = std::scoped_lock{remote_mutex_};
+      remote_cancels_.push_back(&op);
+      has_remote_cancels_.store(true, std::memory_order_release);
+    }
+    if (pool_) {
+      pool_->wake();
+    } else {
+      ::eventfd_write(wake_fd_->native(), 1);
+    }
+  }
+
+  // Drops a post_cancel() that is still queued for op, e.g. because op is
+  // about to complete and be destroyed.
+  void withdraw_cancel(const io_operation& op) noexcept {
+    if (!has_remote_cancels_.load(std::memory_order_acquire)) {
+      return;
+    }
+    auto lock = std::scoped_lock{remote_mutex_};
+    std::erase(remote_cancels_, &op);
+  }
+
+  // Lets other threads interrupt a waiting run_one() through post_cancel().
+  // With io_uring this keeps a read on an eventfd in flight.
+  void enable_remote_wake() {
+    if (pool_ || wake_fd_) {
+      return;
+    }
+    auto const fd = ::eventfd(0, EFD_CLOEXEC);
+    if (fd == -1) {
+      throw mfile_system_error{errno, "eventfd failed"};
+    }
+    wake_fd_.reset(fd);
+    arm_wake();
+  }
+
+  // Submits ops as one chain (IOSQE_IO_LINK): each starts only after the
+  // previous one succeeded. An error or a short transfer completes the rest
+  // of the chain with -ECANCELED. The whole chain must fit in the submission
+  // queue. Links take no timeout (see async_chain()).
+  void submit_linked(std::span<io_operation* const> ops) {
+    if (ops.empty()) {
+      return;
+    }
+    if (ring_ && ops.size() > ring_.params().sq_entries) {
+      throw mfile_system_error{EINVAL, "linked chain exceeds the queue depth"};
+    }
+    if (std::ranges::any_of(
+            ops, [](auto* op) { return op->request.timeout.count() > 0; })) {
+      throw mfile_system_error{EINVAL, "linked requests cannot time out"};
+    }
+    std::size_t acquired = 0;
+    try {
+      for (; acquired < ops.size(); ++acquired) {
+        acquire(ops[acquired]->request);
+      }
+      if (ring_) {
+        reserve_sqes(static_cast<unsigned>(ops.size()));
+      }
+    } catch (...) {
+      for (std::size_t i = 0; i < acquired; ++i) {
+        release(ops[i]->request);
+      }
+      throw;
+    }
+    for (std::size_t i = 0; i < ops.size(); ++i) {
+      ops[i]->next_link = i + 1 < ops.size() ? ops[i + 1] : nullptr;
+    }
+    outstanding_ += ops.size();
+    if (pool_) {
+      // Each link is queued when its predecessor completes
+      pool_pending_.push_back(make_job(*ops.front()));
+      return;
+    }
+    for (auto* op : ops) {
+      auto& sqe = next_sqe();
+      prepare(sqe, op->request);
+      if (op->next_link != nullptr) {
+        sqe.flags |= IOSQE_IO_LINK;
+      }
+      sqe.user_data = tag(*op);
+    }
+  }
+
+  // Submits pending operations and waits until at least one completes.
+  // Returns the number of completions dispatched; 0 if there is no work.
+  auto run_one() -> std::size_t {
+    // Wake-ups and the context's own requests (remote cancels, link
+    // timeouts) complete without counting, so wait on past them
+    while (outstanding_ > 0) {
+      process_remote_cancels();
+      auto count = std::size_t{};
+      if (pool_) {
+        pool_->submit(pool_pending_);
+        count = dispatch_pool(true, std::numeric_limits<std::size_t>::max());
+      } else {
+        ring_.submit(ring_.cq_ready() == 0 ? 1 : 0);
+        count = dispatch(std::numeric_limits<std::size_t>::max());
+      }
+      if (count > 0) {
+        return count;
+      }
+    }
+    return 0;
+  }
+
+  // Submits pending operations and dispatches completions that are already
+  // available without blocking.
+  auto poll() -> std::size_t { return poll_completions(); }
+
+  // Like poll(), but dispatches at most max completions per call, so an
+  // event loop can interleave other work. Re-arms completion_fd() if
+  // completions are left over.
+  auto poll_completions(
+      std::size_t max = std::numeric_limits<std::size_t>::max())
+      -> std::size_t {
+    if (notify_fd_) {
+      // Reset first; completions arriving from now on signal it again
+      auto value = ::eventfd_t{};
+      ::eventfd_read(notify_fd_->native(), &value);
+    }
+    if (outstanding_ == 0) {
+      return 0;
+    }
+    process_remote_cancels();
+    auto count = std::size_t{};
+    auto left_over = false;
+    if (pool_) {
+      pool_->submit(pool_pending_);
+      count = dispatch_pool(false, max);
+      left_over = pool_done_pos_ < pool_done_.size();
+    } else {
+      ring_.submit();
+      count = dispatch(max);
+      left_over = ring_.cq_ready() > 0;
+    }
+    if (notify_fd_ && left_over) {
+      ::eventfd_write(notify_fd_->native(), 1);
+    }
+    return count;
+  }
+
+  // An eventfd that becomes readable when completions are ready, to be
+  // added to an existing epoll set; created on first use. The event loop
+  // then calls poll_completions(). With io_uring, submissions queued by
+  // submit() only reach the kernel on the next poll_completions() call.
+  [[nodiscard]]
+  auto completion_fd() -> int {
+    if (!notify_fd_) {
+      auto const fd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+      if (fd == -1) {
+        throw mfile_system_error{errno, "eventfd failed"};
+      }
+      auto handle = file_handle{weak_file_handle{fd}};
+      if (pool_) {
+        pool_->notify_through(fd);
+      } else {
+        ring_.register_op(IORING_REGISTER_EVENTFD, &fd, 1);
+      }
+      notify_fd_ = std::move(handle);
+    }
+    return notify_fd_->native();
+  }
+
+  // Runs until every submitted operation, including ones submitted from
+  // completion handlers, has completed.
+  auto run() -> std::size_t {
+    std::size_t count = 0;
+    while (outstanding_ > 0) {
+      count += run_one();
+    }
+    return count;
+  }
+
+  [[nodiscard]]
+  auto outstanding() const noexcept -> std::size_t {
+    return outstanding_;
+  }
+
+  // The underlying ring; empty with the thread_pool backend.
+  [[nodiscard]]
+  auto ring() noexcept -> uring& {
+    return ring_;
+  }
+
+ private:
+  // IORING_REGISTER_BUFFERS limit (UIO_MAXIOV); also bounds buf_index.
+  static constexpr std::size_t max_registered_buffers = 1024;
+  // user_data of internal SQEs: operations are tagged with their address
+  static constexpr std::uint64_t ignored_completion = 0;
+  static constexpr std::uint64_t wake_completion = 1;
+
+  struct fixed_file_slot {
+    file<file_handle> owned;
+    std::size_t in_flight{};
+    bool used{};
+  };
+
+  io_backend backend_;
+  // Owned files outlive the ring, which still references them until closed
+  std::vector<fixed_file_slot> files_;
+  std::vector<byte_view> buffers_;
+  std::size_t buffer_ops_{};
+  file_handle wake_fd_;
+  file_handle notify_fd_;
+  std::uint64_t wake_value_{};
+  std::mutex remote_mutex_;
+  std::vector<io_operation*> remote_cancels_;
+  std::atomic<bool> has_remote_cancels_{};
+  uring ring_;
+  std::unique_ptr<detail::thread_pool_backend> pool_;
+  std::vector<detail::thread_pool_backend::job> pool_pending_;
+  std::vector<detail::thread_pool_backend::completion> pool_done_;
+  std::size_t pool_done_pos_{};
+  std::size_t outstanding_{};
+
+  // Errors io_uring_setup reports when io_uring is compiled out, disabled by
+  // sysctl or filtered by seccomp.
+  [[nodiscard]]
+  static auto io_uring_unavailable(int err) noexcept -> bool {
+    return err == ENOSYS || err == EPERM || err == EACCES;
+  }
+
+  static auto make_params(const sqpoll_options& sqpoll) -> io_uring_params {
+    auto params = io_uring_params{};
+    if (sqpoll.enabled) {
+      params.flags |= IORING_SETUP_SQPOLL;
+      params.sq_thread_idle = static_cast<std::uint32_t>(sqpoll.idle.count());
+      if (sqpoll.cpu >= 0) {
+        params.flags |= IORING_SETUP_SQ_AFF;
+        params.sq_thread_cpu = static_cast<std::uint32_t>(sqpoll.cpu);
+      }
+    }
+    return params;
+  }
+
+  static auto tag(const io_operation& op) noexcept -> std::uint64_t {
+    return reinterpret_cast<std::uint64_t>(&op);  // NOLINT
+  }
+
+  auto make_job(io_operation& op) const
+      -> detail::thread_pool_backend::job {
+    using clock = detail::thread_pool_backend::clock;
+    auto job = detail::thread_pool_backend::job{&op, resolve(op.request)};
+    if (op.request.timeout.count() > 0) {
+      job.deadline = clock::now()
+                     + std::chrono::duration_cast<clock::duration>(
+                         op.request.timeout);
+    }
+    return job;
+  }
+
+  void arm_wake() {
+    reserve_sqes(1);
+    auto& sqe = next_sqe();
+    sqe.opcode = IORING_OP_READ;
+    sqe.fd = wake_fd_->native();
+    sqe.addr = reinterpret_cast<std::uint64_t>(&wake_value_);  // NOLINT
+    sqe.len = sizeof(wake_value_);
+    sqe.user_data = wake_completion;
+  }
+
+  void process_remote_cancels() {
+    if (!has_remote_cancels_.load(std::memory_order_acquire)) {
+      return;
+    }
+    auto ops = std::vector<io_operation*>{};
+    {
+      auto lock = std::scoped_lock{remote_mutex_};
+      ops.swap(remote_cancels_);
+      has_remote_cancels_.store(false, std::memory_order_relaxed);
+    }
+    for (auto* op : ops) {
+      cancel(*op);
+    }
+  }
+
+  auto fixed_slot(unsigned index) -> fixed_file_slot& {
+    if (index >= files_.size() || !files_[index].used) {
+      throw mfile_system_error{EBADF, "invalid registered file"};
+    }
+    return files_[index];
+  }
+  [[nodiscard]]
+  auto fixed_slot(unsigned index) const -> const fixed_file_slot& {
+    return const_cast<io_context*>(this)->fixed_slot(index);  // NOLINT
+  }
+
+  // Makes room for n consecutive SQEs so a chain is not split across two
+  // submissions.
+  void reserve_sqes(unsigned n) {
+    if (ring_.space_left() < n) {
+      ring_.submit();
+      while (ring_.sqpoll() && ring_.space_left() < n) {
+        ring_.wait_for_sq_space();
+      }
+    }
+    if (ring_.space_left() < n) {
+      throw mfile_system_error{EBUSY, "io_uring submission queue full"};
+    }
+  }
+
+  // The next SQE of those reserve_sqes() made room for.
+  auto next_sqe() -> io_uring_sqe& {
+    auto* sqe = ring_.get_sqe();
+    if (sqe == nullptr) {
+      throw mfile_system_error{EBUSY, "io_uring submission queue full"};
+    }
+    return *sqe;
+  }
+
+  void update_fixed_file(unsigned index, int fd) {
+    auto update = io_uring_files_update{};
+    update.offset = index;
+    update.fds = reinterpret_cast<std::uint64_t>(&fd);  // NOLINT
+    ring_.register_op(IORING_REGISTER_FILES_UPDATE, &update, 1);
+  }
+
+  // Validates the fixed resources a request uses and pins them.
+  void acquire(const io_request& req) {
+    if ((req.flags & io_request::fixed_buffer) != 0) {
+      if (req.buf_index >= buffers_.size()) {
+        throw mfile_system_error{EFAULT, "invalid registered buffer"};
+      }
+      auto const& buffer = buffers_[req.buf_index];
+      if (req.data < buffer.data()
+          || req.data + req.size > buffer.data() + buffer.size()) {
+        throw mfile_system_error{EFAULT,
+                                 "transfer exceeds the registered buffer"};
+      }
+    }
+    if ((req.flags & io_request::fixed_file) != 0) {
+      ++fixed_slot(static_cast<unsigned>(req.fd)).in_flight;
+    }
+    if ((req.flags & io_request::fixed_buffer) != 0) {
+      ++buffer_ops_;
+    }
+  }
+
+  void release(const io_request& req) noexcept {
+    if ((req.flags & io_request::fixed_file) != 0) {
+      --files_[static_cast<unsigned>(req.fd)].in_flight;
+    }
+    if ((req.flags & io_request::fixed_buffer) != 0) {
+      --buffer_ops_;
+    }
+  }
+
+  // The thread pool has no fixed tables: use the plain descriptor and the
+  // buffer address directly.
+  auto resolve(io_request req) const noexcept -> io_request {
+    if ((req.flags & io_request::fixed_file) != 0) {
+      req.fd = files_[static_cast<unsigned>(req.fd)].owned.handle()->native();
+    }
+    req.flags = 0;
+    return req;
+  }
+
+  static void prepare_timeout(io_uring_sqe& sqe, io_operation& op) noexcept {
+    auto const ns = op.request.timeout.count();
+    op.timeout_spec_.tv_sec = ns / 1'000'000'000;
+    op.timeout_spec_.tv_nsec = ns % 1'000'000'000;
+    sqe.opcode = IORING_OP_LINK_TIMEOUT;
+    sqe.addr = reinterpret_cast<std::uint64_t>(&op.timeout_spec_);  // NOLINT
+    sqe.len = 1;
+    sqe.user_data = ignored_completion;
+  }
+
+  static void prepare(io_uring_sqe& sqe, const io_request& req) noexcept {
+    sqe.fd = req.fd;
+    sqe.addr = reinterpret_cast<std::uint64_t>(req.data);  // NOLINT
+    sqe.len = req.size;
+    sqe.off = req.offset;
+    auto const fixed_buffer = (req.flags & io_request::fixed_buffer) != 0;
+    switch (req.opcode) {
+      case io_opcode::nop:
+        sqe.opcode = IORING_OP_NOP;
+        break;
+      case io_opcode::read:
+        sqe.opcode = fixed_buffer ? IORING_OP_READ_FIXED : IORING_OP_READ;
+        break;
+      case io_opcode::write:
+        sqe.opcode = fixed_buffer ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+        break;
+      case io_opcode::fsync:
+        sqe.opcode = IORING_OP_FSYNC;
+        break;
+      case io_opcode::fdatasync:
+        sqe.opcode = IORING_OP_FSYNC;
+        sqe.fsync_flags = IORING_FSYNC_DATASYNC;
+        break;
+      case io_opcode::openat:
+        sqe.opcode = IORING_OP_OPENAT;
+        sqe.addr = reinterpret_cast<std::uint64_t>(req.path);  // NOLINT
+        sqe.open_flags = static_cast<std::uint32_t>(req.path_flags);
+        break;
+      case io_opcode::statx:
+        sqe.opcode = IORING_OP_STATX;
+        sqe.addr = reinterpret_cast<std::uint64_t>(req.path);  // NOLINT
+        sqe.off = reinterpret_cast<std::uint64_t>(req.data);   // NOLINT
+        sqe.statx_flags = static_cast<std::uint32_t>(req.path_flags);
+        break;
+      case io_opcode::close:
+        sqe.opcode = IORING_OP_CLOSE;
+        break;
+    }
+    if ((req.flags & io_request::fixed_file) != 0) {
+      sqe.flags |= IOSQE_FIXED_FILE;
+    }
+    if ((req.flags & io_request::drain) != 0) {
+      sqe.flags |= IOSQE_IO_DRAIN;
+    }
+    if (fixed_buffer) {
+      sqe.buf_index = req.buf_index;
+    }
+  }
+
+  auto dispatch(std::size_t max) -> std::size_t {
+    std::size_t count = 0;
+    auto const limit = static_cast<unsigned>(
+        std::min<std::size_t>(max, std::numeric_limits<unsigned>::max()));
+    ring_.for_each_cqe(limit, [this, &count](const io_uring_cqe& cqe) {
+      if (cqe.user_data == ignored_completion) {
+        return;
+      }
+      if (cqe.user_data == wake_completion) {
+        arm_wake();
+        return;
+      }
+      --outstanding_;
+      ++count;
+      auto* op = reinterpret_cast<io_operation*>(cqe.user_data);  // NOLINT
+      release(op->request);
+      op->on_complete(cqe.res);
+    });
+    return count;
+  }
+
+  auto dispatch_pool(bool wait, std::size_t max) -> std::size_t {
+    if (pool_done_pos_ == pool_done_.size()) {
+      pool_done_.clear();
+      pool_done_pos_ = 0;
+      pool_->reap(pool_done_, wait);
+    }
+    std::size_t count = 0;
+    while (pool_done_pos_ < pool_done_.size() && count < max) {
+      auto const [op, result] = pool_done_[pool_done_pos_++];
+      auto* next = op->next_link;
+      auto const broken = breaks_chain(op->request, result);
+      --outstanding_;
+      release(op->request);
+      op->on_complete(result);
+      ++count;
+      // Emulate io_uring link semantics
+      if (next != nullptr && !broken) {
+        pool_pending_.push_back(make_job(*next));
+        continue;
+      }
+      for (; next != nullptr; ++count) {
+        auto* cancelled = std::exchange(next, next->next_link);
+        --outstanding_;
+        release(cancelled->request);
+        cancelled->on_complete(-ECANCELED);
+      }
+    }
+    return count;
+  }
+
+  [[nodiscard]]
+  static auto breaks_chain(const io_request& req,
+                           std::int32_t result) noexcept -> bool {
+    if (result < 0) {
+      return true;
+    }
+    auto const transfer
+        = req.opcode == io_opcode::read || req.opcode == io_opcode::write;
+    return transfer && static_cast<std::uint32_t>(result) != req.size;
+  }
+};
+
+}  // namespace mfile
@@ -0,0 +1,335 @@
+// mfile - A modern C++20 file handling library
+// (https://github.com/range3/mfile)
+// Licensed under MIT License
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "mfile/mfile.hpp"
+
+namespace mfile {
+
+// Minimal RAII wrapper around an io_uring instance using the raw system
+// calls, so no liburing dependency is needed. Single-threaded: one thread
+// prepares SQEs, submits and reaps CQEs.
+//
+// With IORING_SETUP_SQPOLL a kernel thread consumes the submission queue, so
+// submit() only enters the kernel to wait for completions or to wake the
+// poller after it went idle.
+class uring {
+ public:
+  struct counters {
+    std::uint64_t enters{};  // io_uring_enter calls
+    std::uint64_t sqpoll_wakeups{};  // times the SQPOLL thread was found idle
+  };
+
+  uring() noexcept = default;
+
+  explicit uring(unsigned entries, io_uring_params params = {}) {
+    auto fd = static_cast<int>(
+        ::syscall(__NR_io_uring_setup, entries, &params));  // NOLINT
+    if (fd < 0) {
+      throw mfile_system_error{errno, "io_uring_setup failed"};
+    }
+    fd_ = fd;
+    params_ = params;
+    try {
+      map_rings();
+    } catch (...) {
+      unmap_rings();
+      ::close(fd_);
+      throw;
+    }
+  }
+
+  uring(const uring&) = delete;
+  auto operator=(const uring&) -> uring& = delete;
+
+  uring(uring&& other) noexcept { swap(other); }
+  auto operator=(uring&& other) noexcept -> uring& {
+    uring{std::move(other)}.swap(*this);
+    return *this;
+  }
+
+  ~uring() noexcept {
+    if (fd_ >= 0) {
+      unmap_rings();
+      ::close(fd_);
+    }
+  }
+
+  [[nodiscard]]
+  explicit operator bool() const noexcept {
+    return fd_ >= 0;
+  }
+
+  [[nodiscard]]
+  auto native() const noexcept -> int {
+    return fd_;
+  }
+
+  [[nodiscard]]
+  auto params() const noexcept -> const io_uring_params& {
+    return params_;
+  }
+
+  // Returns a zeroed SQE, or nullptr if the submission queue is full.
+  [[nodiscard]]
+  auto get_sqe() noexcept -> io_uring_sqe* {
+    auto const head = load_acquire(sq_head_);
+    if (sqe_tail_ - head >= sq_entries_) {
+      return nullptr;
+    }
+    auto* sqe = &sqes_[sqe_tail_ & sq_mask_];
+    ++sqe_tail_;
+    std::memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+  }
+
+  // Number of SQEs get_sqe() can still return.
+  [[nodiscard]]
+  auto space_left() const noexcept -> unsigned {
+    return sq_entries_ - (sqe_tail_ - load_acquire(sq_head_));
+  }
+
+  // Number of SQEs prepared but not yet handed to the kernel.
+  [[nodiscard]]
+  auto pending() const noexcept -> unsigned {
+    return sqe_tail_ - *sq_tail_;
+  }
+
+  [[nodiscard]]
+  auto sqpoll() const noexcept -> bool {
+    return (params_.flags & IORING_SETUP_SQPOLL) != 0;
+  }
+
+  // Publishes prepared SQEs and enters the kernel to submit them, waiting for
+  // at least wait_nr completions. Returns the number of SQEs consumed, or
+  // with SQPOLL the number handed to the poller.
+  auto submit(unsigned wait_nr = 0) -> unsigned {
+    auto const to_submit = flush();
+    unsigned flags = 0;
+    if (wait_nr > 0) {
+      flags |= IORING_ENTER_GETEVENTS;
+    }
+    if (sqpoll()) {
+      // The tail store must be visible before the poller's flag is read
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if ((sq_flags() & IORING_SQ_NEED_WAKEUP) != 0) {
+        flags |= IORING_ENTER_SQ_WAKEUP;
+        ++counters_.sqpoll_wakeups;
+      }
+      if (flags != 0) {
+        enter(to_submit, wait_nr, flags);
+      }
+      return to_submit;
+    }
+    if (to_submit == 0 && wait_nr == 0) {
+      return 0;
+    }
+    return enter(to_submit, wait_nr, flags);
+  }
+
+  // With SQPOLL, waits until the poller has made room in a full submission
+  // queue.
+  void wait_for_sq_space() {
+    if (sqpoll()) {
+      enter(0, 0, IORING_ENTER_SQ_WAIT);
+    }
+  }
+
+  auto enter(unsigned to_submit, unsigned wait_nr, unsigned flags) -> unsigned {
+    ++counters_.enters;
+    long result = -1;
+    do {  // NOLINT
+      result = ::syscall(__NR_io_uring_enter, fd_, to_submit, wait_nr, flags,
+                         nullptr, 0);
+    } while (result == -1 && errno == EINTR);
+    if (result == -1) {
+      throw mfile_system_error{errno, "io_uring_enter failed"};
+    }
+    return static_cast<unsigned>(result);
+  }
+
+  // Makes prepared SQEs visible to the kernel without entering it.
+  auto flush() noexcept -> unsigned {
+    auto const tail = *sq_tail_;
+    if (sqe_tail_ != tail) {
+      store_release(sq_tail_, sqe_tail_);
+    }
+    return sqe_tail_ - load_acquire(sq_head_);
+  }
+
+  // Calls fn(const io_uring_cqe&) for each available CQE, consuming them.
+  template <typename Fn>
+  auto for_each_cqe(Fn&& fn) -> unsigned {
+    return for_each_cqe(~0U, std::forward<Fn>(fn));
+  }
+
+  // As above, but consumes at most max CQEs.
+  template <typename Fn>
+  auto for_each_cqe(unsigned max, Fn&& fn) -> unsigned {
+    unsigned count = 0;
+    auto head = *cq_head_;
+    while (count < max) {
+      auto const tail = load_acquire(cq_tail_);
+      if (head == tail) {
+        break;
+      }
+      for (; head != tail && count < max; ++head, ++count) {
+        auto const cqe = cqes_[head & cq_mask_];
+        store_release(cq_head_, head + 1);
+        fn(cqe);
+      }
+    }
+    return count;
+  }
+
+  [[nodiscard]]
+  auto cq_ready() const noexcept -> unsigned {
+    return load_acquire(cq_tail_) - *cq_head_;
+  }
+
+  [[nodiscard]]
+  auto sq_flags() const noexcept -> unsigned {
+    return load_acquire(sq_flags_);
+  }
+
+  [[nodiscard]]
+  auto stats() const noexcept -> counters {
+    return counters_;
+  }
+
+  auto register_op(unsigned opcode, const void* arg, unsigned nr_args) -> int {
+    long result = -1;
+    do {  // NOLINT
+      result = ::syscall(__NR_io_uring_register, fd_, opcode, arg, nr_args);
+    } while (result == -1 && errno == EINTR);
+    if (result == -1) {
+      throw mfile_system_error{errno, "io_uring_register failed"};
+    }
+    return static_cast<int>(result);
+  }
+
+  void swap(uring& other) noexcept {
+    using std::swap;
+    swap(fd_, other.fd_);
+    swap(params_, other.params_);
+    swap(sq_ring_, other.sq_ring_);
+    swap(sq_ring_size_, other.sq_ring_size_);
+    swap(cq_ring_, other.cq_ring_);
+    swap(cq_ring_size_, other.cq_ring_size_);
+    swap(sqes_, other.sqes_);
+    swap(sq_head_, other.sq_head_);
+    swap(sq_tail_, other.sq_tail_);
+    swap(sq_flags_, other.sq_flags_);
+    swap(sq_mask_, other.sq_mask_);
+    swap(sq_entries_, other.sq_entries_);
+    swap(sqe_tail_, other.sqe_tail_);
+    swap(cq_head_, other.cq_head_);
+    swap(cq_tail_, other.cq_tail_);
+    swap(cq_mask_, other.cq_mask_);
+    swap(cqes_, other.cqes_);
+    swap(counters_, other.counters_);
+  }
+
+ private:
+  int fd_{-1};
+  io_uring_params params_{};
+  void* sq_ring_{MAP_FAILED};
+  std::size_t sq_ring_size_{};
+  void* cq_ring_{MAP_FAILED};
+  std::size_t cq_ring_size_{};
+  io_uring_sqe* sqes_{};
+  unsigned* sq_head_{};
+  unsigned* sq_tail_{};
+  unsigned* sq_flags_{};
+  unsigned sq_mask_{};
+  unsigned sq_entries_{};
+  unsigned sqe_tail_{};
+  unsigned* cq_head_{};
+  unsigned* cq_tail_{};
+  unsigned cq_mask_{};
+  io_uring_cqe* cqes_{};
+  counters counters_{};
+
+  static auto load_acquire(const unsigned* p) noexcept -> unsigned {
+    return std::atomic_ref<const unsigned>{*p}.load(std::memory_order_acquire);
+  }
+  static void store_release(unsigned* p, unsigned v) noexcept {
+    std::atomic_ref<unsigned>{*p}.store(v, std::memory_order_release);
+  }
+
+  static auto map(int fd, std::size_t size, std::uint64_t offset) -> void* {
+    auto* p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd, static_cast<off_t>(offset));
+    if (p == MAP_FAILED) {
+      throw mfile_system_error{errno, "io_uring mmap failed"};
+    }
+    return p;
+  }
+
+  template <typename T>
+  auto at(void* base, std::uint32_t offset) noexcept -> T* {
+    return reinterpret_cast<T*>(static_cast<char*>(base) + offset);  // NOLINT
+  }
+
+  void map_rings() {
+    auto const& sq = params_.sq_off;
+    auto const& cq = params_.cq_off;
+    sq_ring_size_ = sq.array + (params_.sq_entries * sizeof(unsigned));
+    cq_ring_size_ = cq.cqes + (params_.cq_entries * sizeof(io_uring_cqe));
+    auto const single = (params_.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single) {
+      sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+    sq_ring_ = map(fd_, sq_ring_size_, IORING_OFF_SQ_RING);
+    cq_ring_ = single ? sq_ring_ : map(fd_, cq_ring_size_, IORING_OFF_CQ_RING);
+    sqes_ = static_cast<io_uring_sqe*>(
+        map(fd_, params_.sq_entries * sizeof(io_uring_sqe), IORING_OFF_SQES));
+
+    sq_head_ = at<unsigned>(sq_ring_, sq.head);
+    sq_tail_ = at<unsigned>(sq_ring_, sq.tail);
+    sq_flags_ = at<unsigned>(sq_ring_, sq.flags);
+    sq_mask_ = *at<unsigned>(sq_ring_, sq.ring_mask);
+    sq_entries_ = *at<unsigned>(sq_ring_, sq.ring_entries);
+    sqe_tail_ = *sq_tail_;
+    // SQE slots are used in ring order, so the index array is the identity
+    auto* array = at<unsigned>(sq_ring_, sq.array);
+    for (unsigned i = 0; i < sq_entries_; ++i) {
+      array[i] = i;  // NOLINT
+    }
+
+    cq_head_ = at<unsigned>(cq_ring_, cq.head);
+    cq_tail_ = at<unsigned>(cq_ring_, cq.tail);
+    cq_mask_ = *at<unsigned>(cq_ring_, cq.ring_mask);
+    cqes_ = at<io_uring_cqe>(cq_ring_, cq.cqes);
+  }
+
+  void unmap_rings() noexcept {
+    if (sqes_ != nullptr) {
+      ::munmap(sqes_, params_.sq_entries * sizeof(io_uring_sqe));
+      sqes_ = nullptr;
+    }
+    if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) {
+      ::munmap(cq_ring_, cq_ring_size_);
+    }
+    if (sq_ring_ != MAP_FAILED) {
+      ::munmap(sq_ring_, sq_ring_size_);
+    }
+    sq_ring_ = cq_ring_ = MAP_FAILED;
+  }
+};
+
+}  // namespace mfile
@@ -0,0 +1,358 @@
+// mfile - A modern C++20 file handling library
+// (https://github.com/range3/mfile)
+// Licensed under MIT License
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "mfile/crc32c.hpp"
+#include "mfile/endian.hpp"
+#include "mfile/mapped_file.hpp"
+#include "mfile/mfile.hpp"
+
+// Append-only record log. Each record is framed as
+//
+//   [len: u32 LE][crc: u32 LE][payload: len bytes]
+//
+// where crc is the CRC-32C of the four length bytes followed by the
+// payload. A header of eight zero bytes never matches a valid record, which
+// marks the end of the log in a zero-filled (preallocated) segment.
+
+namespace mfile {
+
+namespace detail {
+
+inline constexpr std::size_t log_header_size = 8;
+
+inline auto log_record_crc(const std::byte* len_bytes,
+                           cbyte_view payload) noexcept -> std::uint32_t {
+  return crc32c(payload, crc32c({len_bytes, 4}));
+}
+
+}  // namespace detail
+
+struct log_writer_options {
+  // Records are gathered here until commit() or until it is full.
+  std::size_t buffer_size = std::size_t{1} << 20U;
+  // The segment is extended with fallocate(2) in steps of this size, so
+  // that commit()'s fdatasync has no size change to journal. 0 disables
+  // preallocation.
+  std::uint64_t preallocate = std::uint64_t{64} << 20U;
+  // commit() ends with fdatasync(2); false only writes.
+  bool sync = true;
+};
+
+// Appends framed records to one segment file:
+//
+//   auto log = mfile::log_writer{mfile::open(path, mfile::open_flags::wp())};
+//   log.append(record1);
+//   log.append(record2);
+//   log.commit();  // one pwrite + one fdatasync for both
+//
+// Records appended since the last commit() are lost if the writer is
+// destroyed or the process dies.
+template <file_handle_like Handle = file_handle, file_hooks Hooks = no_hooks>
+class log_writer {
+ public:
+  using file_type = file<Handle, Hooks>;
+
+  // Writes records to f starting at offset end, e.g. the end of the valid
+  // records found by log_reader when resuming a segment. The segment is
+  // truncated to end, so that records left past it are not read back
+  // after the new ones, and O_APPEND is cleared from f: pwrite(2) would
+  // ignore the offsets otherwise.
+  explicit log_writer(file_type f,
+                      std::uint64_t end = 0,
+                      const log_writer_options& options = {})
+      : segment_{std::move(f)},
+        options_{options},
+        buffer_{std::make_unique_for_overwrite<std::byte[]>(  // NOLINT
+            options.buffer_size)},
+        buffer_offset_{end},
+        committed_{end} {
+    auto const fd = segment_.handle()->native();
+    auto const flags = ::fcntl(fd, F_GETFL);
+    if (flags == -1
+        || ((flags & O_APPEND) != 0
+            && ::fcntl(fd, F_SETFL, flags & ~O_APPEND) == -1)) {
+      throw mfile_system_error{errno, "fcntl failed"};
+    }
+    if (segment_.size() > end) {
+      segment_.truncate(end);
+    }
+    if (options_.preallocate != 0) {
+      allocated_ = segment_.size();
+    }
+  }
+
+  // Buffers a record and returns its offset in the segment.
+  auto append(cbyte_view payload) -> std::uint64_t {
+    if (payload.size() > std::numeric_limits<std::uint32_t>::max()) {
+      throw mfile_system_error{EMSGSIZE, "log record is too large"};
+    }
+    auto const offset = end();
+    auto const record_size = detail::log_header_size + payload.size();
+    if (used_ + record_size > options_.buffer_size) {
+      flush();
+    }
+
+    auto header = std::array<std::byte, detail::log_header_size>{};
+    detail::store_le32(header.data(),
+                       static_cast<std::uint32_t>(payload.size()));
+    detail::store_le32(header.data() + 4,
+                       detail::log_record_crc(header.data(), payload));
+
+    if (record_size > options_.buffer_size) {
+      // Too large to buffer: written directly, still synced by commit()
+      reserve(offset + record_size);
+      segment_.pwrite_exact(header, offset);
+      segment_.pwrite_exact(payload, offset + header.size());
+      buffer_offset_ = offset + record_size;
+      return offset;
+    }
+    std::memcpy(buffer_.get() + used_, header.data(), header.size());
+    std::memcpy(buffer_.get() + used_ + header.size(), payload.data(),
+                payload.size());
+    used_ += record_size;
+    return offset;
+  }
+
+  // Writes all buffered records with a single pwrite and makes everything
+  // appended so far durable with a single fdatasync.
+  void commit() {
+    flush();
+    if (committed_ == buffer_offset_) {
+      return;
+    }
+    if (options_.sync) {
+      segment_.datasync();
+    }
+    committed_ = buffer_offset_;
+  }
+
+  // Offset just past the last appended record.
+  [[nodiscard]]
+  auto end() const noexcept -> std::uint64_t {
+    return buffer_offset_ + used_;
+  }
+
+  // Offset just past the last committed record.
+  [[nodiscard]]
+  auto committed() const noexcept -> std::uint64_t {
+    return committed_;
+  }
+
+  [[nodiscard]]
+  auto segment() const noexcept -> const file_type& {
+    return segment_;
+  }
+
+ private:
+  file_type segment_;
+  log_writer_options options_;
+  std::unique_ptr<std::byte[]> buffer_;  // NOLINT(*-avoid-c-arrays)
+  std::size_t used_{};
+  // Segment offset of buffer_[0]
+  std::uint64_t buffer_offset_;
+  std::uint64_t committed_;
+  std::uint64_t allocated_{};
+
+  void flush() {
+    if (used_ == 0) {
+      return;
+    }
+    reserve(buffer_offset_ + used_);
+    segment_.pwrite_exact(cbyte_view{buffer_.get(), used_}, buffer_offset_);
+    buffer_offset_ += used_;
+    used_ = 0;
+  }
+
+  // Makes sure the segment is allocated up to end.
+  void reserve(std::uint64_t end) {
+    if (options_.preallocate == 0 || end <= allocated_) {
+      return;
+    }
+    auto const step = options_.preallocate;
+    auto const target = (end + step - 1) / step * step;
+    try {
+      segment_.allocate(allocated_, target - allocated_);
+      allocated_ = target;
+    } catch (const mfile_system_error& e) {
+      if (e.code().value() != EOPNOTSUPP) {
+        throw;
+      }
+      options_.preallocate = 0;
+    }
+  }
+};
+
+// Why a log_reader stopped.
+enum class log_tail : std::uint8_t {
+  // The segment ended, or continued with zeros (unused preallocation).
+  clean,
+  // A record extends past the end of the segment: an interrupted append.
+  truncated,
+  // A record's checksum does not match: a torn write or corruption.
+  checksum_mismatch,
+};
+
+struct log_record {
+  std::uint64_t offset;
+  // Points into the mapped segment.
+  cbyte_view payload;
+};
+
+// Iterates the records of a segment without copying, verifying each
+// checksum, and stops at the first record that is not intact:
+//
+//   auto reader = mfile::log_reader{mfile::open(path, mfile::open_flags::r())};
+//   for (auto const& record : reader) replay(record.payload);
+//   if (reader.tail() != mfile::log_tail::clean) {
+//     // records from reader.valid_end() on are lost; resume writing there
+//   }
+//
+// valid_end() and tail() describe the position iteration stopped at.
+class log_reader {
+ public:
+  class iterator {
+   public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = log_record;
+    using difference_type = std::ptrdiff_t;
+
+    iterator() noexcept = default;
+    explicit iterator(log_reader* reader) noexcept : reader_{reader} {}
+
+    [[nodiscard]]
+    auto operator*() const noexcept -> const log_record& {
+      return reader_->current_;
+    }
+    [[nodiscard]]
+    auto operator->() const noexcept -> const log_record* {
+      return &reader_->current_;
+    }
+
+    auto operator++() noexcept -> iterator& {
+      if (!reader_->next()) {
+        reader_ = nullptr;
+      }
+      return *this;
+    }
+    void operator++(int) noexcept { ++*this; }
+
+    [[nodiscard]]
+    friend auto operator==(const iterator& it,
+                           std::default_sentinel_t /*end*/) noexcept -> bool {
+      return it.reader_ == nullptr;
+    }
+
+   private:
+    log_reader* reader_{};
+  };
+
+  // Reads records from memory the caller keeps alive, starting at start.
+  explicit log_reader(cbyte_view segment, std::uint64_t start = 0) noexcept
+      : segment_{segment}, start_{start}, valid_end_{start} {}
+
+  // Maps the whole segment file.
+  template <file_handle_like Handle, file_hooks Hooks, metadata_policy Metadata>
+  explicit log_reader(const file<Handle, Hooks, Metadata>& f,
+                      std::uint64_t start = 0)
+      : mapping_{f}, segment_{mapping_}, start_{start}, valid_end_{start} {
+    mapping_.advise(MADV_SEQUENTIAL);
+  }
+
+  log_reader(const log_reader&) = delete;
+  log_reader(log_reader&&) = delete;
+  auto operator=(const log_reader&) -> log_reader& = delete;
+  auto operator=(log_reader&&) -> log_reader& = delete;
+  ~log_reader() = default;
+
+  // Restarts from the start offset.
+  [[nodiscard]]
+  auto begin() noexcept -> iterator {
+    valid_end_ = start_;
+    tail_ = log_tail::clean;
+    return next() ? iterator{this} : iterator{};
+  }
+
+  [[nodiscard]]
+  static auto end() noexcept -> std::default_sentinel_t {
+    return {};
+  }
+
+  // Offset just past the last intact record seen.
+  [[nodiscard]]
+  auto valid_end() const noexcept -> std::uint64_t {
+    return valid_end_;
+  }
+
+  [[nodiscard]]
+  auto tail() const noexcept -> log_tail {
+    return tail_;
+  }
+
+  // Verifies every record and returns the offset writing can resume at.
+  auto recover() noexcept -> std::uint64_t {
+    for (auto it = begin(); it != end(); ++it) {
+    }
+    return valid_end_;
+  }
+
+ private:
+  mapped_file mapping_;
+  cbyte_view segment_;
+  std::uint64_t start_;
+  std::uint64_t valid_end_;
+  log_tail tail_{log_tail::clean};
+  log_record current_{};
+
+  auto next() noexcept -> bool {
+    auto const offset = valid_end_;
+    auto const size = segment_.size();
+    if (offset >= size) {
+      return false;
+    }
+    auto const* p = segment_.data() + offset;
+    auto const remaining = size - offset;
+    if (remaining < detail::log_header_size) {
+      tail_ = is_zero({p, remaining}) ? log_tail::clean : log_tail::truncated;
+      return false;
+    }
+    if (is_zero({p, detail::log_header_size})) {
+      return false;
+    }
+    auto const len = detail::load_le32(p);
+    if (len > remaining - detail::log_header_size) {
+      tail_ = log_tail::truncated;
+      return false;
+    }
+    auto const payload = cbyte_view{p + detail::log_header_size, len};
+    if (detail::log_record_crc(p, payload) != detail::load_le32(p + 4)) {
+      tail_ = log_tail::checksum_mismatch;
+      return false;
+    }
+    current_ = {offset, payload};
+    valid_end_ = offset + detail::log_header_size + len;
+    return true;
+  }
+
+  static auto is_zero(cbyte_view data) noexcept -> bool {
+    return std::all_of(data.begin(), data.end(),
+                       [](std::byte b) { return b == std::byte{}; });
+  }
+};
+
+}  // namespace mfile
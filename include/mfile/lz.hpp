@@ -0,0 +1,244 @@
+// mfile - A modern C++20 file handling library
+// (https://github.com/range3/mfile)
+// Licensed under MIT License
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "mfile/mfile.hpp"
+
+// A small LZ77 block codec in the style of LZ4: greedy hash-table matching,
+// byte-aligned sequences, no entropy stage. It trades ratio for speed in
+// both directions and has no dependencies.
+//
+// A block is a series of sequences:
+//
+//   token       u8: literal length (high nibble), match length - 4 (low)
+//   [lit ext]   255-terminated extension if the literal nibble is 15
+//   literals
+//   offset      u16 LE, 1..65535 bytes back      } absent in the last
+//   [match ext] as above for the match nibble    } sequence of a block
+//
+// A block can be decoded on its own; the decoder checks every length and
+// offset against the buffers it was given.
+
+namespace mfile {
+
+namespace detail {
+inline constexpr std::size_t lz_min_match = 4;
+// The last bytes of a block are always literals, and no match starts in
+// the last lz_match_limit bytes.
+inline constexpr std::size_t lz_last_literals = 5;
+inline constexpr std::size_t lz_match_limit = 12;
+inline constexpr std::size_t lz_max_offset = 65535;
+inline constexpr unsigned lz_hash_log = 14;
+
+inline auto lz_read32(const std::byte* p) noexcept -> std::uint32_t {
+  std::uint32_t v{};
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline auto lz_hash(std::uint32_t v) noexcept -> std::uint32_t {
+  return (v * 2654435761U) >> (32U - lz_hash_log);
+}
+
+// Chunk size of the over-copying fast path of the decoder.
+inline constexpr std::size_t lz_wild_copy = 16;
+
+inline void lz_put_length(std::byte*& op, std::size_t len) noexcept {
+  for (; len >= 255; len -= 255) {
+    *op++ = std::byte{255};  // NOLINT
+  }
+  *op++ = static_cast<std::byte>(len);  // NOLINT
+}
+}  // namespace detail
+
+// Largest compressed size of n input bytes.
+[[nodiscard]]
+constexpr auto lz_compress_bound(std::size_t n) noexcept -> std::size_t {
+  return n + (n / 255) + 16;
+}
+
+// Compresses blocks, reusing its match table across calls.
+class lz_compressor {
+ public:
+  lz_compressor() : table_(std::size_t{1} << detail::lz_hash_log) {}
+
+  // Compresses src into dst, which must hold lz_compress_bound(src.size())
+  // bytes. Returns the compressed size.
+  auto compress(cbyte_view src, byte_view dst) -> std::size_t {
+    using namespace detail;
+    if (dst.size() < lz_compress_bound(src.size())) {
+      throw std::invalid_argument{"lz output buffer is too small"};
+    }
+    std::fill(table_.begin(), table_.end(), 0U);
+
+    auto const* const base = src.data();
+    auto const n = src.size();
+    auto* op = dst.data();
+    std::size_t anchor = 0;
+
+    if (n > lz_match_limit) {
+      auto const match_end = n - lz_last_literals;
+      std::size_t ip = 0;
+      while (ip + lz_match_limit < n) {
+        auto const seq = lz_read32(base + ip);  // NOLINT
+        auto& slot = table_[lz_hash(seq)];
+        auto cand = static_cast<std::size_t>(slot);
+        slot = static_cast<std::uint32_t>(ip);
+        if (cand >= ip || ip - cand > lz_max_offset
+            || lz_read32(base + cand) != seq) {  // NOLINT
+          // Step faster through data that does not match
+          ip += 1 + ((ip - anchor) >> 6U);
+          continue;
+        }
+        while (ip > anchor && cand > 0 && base[ip - 1] == base[cand - 1]) {
+          --ip;
+          --cand;
+        }
+        auto len = lz_min_match;
+        while (ip + len < match_end && base[cand + len] == base[ip + len]) {
+          ++len;
+        }
+        emit(op, base + anchor, ip - anchor, ip - cand, len);  // NOLINT
+        ip += len;
+        anchor = ip;
+        if (ip + lz_match_limit < n) {
+          table_[lz_hash(lz_read32(base + ip - 2))] =  // NOLINT
+              static_cast<std::uint32_t>(ip - 2);
+        }
+      }
+    }
+    emit(op, base + anchor, n - anchor, 0, 0);  // NOLINT
+    return static_cast<std::size_t>(op - dst.data());
+  }
+
+ private:
+  std::vector<std::uint32_t> table_;
+
+  // A match length of 0 ends the block after the literals.
+  static void emit(std::byte*& op,
+                   const std::byte* literals,
+                   std::size_t literal_len,
+                   std::size_t offset,
+                   std::size_t match_len) noexcept {
+    using namespace detail;
+    auto const lit_nibble = std::min<std::size_t>(literal_len, 15);
+    auto const match_code = match_len == 0 ? 0 : match_len - lz_min_match;
+    auto const match_nibble = std::min<std::size_t>(match_code, 15);
+    *op++ = static_cast<std::byte>((lit_nibble << 4U) | match_nibble);  // NOLINT
+    if (lit_nibble == 15) {
+      lz_put_length(op, literal_len - 15);
+    }
+    std::memcpy(op, literals, literal_len);
+    op += literal_len;  // NOLINT
+    if (match_len == 0) {
+      return;
+    }
+    *op++ = static_cast<std::byte>(offset & 0xffU);  // NOLINT
+    *op++ = static_cast<std::byte>(offset >> 8U);  // NOLINT
+    if (match_nibble == 15) {
+      lz_put_length(op, match_code - 15);
+    }
+  }
+};
+
+// Decompresses one block into dst and returns the decompressed size.
+// Throws mfile_system_error(EBADMSG) if src is malformed or does not fit.
+// A block cut at a sequence boundary decodes to a prefix, so callers
+// compare the result with the size they expect.
+inline auto lz_decompress(cbyte_view src, byte_view dst) -> std::size_t {
+  constexpr auto chunk = detail::lz_wild_copy;
+  // Whether n bytes plus a chunk of slack fit between p and limit
+  auto const room = [](const std::byte* p, const std::byte* limit,
+                       std::size_t n) noexcept {
+    return static_cast<std::size_t>(limit - p) >= n + chunk;
+  };
+  auto const* ip = src.data();
+  auto const* const iend = ip + src.size();  // NOLINT
+  auto* op = dst.data();
+  auto* const oend = op + dst.size();  // NOLINT
+  auto const corrupt = [] {
+    return mfile_system_error{EBADMSG, "corrupt lz block"};
+  };
+  auto const read_length = [&](std::size_t len) {
+    auto b = std::byte{255};
+    while (b == std::byte{255}) {
+      if (ip == iend) {
+        throw corrupt();
+      }
+      b = *ip++;  // NOLINT
+      len += static_cast<std::size_t>(b);
+    }
+    return len;
+  };
+
+  while (true) {
+    if (ip == iend) {
+      throw corrupt();
+    }
+    auto const token = static_cast<unsigned>(*ip++);  // NOLINT
+    auto literal_len = static_cast<std::size_t>(token >> 4U);
+    if (literal_len == 15) {
+      literal_len = read_length(literal_len);
+    }
+    if (literal_len > static_cast<std::size_t>(iend - ip)
+        || literal_len > static_cast<std::size_t>(oend - op)) {
+      throw corrupt();
+    }
+    if (room(op, oend, literal_len) && room(ip, iend, literal_len)) {
+      for (std::size_t i = 0; i < literal_len; i += chunk) {
+        std::memcpy(op + i, ip + i, chunk);  // NOLINT
+      }
+    } else {
+      std::memcpy(op, ip, literal_len);
+    }
+    ip += literal_len;  // NOLINT
+    op += literal_len;  // NOLINT
+    if (ip == iend) {
+      break;
+    }
+
+    if (iend - ip < 2) {
+      throw corrupt();
+    }
+    auto const offset = static_cast<std::size_t>(ip[0])
+                        | (static_cast<std::size_t>(ip[1]) << 8U);  // NOLINT
+    ip += 2;  // NOLINT
+    auto match_len = static_cast<std::size_t>(token & 15U);
+    if (match_len == 15) {
+      match_len = read_length(match_len);
+    }
+    match_len += detail::lz_min_match;
+    if (offset == 0 || offset > static_cast<std::size_t>(op - dst.data())
+        || match_len > static_cast<std::size_t>(oend - op)) {
+      throw corrupt();
+    }
+    auto const* match = op - offset;  // NOLINT
+    if (offset >= match_len) {
+      std::memcpy(op, match, match_len);
+      op += match_len;  // NOLINT
+    } else if (offset >= chunk && room(op, oend, match_len)) {
+      // Each chunk reads only bytes written before it, so a match longer
+      // than its offset repeats correctly
+      for (std::size_t i = 0; i < match_len; i += chunk) {
+        std::memcpy(op + i, match + i, chunk);  // NOLINT
+      }
+      op += match_len;  // NOLINT
+    } else {
+      for (std::size_t i = 0; i < match_len; ++i) {
+        *op++ = match[i];  // NOLINT
+      }
+    }
+  }
+  return static_cast<std::size_t>(op - dst.data());
+}
+
+}  // namespace mfile
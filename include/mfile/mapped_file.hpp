@@ -0,0 +1,166 @@
+// mfile - A modern C++20 file handling library
+// (https://github.com/range3/mfile)
+// Licensed under MIT License
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#include <linux/magic.h>
+#include <sys/mman.h>
+#include <sys/vfs.h>
+#include <unistd.h>
+
+#include "mfile/huge_pages.hpp"
+#include "mfile/mfile.hpp"
+
+namespace mfile {
+
+struct map_options {
+  // PROT_WRITE with MAP_SHARED; stores reach the file.
+  bool writable = false;
+  // MAP_POPULATE: fault the whole range in up front.
+  bool populate = false;
+  // Map with huge pages (mfile/huge_pages.hpp). hugetlb applies to files
+  // on hugetlbfs; other files fall back to transparent, which aligns the
+  // mapping to huge pages and marks it MADV_HUGEPAGE.
+  huge_page_mode huge_pages = huge_page_mode::off;
+};
+
+// A file, or a range of it, mapped into memory. The mapping stays valid
+// after the file object used to create it is closed.
+class mapped_file {
+ public:
+  mapped_file() noexcept = default;
+
+  // Maps the whole file.
+  template <file_handle_like Handle, file_hooks Hooks, metadata_policy Metadata>
+  explicit mapped_file(const file<Handle, Hooks, Metadata>& f,
+                       const map_options& options = {})
+      : mapped_file{f, 0, f.size(), options} {}
+
+  // Maps [offset, offset + size); offset must be a multiple of the page
+  // size.
+  template <file_handle_like Handle, file_hooks Hooks, metadata_policy Metadata>
+  mapped_file(const file<Handle, Hooks, Metadata>& f,
+              std::uint64_t offset,
+              std::size_t size,
+              const map_options& options = {})
+      : size_{size}, mapped_{size} {
+    if (size_ == 0) {
+      return;
+    }
+    auto const fd = f.handle()->native();
+    auto const prot = PROT_READ | (options.writable ? PROT_WRITE : 0);
+    auto const flags = MAP_SHARED | (options.populate ? MAP_POPULATE : 0);
+    auto huge = options.huge_pages;
+    if (huge == huge_page_mode::hugetlb) {
+      struct statfs fs {};
+      if (::fstatfs(fd, &fs) == 0 && fs.f_type == HUGETLBFS_MAGIC) {
+        // munmap of a hugetlb mapping takes whole huge pages
+        mapped_ = detail::round_up(size_, static_cast<std::size_t>(fs.f_bsize));
+        huge_ = huge_page_mode::hugetlb;
+      } else {
+        huge = huge_page_mode::transparent;
+      }
+    }
+
+    void* p = nullptr;
+    if (huge == huge_page_mode::transparent) {
+      mapped_ = detail::round_up(
+          size_, static_cast<std::size_t>(::sysconf(_SC_PAGESIZE)));
+      p = detail::mmap_aligned(mapped_, detail::huge_page_size(), prot,
+                               MAP_SHARED, fd, static_cast<off_t>(offset));
+    } else {
+      p = ::mmap(nullptr, mapped_, prot, flags, fd,
+                 static_cast<off_t>(offset));
+    }
+    if (p == MAP_FAILED) {
+      throw mfile_system_error{errno, "mmap failed"};
+    }
+    data_ = static_cast<std::byte*>(p);
+
+    if (huge == huge_page_mode::transparent) {
+      if (::madvise(p, mapped_, MADV_HUGEPAGE) == 0) {
+        huge_ = huge_page_mode::transparent;
+      }
+      // Populated only now so that faults can map huge pages
+      if (options.populate) {
+#if defined(MADV_POPULATE_READ)
+        ::madvise(p, mapped_, MADV_POPULATE_READ);
+#else
+        ::madvise(p, mapped_, MADV_WILLNEED);
+#endif
+      }
+    }
+  }
+
+  mapped_file(const mapped_file&) = delete;
+  auto operator=(const mapped_file&) -> mapped_file& = delete;
+
+  mapped_file(mapped_file&& other) noexcept
+      : data_{std::exchange(other.data_, nullptr)},
+        size_{std::exchange(other.size_, 0)},
+        mapped_{std::exchange(other.mapped_, 0)},
+        huge_{std::exchange(other.huge_, huge_page_mode::off)} {}
+
+  auto operator=(mapped_file&& other) noexcept -> mapped_file& {
+    mapped_file{std::move(other)}.swap(*this);
+    return *this;
+  }
+
+  ~mapped_file() noexcept {
+    if (data_ != nullptr) {
+      ::munmap(data_, mapped_);
+    }
+  }
+
+  [[nodiscard]]
+  auto data() const noexcept -> std::byte* {
+    return data_;
+  }
+  [[nodiscard]]
+  auto size() const noexcept -> std::size_t {
+    return size_;
+  }
+
+  // Reads /proc/self/smaps.
+  [[nodiscard]]
+  auto huge_pages() const -> huge_page_stats {
+    return {huge_, huge_page_bytes({data_, size_})};
+  }
+
+  // madvise(2) over the whole mapping, e.g. MADV_SEQUENTIAL.
+  void advise(int advice) const {
+    if (data_ != nullptr && ::madvise(data_, mapped_, advice) == -1) {
+      throw mfile_system_error{errno, "madvise failed"};
+    }
+  }
+
+  // NOLINTNEXTLINE
+  operator byte_view() const noexcept { return {data_, size_}; }
+  // NOLINTNEXTLINE
+  operator cbyte_view() const noexcept { return {data_, size_}; }
+
+  void swap(mapped_file& other) noexcept {
+    using std::swap;
+    swap(data_, other.data_);
+    swap(size_, other.size_);
+    swap(mapped_, other.mapped_);
+    swap(huge_, other.huge_);
+  }
+
+ private:
+  std::byte* data_{};
+  std::size_t size_{};
+  std::size_t mapped_{};
+  huge_page_mode huge_{huge_page_mode::off};
+};
+
+inline void swap(mapped_file& lhs, mapped_file& rhs) noexcept {
+  lhs.swap(rhs);
+}
+
+}  // namespace mfile
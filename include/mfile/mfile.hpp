@@ -4,21 +4,32 @@
 // Licensed under MIT License
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
 #include <format>
 #include <limits>
 #include <memory>
+#include <optional>
 #include <string>
 #include <string_view>
 #include <system_error>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
 #include <byte_span/byte_span.hpp>
 #include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
+#include <unistd.h>
+
+#include "mfile/usdt.hpp"
 
 namespace mfile {
 using range3::byte_span;
@@ -30,6 +41,9 @@ enum class errc : int {
   success = 0,
   end_of_file = 1,
   insufficient_space = 2,
+  timed_out = 3,
+  operation_cancelled = 4,
+  checksum_mismatch = 5,
 };
 
 class error_category : public std::error_category {
@@ -53,6 +67,12 @@ class error_category : public std::error_category {
         return "End of file reached";
       case errc::insufficient_space:
         return "Insufficient space";
+      case errc::timed_out:
+        return "Operation timed out";
+      case errc::operation_cancelled:
+        return "Operation cancelled";
+      case errc::checksum_mismatch:
+        return "Checksum mismatch";
       default:
         return "Unknown mfile error";
     }
@@ -71,6 +91,12 @@ class error_category : public std::error_category {
         return std::errc::no_message;
       case errc::insufficient_space:
         return std::errc::no_space_on_device;
+      case errc::timed_out:
+        return std::errc::timed_out;
+      case errc::operation_cancelled:
+        return std::errc::operation_canceled;
+      case errc::checksum_mismatch:
+        return std::errc::bad_message;
       default:
         return {ev, *this};
     }
@@ -269,6 +295,11 @@ class open_flags {
     return set(O_TMPFILE);
   }
 
+  [[nodiscard]]
+  constexpr auto nonblock() noexcept -> open_flags& {
+    return set(O_NONBLOCK);
+  }
+
   [[nodiscard]]
   constexpr auto set(int flag) noexcept -> open_flags& {
     flags_ |= static_cast<std::uint32_t>(flag);
@@ -295,6 +326,273 @@ class open_flags {
   std::uint32_t flags_;
 };
 
+struct statx_timestamp {
+  std::int64_t tv_sec;
+  std::uint32_t tv_nsec;
+  std::int32_t reserved;
+};
+
+// Result of file::statx(). Mirrors the kernel's struct statx so that fields
+// newer than the C library's definition (e.g. the direct I/O alignment) are
+// available. Only fields whose STATX_* bit is set in stx_mask are valid.
+struct statx_result {
+  std::uint32_t stx_mask;
+  std::uint32_t stx_blksize;
+  std::uint64_t stx_attributes;
+  std::uint32_t stx_nlink;
+  std::uint32_t stx_uid;
+  std::uint32_t stx_gid;
+  std::uint16_t stx_mode;
+  std::uint16_t reserved0;
+  std::uint64_t stx_ino;
+  std::uint64_t stx_size;
+  std::uint64_t stx_blocks;
+  std::uint64_t stx_attributes_mask;
+  statx_timestamp stx_atime;
+  statx_timestamp stx_btime;
+  statx_timestamp stx_ctime;
+  statx_timestamp stx_mtime;
+  std::uint32_t stx_rdev_major;
+  std::uint32_t stx_rdev_minor;
+  std::uint32_t stx_dev_major;
+  std::uint32_t stx_dev_minor;
+  std::uint64_t stx_mnt_id;
+  std::uint32_t stx_dio_mem_align;
+  std::uint32_t stx_dio_offset_align;
+  std::uint64_t reserved1[12];  // NOLINT
+};
+static_assert(sizeof(statx_result) == 256);
+
+// STATX_* mask bits, including those missing from older C library headers.
+namespace statx_mask {
+inline constexpr std::uint32_t type = 0x0001U;
+inline constexpr std::uint32_t mode = 0x0002U;
+inline constexpr std::uint32_t nlink = 0x0004U;
+inline constexpr std::uint32_t uid = 0x0008U;
+inline constexpr std::uint32_t gid = 0x0010U;
+inline constexpr std::uint32_t atime = 0x0020U;
+inline constexpr std::uint32_t mtime = 0x0040U;
+inline constexpr std::uint32_t ctime = 0x0080U;
+inline constexpr std::uint32_t ino = 0x0100U;
+inline constexpr std::uint32_t size = 0x0200U;
+inline constexpr std::uint32_t blocks = 0x0400U;
+inline constexpr std::uint32_t basic_stats = 0x07ffU;
+inline constexpr std::uint32_t btime = 0x0800U;
+inline constexpr std::uint32_t mnt_id = 0x1000U;
+inline constexpr std::uint32_t dioalign = 0x2000U;
+}  // namespace statx_mask
+
+// Alignment requirements for O_DIRECT I/O on a file. Zero alignments mean the
+// file does not support direct I/O.
+struct dio_alignment {
+  static constexpr std::uint32_t fallback = 4096;
+
+  std::uint32_t memory;  // buffer address and length alignment
+  std::uint32_t offset;  // file offset alignment
+  bool reported;         // false if the kernel did not report it (fallback)
+};
+
+// Page-cache state of a file range, in pages. Only cached is known when the
+// kernel lacks cachestat(2) (before Linux 6.5) and mincore(2) on a temporary
+// mapping is used instead; detailed is false then and the rest are zero.
+struct cache_residency {
+  std::uint64_t pages;             // pages in the range, clamped to EOF
+  std::uint64_t cached;            // resident in the page cache
+  std::uint64_t dirty;             // resident and not yet written back
+  std::uint64_t writeback;         // being written back
+  std::uint64_t evicted;           // evicted from the page cache
+  std::uint64_t recently_evicted;  // evicted, but would still be cached now
+  bool detailed;
+
+  // Fraction of the range that is cached; 1 for an empty range.
+  [[nodiscard]]
+  auto ratio() const noexcept -> double {
+    return pages == 0 ? 1.0
+                      : static_cast<double>(cached) / static_cast<double>(pages);
+  }
+};
+
+namespace detail {
+// glibc's dev_t encoding; avoids the major()/minor() macros of
+// <sys/sysmacros.h> leaking into user code.
+constexpr auto dev_major(dev_t dev) noexcept -> std::uint32_t {
+  auto const d = static_cast<std::uint64_t>(dev);
+  return static_cast<std::uint32_t>(((d >> 8U) & 0xfffU)
+                                    | ((d >> 32U) & ~std::uint64_t{0xfffU}));
+}
+
+constexpr auto dev_minor(dev_t dev) noexcept -> std::uint32_t {
+  auto const d = static_cast<std::uint64_t>(dev);
+  return static_cast<std::uint32_t>((d & 0xffU)
+                                    | ((d >> 12U) & ~std::uint64_t{0xffU}));
+}
+
+// cachestat(2) ABI from <linux/mman.h>, which older headers lack. The
+// syscall number is shared by all architectures.
+struct cachestat_range {
+  std::uint64_t off;
+  std::uint64_t len;
+};
+
+struct cachestat {
+  std::uint64_t nr_cache;
+  std::uint64_t nr_dirty;
+  std::uint64_t nr_writeback;
+  std::uint64_t nr_evicted;
+  std::uint64_t nr_recently_evicted;
+};
+
+#ifdef __NR_cachestat
+inline constexpr long nr_cachestat = __NR_cachestat;
+#else
+inline constexpr long nr_cachestat = 451;
+#endif
+
+// Counts the resident pages among [first, first + count) with mincore(2),
+// mapping at most mincore_window pages at a time. Returns -1 with errno set
+// on failure, like the system calls it wraps.
+inline constexpr std::uint64_t mincore_window = 1U << 18U;
+
+inline auto mincore_pages(int fd,
+                          std::uint64_t first,
+                          std::uint64_t count,
+                          std::size_t page,
+                          std::uint64_t& cached) -> int {
+  auto vec = std::vector<unsigned char>(
+      static_cast<std::size_t>(std::min(count, mincore_window)));
+  cached = 0;
+  while (count > 0) {
+    auto const n = static_cast<std::size_t>(std::min(count, mincore_window));
+    auto const bytes = n * page;
+    auto* p = ::mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd,
+                     static_cast<off_t>(first * page));
+    if (p == MAP_FAILED) {
+      return -1;
+    }
+    auto const result = ::mincore(p, bytes, vec.data());
+    auto const saved_errno = errno;
+    ::munmap(p, bytes);
+    if (result == -1) {
+      errno = saved_errno;
+      return -1;
+    }
+    cached += static_cast<std::uint64_t>(
+        std::count_if(vec.begin(), vec.begin() + static_cast<std::ptrdiff_t>(n),
+                      [](unsigned char v) { return (v & 1U) != 0; }));
+    first += n;
+    count -= n;
+  }
+  return 0;
+}
+
+inline auto statx_from_stat(const struct stat& st) noexcept -> statx_result {
+  auto ts = [](const timespec& t) {
+    return statx_timestamp{
+        static_cast<std::int64_t>(t.tv_sec),
+        static_cast<std::uint32_t>(t.tv_nsec),
+        0,
+    };
+  };
+  auto stx = statx_result{};
+  stx.stx_mask = statx_mask::basic_stats;
+  stx.stx_blksize = static_cast<std::uint32_t>(st.st_blksize);
+  stx.stx_nlink = static_cast<std::uint32_t>(st.st_nlink);
+  stx.stx_uid = st.st_uid;
+  stx.stx_gid = st.st_gid;
+  stx.stx_mode = static_cast<std::uint16_t>(st.st_mode);
+  stx.stx_ino = st.st_ino;
+  stx.stx_size = static_cast<std::uint64_t>(st.st_size);
+  stx.stx_blocks = static_cast<std::uint64_t>(st.st_blocks);
+  stx.stx_atime = ts(st.st_atim);
+  stx.stx_ctime = ts(st.st_ctim);
+  stx.stx_mtime = ts(st.st_mtim);
+  stx.stx_rdev_major = dev_major(st.st_rdev);
+  stx.stx_rdev_minor = dev_minor(st.st_rdev);
+  stx.stx_dev_major = dev_major(st.st_dev);
+  stx.stx_dev_minor = dev_minor(st.st_dev);
+  return stx;
+}
+}  // namespace detail
+
+// Staleness policy for file::enable_metadata_cache(). Cached metadata older
+// than max_age is re-read from the kernel on the next size()/tell().
+struct metadata_cache_policy {
+  std::chrono::steady_clock::duration max_age =
+      std::chrono::steady_clock::duration::max();
+};
+
+namespace detail {
+// Size and position of a file as last observed or changed through file<>.
+// Shared by copies of a file object since they also share the kernel's file
+// offset.
+struct metadata_cache {
+  using clock = std::chrono::steady_clock;
+
+  std::atomic<std::uint64_t> size{};
+  std::atomic<std::uint64_t> position{};
+  std::atomic<clock::rep> refreshed_at{};
+  metadata_cache_policy policy;
+  bool append{};
+
+  explicit metadata_cache(metadata_cache_policy p) noexcept : policy{p} {}
+
+  [[nodiscard]]
+  auto stale() const noexcept -> bool {
+    if (policy.max_age == clock::duration::max()) {
+      return false;
+    }
+    auto const last = clock::time_point{
+        clock::duration{refreshed_at.load(std::memory_order_relaxed)}};
+    return clock::now() - last > policy.max_age;
+  }
+
+  void refreshed(std::uint64_t new_size, std::uint64_t new_position) noexcept {
+    size.store(new_size, std::memory_order_relaxed);
+    position.store(new_position, std::memory_order_relaxed);
+    refreshed_at.store(clock::now().time_since_epoch().count(),
+                       std::memory_order_relaxed);
+  }
+
+  void extend_to(std::uint64_t end) noexcept {
+    auto current = size.load(std::memory_order_relaxed);
+    while (current < end
+           && !size.compare_exchange_weak(current, end,
+                                          std::memory_order_relaxed)) {
+    }
+  }
+
+  void advanced(std::size_t bytes) noexcept {
+    position.fetch_add(bytes, std::memory_order_relaxed);
+  }
+
+  void written(std::size_t bytes) noexcept {
+    if (append) {
+      // O_APPEND writes land at the end of file regardless of the position
+      auto const end = size.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+      position.store(end, std::memory_order_relaxed);
+    } else {
+      auto const end =
+          position.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+      extend_to(end);
+    }
+  }
+};
+}  // namespace detail
+
+// Metadata policy that caches nothing: size() and tell() always ask the
+// kernel. file<Handle> with it is no larger than its handle.
+struct no_metadata_cache {};
+
+// Metadata policy for file::enable_metadata_cache(). The cache is shared by
+// copies of a file object and absent until enabled.
+struct shared_metadata_cache {
+  std::shared_ptr<detail::metadata_cache> state;
+};
+
+template <typename T>
+concept metadata_policy = std::same_as<T, no_metadata_cache>
+                          || std::same_as<T, shared_metadata_cache>;
+
 template <typename T>
 concept weak_file_handle_like = requires(T& h) {
   { h.native() } -> std::same_as<int>;
@@ -314,10 +612,58 @@ concept file_handle_like =
 template <typename T>
 concept copyable_handle = std::is_copy_constructible_v<T>;
 
-template <file_handle_like Handle>
+// Operations reported to file hooks; one per system call wrapper.
+enum class io_op : std::uint8_t {
+  read,
+  write,
+  pread,
+  pwrite,
+  seek,
+  stat,
+  truncate,
+  sync,
+  advise,
+  allocate,
+};
+
+// Hook policy that does nothing. file<Handle> skips the hook calls entirely
+// when instantiated with it, so the default configuration has no overhead.
+struct no_hooks {
+  constexpr void on_begin(io_op /*op*/,
+                          std::size_t /*bytes*/,
+                          std::uint64_t /*offset*/) const noexcept {}
+  constexpr void on_end(io_op /*op*/,
+                        std::size_t /*bytes*/,
+                        std::uint64_t /*offset*/,
+                        std::int64_t /*result*/) const noexcept {}
+};
+
+// on_begin is called right before a system call is issued and may throw to
+// inject a fault. on_end receives the result of the call: the transferred
+// byte count (or resulting offset) on success, -errno on failure. offset is
+// the file offset the call targets, or 0 when it works at the current
+// position (read, write, relative seeks).
+template <typename T>
+concept file_hooks = requires(const T& h,
+                              io_op op,
+                              std::size_t bytes,
+                              std::uint64_t offset,
+                              std::int64_t result) {
+  h.on_begin(op, bytes, offset);
+  h.on_end(op, bytes, offset, result);
+};
+
+template <file_handle_like Handle,
+          file_hooks Hooks = no_hooks,
+          metadata_policy Metadata = no_metadata_cache>
 class file {
  public:
   using handle_type = Handle;
+  using hooks_type = Hooks;
+  using metadata_type = Metadata;
+
+  static constexpr bool caches_metadata =
+      std::is_same_v<metadata_type, shared_metadata_cache>;
 
   constexpr file() noexcept = default;
   constexpr file(const file&) = delete;
@@ -336,6 +682,16 @@ class file {
   constexpr explicit file(handle_type handle) noexcept
       : handle_{std::move(handle)} {}
 
+  constexpr file(handle_type handle, hooks_type hooks) noexcept
+      : handle_{std::move(handle)}, hooks_{std::move(hooks)} {}
+
+  constexpr file(handle_type handle,
+                 hooks_type hooks,
+                 metadata_type metadata) noexcept
+      : handle_{std::move(handle)},
+        hooks_{std::move(hooks)},
+        metadata_{std::move(metadata)} {}
+
   [[nodiscard]]
   auto read(byte_view data) const -> std::size_t {
     std::size_t bytes_read{};
@@ -449,12 +805,17 @@ class file {
   auto read_once(byte_view data) const -> std::size_t {
     ssize_t result = -1;
     do {  // NOLINT
-      result = ::read(native(), data.data(), data.size());
+      result = invoke<io_op::read>(data.size(), 0, [&](int fd) {
+        return ::read(fd, data.data(), data.size());
+      });
     } while (result == -1 && errno == EINTR);
 
     if (result == -1) {
       throw mfile_system_error{errno, "read failed"};
     }
+    update_metadata([&](auto& cache) {
+      cache.advanced(static_cast<std::size_t>(result));
+    });
     return static_cast<std::size_t>(result);
   }
 
@@ -462,23 +823,141 @@ class file {
   auto write_once(cbyte_view data) const -> std::size_t {
     ssize_t result = -1;
     do {  // NOLINT
-      result = ::write(native(), data.data(), data.size());
+      result = invoke<io_op::write>(data.size(), 0, [&](int fd) {
+        return ::write(fd, data.data(), data.size());
+      });
     } while (result == -1 && errno == EINTR);
 
     if (result == -1) {
       throw mfile_system_error{errno, "write failed"};
     }
+    update_metadata([&](auto& cache) {
+      cache.written(static_cast<std::size_t>(result));
+    });
     return static_cast<std::size_t>(result);
   }
 
+  // Non-blocking I/O for O_NONBLOCK pipes, FIFOs and sockets: like
+  // read_once/write_once, but std::nullopt when the call would block
+  // (EAGAIN) instead of throwing. A read returning 0 still means EOF.
+  [[nodiscard]]
+  auto try_read_once(byte_view data) const -> std::optional<std::size_t> {
+    ssize_t result = -1;
+    do {  // NOLINT
+      result = invoke<io_op::read>(data.size(), 0, [&](int fd) {
+        return ::read(fd, data.data(), data.size());
+      });
+    } while (result == -1 && errno == EINTR);
+
+    if (result == -1) {
+      if (would_block(errno)) {
+        return std::nullopt;
+      }
+      throw mfile_system_error{errno, "read failed"};
+    }
+    update_metadata([&](auto& cache) {
+      cache.advanced(static_cast<std::size_t>(result));
+    });
+    return static_cast<std::size_t>(result);
+  }
+
+  [[nodiscard]]
+  auto try_write_once(cbyte_view data) const -> std::optional<std::size_t> {
+    ssize_t result = -1;
+    do {  // NOLINT
+      result = invoke<io_op::write>(data.size(), 0, [&](int fd) {
+        return ::write(fd, data.data(), data.size());
+      });
+    } while (result == -1 && errno == EINTR);
+
+    if (result == -1) {
+      if (would_block(errno)) {
+        return std::nullopt;
+      }
+      throw mfile_system_error{errno, "write failed"};
+    }
+    update_metadata([&](auto& cache) {
+      cache.written(static_cast<std::size_t>(result));
+    });
+    return static_cast<std::size_t>(result);
+  }
+
+  // Reads until data is full, EOF or the descriptor would block. Returns
+  // std::nullopt only if it would block before anything was read.
+  [[nodiscard]]
+  auto try_read(byte_view data) const -> std::optional<std::size_t> {
+    std::size_t bytes_read{};
+    while (bytes_read < data.size()) {
+      auto result =
+          try_read_once(data.subspan(bytes_read, data.size() - bytes_read));
+      if (!result) {
+        if (bytes_read == 0) {
+          return std::nullopt;
+        }
+        break;
+      }
+      // EOF
+      if (*result == 0) {
+        break;
+      }
+      bytes_read += *result;
+    }
+    return bytes_read;
+  }
+
+  // Writes until all of data is written or the descriptor would block.
+  // Returns std::nullopt only if it would block before anything was written.
+  [[nodiscard]]
+  auto try_write(cbyte_view data) const -> std::optional<std::size_t> {
+    std::size_t bytes_written{};
+    while (bytes_written < data.size()) {
+      auto result = try_write_once(
+          data.subspan(bytes_written, data.size() - bytes_written));
+      if (!result) {
+        if (bytes_written == 0) {
+          return std::nullopt;
+        }
+        break;
+      }
+      if (*result == 0) {
+        break;
+      }
+      bytes_written += *result;
+    }
+    return bytes_written;
+  }
+
+  // Toggles O_NONBLOCK on the open file description.
+  void set_nonblocking(bool enable) const {
+    auto const flags = ::fcntl(native(), F_GETFL);
+    if (flags == -1) {
+      throw mfile_system_error{errno, "fcntl failed"};
+    }
+    auto const updated = enable ? flags | O_NONBLOCK : flags & ~O_NONBLOCK;
+    if (updated != flags && ::fcntl(native(), F_SETFL, updated) == -1) {
+      throw mfile_system_error{errno, "fcntl failed"};
+    }
+  }
+
+  [[nodiscard]]
+  auto nonblocking() const -> bool {
+    auto const flags = ::fcntl(native(), F_GETFL);
+    if (flags == -1) {
+      throw mfile_system_error{errno, "fcntl failed"};
+    }
+    return (flags & O_NONBLOCK) != 0;
+  }
+
   // positional I/O
   // Low-level API
   [[nodiscard]]
   auto pread_once(byte_view data, std::uint64_t offset) const -> std::size_t {
     ssize_t result = -1;
     do {  // NOLINT
-      result = ::pread(native(), data.data(), data.size(),
+      result = invoke<io_op::pread>(data.size(), offset, [&](int fd) {
+        return ::pread(fd, data.data(), data.size(),
                        static_cast<off_t>(offset));
+      });
     } while (result == -1 && errno == EINTR);
 
     if (result == -1) {
@@ -491,13 +970,18 @@ class file {
   auto pwrite_once(cbyte_view data, std::uint64_t offset) const -> std::size_t {
     ssize_t result = -1;
     do {  // NOLINT
-      result = ::pwrite(native(), data.data(), data.size(),
+      result = invoke<io_op::pwrite>(data.size(), offset, [&](int fd) {
+        return ::pwrite(fd, data.data(), data.size(),
                         static_cast<off_t>(offset));
+      });
     } while (result == -1 && errno == EINTR);
 
     if (result == -1) {
       throw mfile_system_error{errno, "pwrite failed"};
     }
+    update_metadata([&](auto& cache) {
+      cache.extend_to(offset + static_cast<std::uint64_t>(result));
+    });
     return static_cast<std::size_t>(result);
   }
 
@@ -615,16 +1099,35 @@ class file {
   }
 
   auto seek(std::int64_t offset, int whence) const -> std::uint64_t {
-    auto result = ::lseek(native(), offset, whence);
+    // Hooks see the target only when it is absolute; the resulting position
+    // is the result either way
+    auto const target = whence == SEEK_SET && offset >= 0
+                            ? static_cast<std::uint64_t>(offset)
+                            : 0;
+    auto result = invoke<io_op::seek>(
+        0, target, [&](int fd) { return ::lseek(fd, offset, whence); });
     if (result == -1) {
       throw mfile_system_error{errno, "seek failed"};
     }
+    update_metadata([&](auto& cache) {
+      cache.position.store(static_cast<std::uint64_t>(result),
+                           std::memory_order_relaxed);
+    });
     return static_cast<std::uint64_t>(result);
   }
 
   [[nodiscard]]
   auto tell() const -> std::uint64_t {
-    auto result = ::lseek(native(), 0, SEEK_CUR);
+    if constexpr (caches_metadata) {
+      if (auto* cache = metadata_.state.get()) {
+        if (cache->stale()) {
+          refresh();
+        }
+        return cache->position.load(std::memory_order_relaxed);
+      }
+    }
+    auto result = invoke<io_op::seek>(
+        0, 0, [&](int fd) { return ::lseek(fd, 0, SEEK_CUR); });
     if (result == -1) {
       throw mfile_system_error{errno, "tell failed"};
     }
@@ -634,15 +1137,57 @@ class file {
   [[nodiscard]]
   auto stat() const -> struct stat {
     struct stat st {};
-    if (::fstat(native(), &st) == -1) {
+    if (invoke<io_op::stat>(0, 0, [&](int fd) { return ::fstat(fd, &st); })
+        == -1) {
       throw mfile_system_error{errno, "stat failed"};
     }
     return st;
   }
 
+  // statx(2) on the open file, asking only for the fields in mask. Falls
+  // back to fstat(2) where statx is unavailable (the basic fields only).
+  [[nodiscard]]
+  auto statx(std::uint32_t mask = statx_mask::basic_stats) const
+      -> statx_result {
+    auto stx = statx_result{};
+    auto result = invoke<io_op::stat>(0, 0, [&](int fd) {
+      return ::statx(fd, "", AT_EMPTY_PATH | AT_STATX_SYNC_AS_STAT, mask,
+                     reinterpret_cast<struct statx*>(&stx));  // NOLINT
+    });
+    if (result == -1) {
+      if (errno == ENOSYS) {
+        return detail::statx_from_stat(stat());
+      }
+      throw mfile_system_error{errno, "statx failed"};
+    }
+    if ((stx.stx_mask & statx_mask::size) != 0) {
+      update_metadata([&](auto& cache) {
+        cache.size.store(stx.stx_size, std::memory_order_relaxed);
+      });
+    }
+    return stx;
+  }
+
   [[nodiscard]]
   auto size() const -> std::uint64_t {
-    return static_cast<std::uint64_t>(stat().st_size);
+    if constexpr (caches_metadata) {
+      if (auto* cache = metadata_.state.get()) {
+        if (cache->stale()) {
+          refresh();
+        }
+        return cache->size.load(std::memory_order_relaxed);
+      }
+    }
+    return statx(statx_mask::size).stx_size;
+  }
+
+  [[nodiscard]]
+  auto dio_alignment() const -> mfile::dio_alignment {
+    auto stx = statx(statx_mask::dioalign);
+    if ((stx.stx_mask & statx_mask::dioalign) == 0) {
+      return {dio_alignment::fallback, dio_alignment::fallback, false};
+    }
+    return {stx.stx_dio_mem_align, stx.stx_dio_offset_align, true};
   }
 
   [[nodiscard]]
@@ -650,26 +1195,217 @@ class file {
     return size() == 0;
   }
 
+  // Page-cache residency of [offset, offset + len), or up to EOF when len is
+  // zero. Uses cachestat(2), falling back to mincore(2) on a temporary
+  // read-only mapping where the kernel (or a seccomp filter) refuses it; the
+  // fallback needs a readable descriptor.
+  [[nodiscard]]
+  auto cache_residency(std::uint64_t offset = 0, std::uint64_t len = 0) const
+      -> mfile::cache_residency {
+    auto const file_size = statx(statx_mask::size).stx_size;
+    auto const end = len == 0 || len > file_size - std::min(offset, file_size)
+                         ? file_size
+                         : offset + len;
+    auto res = mfile::cache_residency{};
+    if (offset >= end) {
+      return res;
+    }
+    auto const page = static_cast<std::uint64_t>(::sysconf(_SC_PAGESIZE));
+    auto const first = offset / page;
+    res.pages = ((end + page - 1) / page) - first;
+
+    auto range = detail::cachestat_range{offset, end - offset};
+    auto cs = detail::cachestat{};
+    auto result = invoke<io_op::stat>(0, offset, [&](int fd) {
+      return static_cast<int>(
+          ::syscall(detail::nr_cachestat, fd, &range, &cs, 0));  // NOLINT
+    });
+    if (result == 0) {
+      res.cached = cs.nr_cache;
+      res.dirty = cs.nr_dirty;
+      res.writeback = cs.nr_writeback;
+      res.evicted = cs.nr_evicted;
+      res.recently_evicted = cs.nr_recently_evicted;
+      res.detailed = true;
+      return res;
+    }
+    if (errno != ENOSYS && errno != EPERM && errno != EOPNOTSUPP) {
+      throw mfile_system_error{errno, "cachestat failed"};
+    }
+    result = invoke<io_op::stat>(0, offset, [&](int fd) {
+      return detail::mincore_pages(fd, first, res.pages,
+                                   static_cast<std::size_t>(page), res.cached);
+    });
+    if (result == -1) {
+      throw mfile_system_error{errno, "mincore failed"};
+    }
+    return res;
+  }
+
   void truncate(std::uint64_t size) const {
     int result = -1;
     do {  // NOLINT
-      result = ::ftruncate(native(), static_cast<off_t>(size));
+      result = invoke<io_op::truncate>(0, size, [&](int fd) {
+        return ::ftruncate(fd, static_cast<off_t>(size));
+      });
     } while (result == -1 && errno == EINTR);
 
     if (result == -1) {
       throw mfile_system_error{errno, "truncate failed"};
     }
+    update_metadata([&](auto& cache) {
+      cache.size.store(size, std::memory_order_relaxed);
+    });
   }
 
   void sync() const {
-    if (::fsync(native()) == -1) {
+    if (invoke<io_op::sync>(0, 0, [&](int fd) { return ::fsync(fd); }) == -1) {
       throw mfile_system_error{errno, "sync failed"};
     }
   }
 
+  // fdatasync(2): like sync(), but skips metadata not needed to read the
+  // data back, such as timestamps.
+  void datasync() const {
+    if (invoke<io_op::sync>(0, 0, [&](int fd) { return ::fdatasync(fd); })
+        == -1) {
+      throw mfile_system_error{errno, "datasync failed"};
+    }
+  }
+
+  // fallocate(2) mode 0: reserves blocks for [offset, offset + len),
+  // extending the file with zeros if needed.
+  void allocate(std::uint64_t offset, std::uint64_t len) const {
+    int result = -1;
+    do {  // NOLINT
+      result = invoke<io_op::allocate>(len, offset, [&](int fd) {
+        return ::fallocate(fd, 0, static_cast<off_t>(offset),
+                           static_cast<off_t>(len));
+      });
+    } while (result == -1 && errno == EINTR);
+
+    if (result == -1) {
+      throw mfile_system_error{errno, "allocate failed"};
+    }
+    update_metadata([&](auto& cache) {
+      cache.extend_to(offset + len);
+    });
+  }
+
+  // posix_fadvise(2) over [offset, offset + len), or up to EOF when len is
+  // zero, e.g. POSIX_FADV_WILLNEED or POSIX_FADV_DONTNEED.
+  void advise(int advice,
+              std::uint64_t offset = 0,
+              std::uint64_t len = 0) const {
+    auto result = invoke<io_op::advise>(len, offset, [&](int fd) {
+      auto const err = ::posix_fadvise(fd, static_cast<off_t>(offset),
+                                       static_cast<off_t>(len), advice);
+      errno = err;
+      return err == 0 ? 0 : -1;
+    });
+    if (result == -1) {
+      throw mfile_system_error{errno, "posix_fadvise failed"};
+    }
+  }
+
+  // readahead(2): reads [offset, offset + len) into the page cache without
+  // copying it out. Falls back to POSIX_FADV_WILLNEED for files readahead
+  // does not support.
+  void readahead(std::uint64_t offset, std::uint64_t len) const {
+    auto result = invoke<io_op::advise>(len, offset, [&](int fd) {
+      return ::readahead(fd, static_cast<off_t>(offset),
+                         static_cast<std::size_t>(len));
+    });
+    if (result == -1) {
+      if (errno == EINVAL) {
+        advise(POSIX_FADV_WILLNEED, offset, len);
+        return;
+      }
+      throw mfile_system_error{errno, "readahead failed"};
+    }
+  }
+
+  // Cached-metadata mode, for files with the shared_metadata_cache policy
+  // (see with_metadata_cache()): size(), empty() and tell() are answered
+  // from the size and position tracked through this object (and its copies)
+  // instead of fstat/lseek. Changes made through other descriptors or
+  // processes are only picked up by refresh() or when the policy's max_age
+  // expires.
+  void enable_metadata_cache(metadata_cache_policy policy = {})
+    requires caches_metadata
+  {
+    auto cache = std::make_shared<detail::metadata_cache>(policy);
+    auto const flags =
+        invoke<io_op::stat>(0, 0, [](int fd) { return ::fcntl(fd, F_GETFL); });
+    if (flags == -1) {
+      throw mfile_system_error{errno, "fcntl failed"};
+    }
+    cache->append = (static_cast<unsigned>(flags) & O_APPEND) != 0;
+    metadata_.state = std::move(cache);
+    refresh();
+  }
+
+  void disable_metadata_cache() noexcept
+    requires caches_metadata
+  {
+    metadata_.state.reset();
+  }
+
+  [[nodiscard]]
+  auto metadata_cached() const noexcept -> bool {
+    if constexpr (caches_metadata) {
+      return static_cast<bool>(metadata_.state);
+    } else {
+      return false;
+    }
+  }
+
+  // The same file with a metadata cache enabled, taking over the handle and
+  // hooks of this one.
+  [[nodiscard]]
+  auto with_metadata_cache(metadata_cache_policy policy = {}) && -> file<
+      handle_type,
+      hooks_type,
+      shared_metadata_cache> {
+    auto cached = file<handle_type, hooks_type, shared_metadata_cache>{
+        std::move(handle_), std::move(hooks_), {}};
+    cached.enable_metadata_cache(policy);
+    return cached;
+  }
+
+  // Re-reads the size and position from the kernel.
+  void refresh() const {
+    if constexpr (caches_metadata) {
+      if (!metadata_.state) {
+        return;
+      }
+      auto const position = invoke<io_op::seek>(
+          0, 0, [](int fd) { return ::lseek(fd, 0, SEEK_CUR); });
+      if (position == -1) {
+        throw mfile_system_error{errno, "tell failed"};
+      }
+      auto stx = statx_result{};
+      auto result = invoke<io_op::stat>(0, 0, [&](int fd) {
+        return ::statx(fd, "", AT_EMPTY_PATH | AT_STATX_SYNC_AS_STAT,
+                       statx_mask::size,
+                       reinterpret_cast<struct statx*>(&stx));  // NOLINT
+      });
+      if (result == -1) {
+        if (errno != ENOSYS) {
+          throw mfile_system_error{errno, "statx failed"};
+        }
+        stx.stx_size = static_cast<std::uint64_t>(stat().st_size);
+      }
+      metadata_.state->refreshed(stx.stx_size,
+                                 static_cast<std::uint64_t>(position));
+    }
+  }
+
   constexpr void swap(file& other) noexcept {
     using std::swap;
     swap(handle_, other.handle_);
+    swap(hooks_, other.hooks_);
+    swap(metadata_, other.metadata_);
   }
 
   [[nodiscard]]
@@ -677,22 +1413,123 @@ class file {
     return handle_;
   }
 
+  [[nodiscard]]
+  constexpr auto hooks() const noexcept -> const hooks_type& {
+    return hooks_;
+  }
+
+  [[nodiscard]]
+  constexpr auto hooks() noexcept -> hooks_type& {
+    return hooks_;
+  }
+
  private:
   handle_type handle_{};
+  [[no_unique_address]] hooks_type hooks_{};
+  [[no_unique_address]] metadata_type metadata_{};
 
   [[nodiscard]]
   constexpr auto native() const noexcept -> int {
     return handle_->native();
   }
+
+  // Applies update to the metadata cache, if there is one. Compiles to
+  // nothing with no_metadata_cache.
+  template <typename Update>
+  constexpr void update_metadata(Update&& update) const noexcept {
+    if constexpr (caches_metadata) {
+      if (auto* cache = metadata_.state.get()) {
+        std::forward<Update>(update)(*cache);
+      }
+    }
+  }
+
+  [[nodiscard]]
+  static constexpr auto would_block(int err) noexcept -> bool {
+    return err == EAGAIN;  // EWOULDBLOCK on Linux
+  }
+
+  // Brackets one system call with the hook callbacks and USDT probes. errno
+  // is preserved across on_end so that callers can still report the failure.
+  template <io_op Op, typename Call>
+  auto invoke(std::size_t bytes, std::uint64_t offset, Call&& call) const {
+    if constexpr (std::is_same_v<hooks_type, no_hooks> && !MFILE_USDT_ENABLED) {
+      return std::forward<Call>(call)(native());
+    } else {
+      probe_entry<Op>(bytes, offset);
+      hooks_.on_begin(Op, bytes, offset);
+      auto result = std::forward<Call>(call)(native());
+      auto const saved_errno = errno;
+      auto const status = result == -1 ? -static_cast<std::int64_t>(saved_errno)
+                                       : static_cast<std::int64_t>(result);
+      probe_return<Op>(bytes, offset, status);
+      hooks_.on_end(Op, bytes, offset, status);
+      errno = saved_errno;
+      return result;
+    }
+  }
+
+  template <io_op Op>
+  void probe_entry([[maybe_unused]] std::size_t bytes,
+                   [[maybe_unused]] std::uint64_t offset) const noexcept {
+#if MFILE_USDT_ENABLED
+    [[maybe_unused]] auto const fd = native();
+    if constexpr (Op == io_op::read) {
+      MFILE_USDT_PROBE3(read_once_entry, fd, offset, bytes);
+    } else if constexpr (Op == io_op::write) {
+      MFILE_USDT_PROBE3(write_once_entry, fd, offset, bytes);
+    } else if constexpr (Op == io_op::pread) {
+      MFILE_USDT_PROBE3(pread_once_entry, fd, offset, bytes);
+    } else if constexpr (Op == io_op::pwrite) {
+      MFILE_USDT_PROBE3(pwrite_once_entry, fd, offset, bytes);
+    } else if constexpr (Op == io_op::truncate) {
+      MFILE_USDT_PROBE3(truncate_entry, fd, offset, bytes);
+    } else if constexpr (Op == io_op::allocate) {
+      MFILE_USDT_PROBE3(allocate_entry, fd, offset, bytes);
+    } else if constexpr (Op == io_op::sync) {
+      MFILE_USDT_PROBE3(sync_entry, fd, offset, bytes);
+    }
+#endif
+  }
+
+  template <io_op Op, typename Result>
+  void probe_return([[maybe_unused]] std::size_t bytes,
+                    [[maybe_unused]] std::uint64_t offset,
+                    [[maybe_unused]] Result result) const noexcept {
+#if MFILE_USDT_ENABLED
+    [[maybe_unused]] auto const fd = native();
+    [[maybe_unused]] auto const res = static_cast<std::int64_t>(result);
+    if constexpr (Op == io_op::read) {
+      MFILE_USDT_PROBE4(read_once_return, fd, offset, bytes, res);
+    } else if constexpr (Op == io_op::write) {
+      MFILE_USDT_PROBE4(write_once_return, fd, offset, bytes, res);
+    } else if constexpr (Op == io_op::pread) {
+      MFILE_USDT_PROBE4(pread_once_return, fd, offset, bytes, res);
+    } else if constexpr (Op == io_op::pwrite) {
+      MFILE_USDT_PROBE4(pwrite_once_return, fd, offset, bytes, res);
+    } else if constexpr (Op == io_op::truncate) {
+      MFILE_USDT_PROBE4(truncate_return, fd, offset, bytes, res);
+    } else if constexpr (Op == io_op::allocate) {
+      MFILE_USDT_PROBE4(allocate_return, fd, offset, bytes, res);
+    } else if constexpr (Op == io_op::sync) {
+      MFILE_USDT_PROBE4(sync_return, fd, offset, bytes, res);
+    }
+#endif
+  }
 };
 
 // deduction guides
 template <file_handle_like H>
 file(H) -> file<H>;
+template <file_handle_like H, file_hooks K>
+file(H, K) -> file<H, K>;
+template <file_handle_like H, file_hooks K, metadata_policy M>
+file(H, K, M) -> file<H, K, M>;
 
 // non-member functions
-template <file_handle_like Handle>
-constexpr void swap(file<Handle>& lhs, file<Handle>& rhs) noexcept {
+template <file_handle_like Handle, file_hooks Hooks, metadata_policy Metadata>
+constexpr void swap(file<Handle, Hooks, Metadata>& lhs,
+                    file<Handle, Hooks, Metadata>& rhs) noexcept {
   lhs.swap(rhs);
 }
 
@@ -700,7 +1537,10 @@ constexpr void swap(file<Handle>& lhs, file<Handle>& rhs) noexcept {
 inline auto open(const char* path,
                  open_flags flags,
                  mode_t mode = 0666) -> file<file_handle> {
+  MFILE_USDT_PROBE3(open_entry, path, flags.flags(), mode);
   auto fd = ::open(path, flags.flags(), mode);  // NOLINT
+  MFILE_USDT_PROBE4(open_return, path, flags.flags(), mode,
+                    fd == -1 ? -errno : fd);
   if (fd == -1) {
     throw mfile_system_error{errno,
                              std::format("Failed to open file: {}", path)};
@@ -0,0 +1,341 @@
+// mfile - A modern C++20 file handling library
+// (https://github.com/range3/mfile)
+// Licensed under MIT License
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <optional>
+#include <span>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "mfile/mfile.hpp"
+
+// Page-cache warming and eviction for sets of files, vmtouch style:
+//
+//   auto reports = mfile::warm_page_cache(targets, {.threads = 8});
+//   for (auto const& r : reports) {
+//     if (!r.error) log(r.path, r.before.ratio(), r.after.ratio());
+//   }
+//
+// Files are split into chunks that worker threads pick up in turn, so one
+// large file is warmed or evicted by all threads at once. Warming uses
+// readahead(2) and reads the pages it skipped; eviction writes dirty pages
+// back and drops the range with POSIX_FADV_DONTNEED. Residency is measured
+// before and after.
+
+namespace mfile {
+
+// A file, or the part [offset, offset + len) of it; up to EOF when len is 0.
+struct cache_target {
+  std::string path;
+  std::uint64_t offset = 0;
+  std::uint64_t len = 0;
+};
+
+enum class cache_action : std::uint8_t {
+  query,
+  warm,
+  evict,
+};
+
+struct page_cache_options {
+  // Worker threads; 0 uses std::thread::hardware_concurrency().
+  unsigned threads = 0;
+  // Unit of work handed to a thread.
+  std::uint64_t chunk_size = std::uint64_t{16} << 20U;
+  // fdatasync before evicting; dirty pages cannot be dropped otherwise.
+  bool flush_before_evict = true;
+  // Files open at once. Targets are processed in waves of this many, so
+  // that large sets stay below RLIMIT_NOFILE.
+  std::size_t max_open_files = 512;
+};
+
+struct cache_report {
+  std::string path;
+  cache_residency before{};
+  cache_residency after{};  // same as before for cache_action::query
+  std::error_code error;    // the first failure on this file
+};
+
+namespace detail {
+// Runs fn(i) for every i in [0, n) on up to threads threads.
+template <typename Fn>
+void parallel_for(std::size_t n, unsigned threads, Fn&& fn) {
+  auto next = std::atomic<std::size_t>{};
+  auto work = [&] {
+    for (auto i = next.fetch_add(1, std::memory_order_relaxed); i < n;
+         i = next.fetch_add(1, std::memory_order_relaxed)) {
+      fn(i);
+    }
+  };
+  auto const count = std::min<std::size_t>(threads, n);
+  auto workers = std::vector<std::jthread>{};
+  workers.reserve(count > 0 ? count - 1 : 0);
+  for (std::size_t i = 1; i < count; ++i) {
+    workers.emplace_back(work);
+  }
+  work();
+}
+
+// The byte ranges of [offset, offset + len) that are not in the page cache,
+// in order, found with mincore(2) on a temporary mapping. A window the
+// kernel will not map or query is reported as missing whole.
+inline auto uncached_ranges(int fd, std::uint64_t offset, std::uint64_t len)
+    -> std::vector<std::pair<std::uint64_t, std::uint64_t>> {
+  auto ranges = std::vector<std::pair<std::uint64_t, std::uint64_t>>{};
+  auto add = [&](std::uint64_t begin, std::uint64_t end) {
+    begin = std::max(begin, offset);
+    end = std::min(end, offset + len);
+    if (begin >= end) {
+      return;
+    }
+    if (!ranges.empty() && ranges.back().second == begin) {
+      ranges.back().second = end;
+    } else {
+      ranges.emplace_back(begin, end);
+    }
+  };
+
+  auto const page = static_cast<std::uint64_t>(::sysconf(_SC_PAGESIZE));
+  auto first = offset / page;
+  auto count = len == 0 ? 0 : ((offset + len + page - 1) / page) - first;
+  auto vec = std::vector<unsigned char>(
+      static_cast<std::size_t>(std::min(count, mincore_window)));
+  while (count > 0) {
+    auto const n = std::min(count, mincore_window);
+    auto const bytes = static_cast<std::size_t>(n * page);
+    auto* p = ::mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd,
+                     static_cast<off_t>(first * page));
+    auto result = -1;
+    if (p != MAP_FAILED) {
+      result = ::mincore(p, bytes, vec.data());
+      ::munmap(p, bytes);
+    }
+    for (std::uint64_t i = 0; i < n; ++i) {
+      if (result == -1 || (vec[static_cast<std::size_t>(i)] & 1U) == 0) {
+        add((first + i) * page, (first + i + 1) * page);
+      }
+    }
+    first += n;
+    count -= n;
+  }
+  return ranges;
+}
+
+class page_cache_job {
+ public:
+  page_cache_job(std::span<const cache_target> targets,
+                 cache_action action,
+                 page_cache_options options)
+      : targets_{targets},
+        action_{action},
+        options_{options},
+        files_(targets.size()),
+        ranges_(targets.size()),
+        errors_(targets.size()) {
+    if (options_.threads == 0) {
+      options_.threads = std::max(1U, std::thread::hardware_concurrency());
+    }
+    options_.chunk_size = std::max<std::uint64_t>(options_.chunk_size, 1);
+    options_.max_open_files = std::max<std::size_t>(options_.max_open_files, 1);
+  }
+
+  auto run() -> std::vector<cache_report> {
+    auto reports = std::vector<cache_report>(targets_.size());
+    for (std::size_t first = 0; first < targets_.size();
+         first += options_.max_open_files) {
+      auto const count =
+          std::min(options_.max_open_files, targets_.size() - first);
+      run_wave(first, count, reports);
+    }
+    return reports;
+  }
+
+ private:
+  struct chunk {
+    std::size_t target;
+    std::uint64_t offset;
+    std::uint64_t len;
+  };
+
+  // Opens, processes and closes targets [first, first + count).
+  void run_wave(std::size_t first,
+                std::size_t count,
+                std::vector<cache_report>& reports) {
+    parallel_for(count, options_.threads, [&](std::size_t i) {
+      open(first + i, reports[first + i]);
+    });
+
+    if (action_ != cache_action::query) {
+      auto chunks = std::vector<chunk>{};
+      for (auto i = first; i < first + count; ++i) {
+        auto const [begin, end] = ranges_[i];
+        for (auto off = begin; off < end; off += options_.chunk_size) {
+          chunks.push_back({i, off, std::min(options_.chunk_size, end - off)});
+        }
+      }
+      parallel_for(chunks.size(), options_.threads,
+                   [&](std::size_t i) { apply(chunks[i]); });
+    }
+
+    parallel_for(count, options_.threads, [&](std::size_t i) {
+      finish(first + i, reports[first + i]);
+    });
+  }
+
+  std::span<const cache_target> targets_;
+  cache_action action_;
+  page_cache_options options_;
+  std::vector<std::optional<file<file_handle>>> files_;
+  // [offset, end) of each target, clamped to EOF
+  std::vector<std::pair<std::uint64_t, std::uint64_t>> ranges_;
+  std::vector<std::atomic<int>> errors_;
+
+  void fail(std::size_t i, int err) noexcept {
+    auto expected = 0;
+    errors_[i].compare_exchange_strong(expected, err,
+                                       std::memory_order_relaxed);
+  }
+
+  // Records the exception being handled against target i. Everything runs
+  // on worker threads, where nothing may escape.
+  void fail_current(std::size_t i) noexcept {
+    try {
+      throw;
+    } catch (const std::system_error& e) {
+      fail(i, e.code().value());
+    } catch (const std::bad_alloc&) {
+      fail(i, ENOMEM);
+    } catch (...) {
+      fail(i, EIO);
+    }
+  }
+
+  void open(std::size_t i, cache_report& report) {
+    auto const& t = targets_[i];
+    try {
+      report.path = t.path;
+      auto f = mfile::open(t.path.c_str(), open_flags::r());
+      auto const size = f.size();
+      auto const begin = std::min(t.offset, size);
+      auto const end =
+          t.len == 0 || t.len > size - begin ? size : begin + t.len;
+      report.before = f.cache_residency(begin, end - begin);
+      if (action_ == cache_action::evict && options_.flush_before_evict) {
+        f.datasync();
+      }
+      ranges_[i] = {begin, end};
+      files_[i].emplace(std::move(f));
+    } catch (...) {
+      fail_current(i);
+    }
+  }
+
+  void apply(const chunk& c) {
+    auto const& f = *files_[c.target];
+    try {
+      if (action_ == cache_action::warm) {
+        f.readahead(c.offset, c.len);
+        // readahead(2) stops at the device's readahead limit, so read
+        // whatever it left out
+        if (auto res = f.cache_residency(c.offset, c.len);
+            res.cached < res.pages) {
+          touch(f, c);
+        }
+      } else {
+        f.advise(POSIX_FADV_DONTNEED, c.offset, c.len);
+      }
+    } catch (...) {
+      fail_current(c.target);
+    }
+  }
+
+  // Reads the pages of c that are still not cached.
+  static void touch(const file<file_handle>& f, const chunk& c) {
+    constexpr std::uint64_t max_buffer = std::uint64_t{1} << 20U;
+    auto const missing = uncached_ranges(f.handle()->native(), c.offset, c.len);
+    auto buffer = std::vector<std::byte>{};
+    for (auto const& [begin, end] : missing) {
+      buffer.resize(std::max(
+          buffer.size(),
+          static_cast<std::size_t>(std::min(end - begin, max_buffer))));
+      for (auto off = begin; off < end;) {
+        auto const n = std::min<std::uint64_t>(buffer.size(), end - off);
+        auto const got = f.pread(
+            byte_view{buffer.data(), static_cast<std::size_t>(n)}, off);
+        if (got == 0) {
+          return;
+        }
+        off += got;
+      }
+    }
+  }
+
+  void finish(std::size_t i, cache_report& report) {
+    if (files_[i]) {
+      if (action_ == cache_action::query) {
+        report.after = report.before;
+      } else {
+        try {
+          auto const [begin, end] = ranges_[i];
+          report.after = files_[i]->cache_residency(begin, end - begin);
+        } catch (...) {
+          fail_current(i);
+        }
+      }
+      files_[i].reset();
+    }
+    if (auto const err = errors_[i].load(std::memory_order_relaxed);
+        err != 0) {
+      report.error = std::error_code{err, std::system_category()};
+    }
+  }
+};
+}  // namespace detail
+
+// Applies action to every target and reports their residency before and
+// after, in the order of targets. Failures are reported per target instead
+// of thrown.
+[[nodiscard]]
+inline auto apply_page_cache(std::span<const cache_target> targets,
+                             cache_action action,
+                             page_cache_options options = {})
+    -> std::vector<cache_report> {
+  return detail::page_cache_job{targets, action, options}.run();
+}
+
+[[nodiscard]]
+inline auto query_page_cache(std::span<const cache_target> targets,
+                             page_cache_options options = {})
+    -> std::vector<cache_report> {
+  return apply_page_cache(targets, cache_action::query, options);
+}
+
+[[nodiscard]]
+inline auto warm_page_cache(std::span<const cache_target> targets,
+                            page_cache_options options = {})
+    -> std::vector<cache_report> {
+  return apply_page_cache(targets, cache_action::warm, options);
+}
+
+[[nodiscard]]
+inline auto evict_page_cache(std::span<const cache_target> targets,
+                             page_cache_options options = {})
+    -> std::vector<cache_report> {
+  return apply_page_cache(targets, cache_action::evict, options);
+}
+
+}  // namespace mfile
@@ -0,0 +1,161 @@
+// mfile - A modern C++20 file handling library
+// (https://github.com/range3/mfile)
+// Licensed under MIT License
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <span>
+
+#include <poll.h>
+#include <sys/epoll.h>
+
+#include "mfile/mfile.hpp"
+
+// Readiness waiting for non-blocking descriptors, to pair with
+// file::try_read_once()/try_write_once():
+//
+//   auto n = f.try_read_once(buffer);
+//   while (!n) {
+//     (void)mfile::wait_ready(f, mfile::readiness::readable);
+//     n = f.try_read_once(buffer);
+//   }
+
+namespace mfile {
+
+enum class readiness : std::uint32_t {
+  readable = EPOLLIN,
+  writable = EPOLLOUT,
+  both = EPOLLIN | EPOLLOUT,
+};
+
+// Waits with poll(2) until fd is ready, or the timeout expires (a negative
+// timeout waits forever). Returns false on timeout. Hang-ups and errors
+// count as ready; the next read or write reports them.
+[[nodiscard]]
+inline auto wait_ready(int fd,
+                       readiness what,
+                       std::chrono::milliseconds timeout =
+                           std::chrono::milliseconds{-1}) -> bool {
+  auto pfd = ::pollfd{};
+  pfd.fd = fd;
+  pfd.events = static_cast<short>(  // NOLINT(google-runtime-int)
+      ((static_cast<std::uint32_t>(what) & EPOLLIN) != 0 ? POLLIN : 0)
+      | ((static_cast<std::uint32_t>(what) & EPOLLOUT) != 0 ? POLLOUT : 0));
+  auto const deadline = std::chrono::steady_clock::now() + timeout;
+  while (true) {
+    auto const result = ::poll(&pfd, 1, static_cast<int>(timeout.count()));
+    if (result == -1) {
+      if (errno != EINTR) {
+        throw mfile_system_error{errno, "poll failed"};
+      }
+      if (timeout.count() > 0) {
+        timeout = std::max(
+            std::chrono::milliseconds{},
+            std::chrono::ceil<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now()));
+      }
+      continue;
+    }
+    if (result == 0) {
+      return false;
+    }
+    if ((pfd.revents & POLLNVAL) != 0) {
+      throw mfile_system_error{EBADF, "poll failed"};
+    }
+    return true;
+  }
+}
+
+template <file_handle_like Handle, file_hooks Hooks, metadata_policy Metadata>
+[[nodiscard]]
+auto wait_ready(const file<Handle, Hooks, Metadata>& f,
+                readiness what,
+                std::chrono::milliseconds timeout =
+                    std::chrono::milliseconds{-1}) -> bool {
+  return wait_ready(f.handle()->native(), what, timeout);
+}
+
+// RAII epoll(7) instance for waiting on many descriptors at once, e.g.
+// non-blocking pipes together with io_context::completion_fd().
+class epoll_set {
+ public:
+  epoll_set() {
+    auto const fd = ::epoll_create1(EPOLL_CLOEXEC);
+    if (fd == -1) {
+      throw mfile_system_error{errno, "epoll_create1 failed"};
+    }
+    fd_.reset(fd);
+  }
+
+  // Level-triggered interest in fd; user_data is handed back by wait().
+  void add(int fd, readiness what, std::uint64_t user_data) {
+    control(EPOLL_CTL_ADD, fd, what, user_data);
+  }
+
+  void modify(int fd, readiness what, std::uint64_t user_data) {
+    control(EPOLL_CTL_MOD, fd, what, user_data);
+  }
+
+  void remove(int fd) { control(EPOLL_CTL_DEL, fd, readiness::both, 0); }
+
+  template <file_handle_like Handle, file_hooks Hooks, metadata_policy Metadata>
+  void add(const file<Handle, Hooks, Metadata>& f,
+           readiness what,
+           std::uint64_t user_data) {
+    add(f.handle()->native(), what, user_data);
+  }
+
+  template <file_handle_like Handle, file_hooks Hooks, metadata_policy Metadata>
+  void modify(const file<Handle, Hooks, Metadata>& f,
+              readiness what,
+              std::uint64_t user_data) {
+    modify(f.handle()->native(), what, user_data);
+  }
+
+  template <file_handle_like Handle, file_hooks Hooks, metadata_policy Metadata>
+  void remove(const file<Handle, Hooks, Metadata>& f) {
+    remove(f.handle()->native());
+  }
+
+  // Waits until at least one descriptor is ready or the timeout expires (a
+  // negative timeout waits forever). Returns the ready events; empty on
+  // timeout or when interrupted by a signal.
+  [[nodiscard]]
+  auto wait(std::span<::epoll_event> events,
+            std::chrono::milliseconds timeout = std::chrono::milliseconds{-1})
+      -> std::span<::epoll_event> {
+    auto const result =
+        ::epoll_wait(fd_->native(), events.data(),
+                     static_cast<int>(events.size()),
+                     static_cast<int>(timeout.count()));
+    if (result == -1) {
+      if (errno == EINTR) {
+        return {};
+      }
+      throw mfile_system_error{errno, "epoll_wait failed"};
+    }
+    return events.first(static_cast<std::size_t>(result));
+  }
+
+  [[nodiscard]]
+  auto native() const noexcept -> int {
+    return fd_->native();
+  }
+
+ private:
+  file_handle fd_;
+
+  void control(int op, int fd, readiness what, std::uint64_t user_data) {
+    auto event = ::epoll_event{};
+    event.events = static_cast<std::uint32_t>(what);
+    event.data.u64 = user_data;
+    if (::epoll_ctl(fd_->native(), op, fd, &event) == -1) {
+      throw mfile_system_error{errno, "epoll_ctl failed"};
+    }
+  }
+};
+
+}  // namespace mfile
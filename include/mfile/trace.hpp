@@ -0,0 +1,367 @@
+// mfile - A modern C++20 file handling library
+// (https://github.com/range3/mfile)
+// Licensed under MIT License
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+#include <unistd.h>
+
+#include "mfile/mfile.hpp"
+
+namespace mfile::trace {
+
+// One completed system call as seen by trace_hooks.
+struct event {
+  io_op op{};
+  std::uint32_t tid{};
+  std::uint64_t begin_ns{};
+  std::uint64_t end_ns{};
+  std::uint64_t offset{};
+  std::uint64_t bytes{};
+  std::int64_t result{};
+};
+
+[[nodiscard]]
+constexpr auto to_string(io_op op) noexcept -> std::string_view {
+  switch (op) {
+    case io_op::read:
+      return "read";
+    case io_op::write:
+      return "write";
+    case io_op::pread:
+      return "pread";
+    case io_op::pwrite:
+      return "pwrite";
+    case io_op::seek:
+      return "seek";
+    case io_op::stat:
+      return "stat";
+    case io_op::truncate:
+      return "truncate";
+    case io_op::sync:
+      return "sync";
+    case io_op::advise:
+      return "advise";
+    case io_op::allocate:
+      return "allocate";
+  }
+  return "unknown";
+}
+
+// Bounded single-producer ring buffer. The owning thread overwrites the
+// oldest events when it is full; readers on other threads take consistent
+// snapshots through a per-slot sequence number (seqlock) and never block the
+// producer.
+class ring_buffer {
+ public:
+  explicit ring_buffer(std::size_t capacity)
+      : slots_(std::max<std::size_t>(capacity, 1)) {}
+
+  void push(const event& ev) noexcept {
+    auto const head = head_.load(std::memory_order_relaxed);
+    auto& slot = slots_[head % slots_.size()];
+    slot.seq.store((2 * head) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.store(ev);
+    slot.seq.store((2 * head) + 2, std::memory_order_release);
+    head_.store(head + 1, std::memory_order_release);
+  }
+
+  // Appends the events currently held, oldest first.
+  void snapshot(std::vector<event>& out) const {
+    auto const head = head_.load(std::memory_order_acquire);
+    auto const first = head > slots_.size() ? head - slots_.size() : 0;
+    for (auto i = first; i < head; ++i) {
+      auto const& slot = slots_[i % slots_.size()];
+      auto const seq = slot.seq.load(std::memory_order_acquire);
+      if (seq != (2 * i) + 2) {
+        continue;  // overwritten or being written
+      }
+      auto ev = slot.load();
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (slot.seq.load(std::memory_order_relaxed) == seq) {
+        out.push_back(ev);
+      }
+    }
+  }
+
+  [[nodiscard]]
+  auto capacity() const noexcept -> std::size_t {
+    return slots_.size();
+  }
+
+  // Number of events pushed over the lifetime of the buffer.
+  [[nodiscard]]
+  auto total() const noexcept -> std::uint64_t {
+    return head_.load(std::memory_order_acquire);
+  }
+
+  // Number of events lost to overwriting.
+  [[nodiscard]]
+  auto dropped() const noexcept -> std::uint64_t {
+    auto const head = total();
+    return head > slots_.size() ? head - slots_.size() : 0;
+  }
+
+ private:
+  struct slot_type {
+    static constexpr std::size_t words = 6;
+
+    std::atomic<std::uint64_t> seq{0};
+    std::array<std::atomic<std::uint64_t>, words> data{};
+
+    void store(const event& ev) noexcept {
+      auto const meta = (static_cast<std::uint64_t>(ev.tid) << 8U)
+                        | static_cast<std::uint64_t>(ev.op);
+      data[0].store(meta, std::memory_order_relaxed);
+      data[1].store(ev.begin_ns, std::memory_order_relaxed);
+      data[2].store(ev.end_ns, std::memory_order_relaxed);
+      data[3].store(ev.offset, std::memory_order_relaxed);
+      data[4].store(ev.bytes, std::memory_order_relaxed);
+      data[5].store(static_cast<std::uint64_t>(ev.result),
+                    std::memory_order_relaxed);
+    }
+
+    [[nodiscard]]
+    auto load() const noexcept -> event {
+      auto const meta = data[0].load(std::memory_order_relaxed);
+      return {
+          .op = static_cast<io_op>(meta & 0xffU),
+          .tid = static_cast<std::uint32_t>(meta >> 8U),
+          .begin_ns = data[1].load(std::memory_order_relaxed),
+          .end_ns = data[2].load(std::memory_order_relaxed),
+          .offset = data[3].load(std::memory_order_relaxed),
+          .bytes = data[4].load(std::memory_order_relaxed),
+          .result =
+              static_cast<std::int64_t>(data[5].load(std::memory_order_relaxed)),
+      };
+    }
+  };
+
+  std::vector<slot_type> slots_;
+  std::atomic<std::uint64_t> head_{0};
+};
+
+// Collects events from any number of threads into per-thread ring buffers of
+// a fixed capacity. The buffer of a thread that exits keeps its events and
+// is handed to the next thread that starts recording, so memory use is
+// bounded by the largest number of threads recording at once * capacity.
+class tracer {
+ public:
+  static constexpr std::size_t default_capacity = 64 * 1024;
+
+  explicit tracer(std::size_t per_thread_capacity = default_capacity)
+      : capacity_{per_thread_capacity},
+        id_{next_id()},
+        registry_{std::make_shared<registry>()} {}
+
+  tracer(const tracer&) = delete;
+  auto operator=(const tracer&) -> tracer& = delete;
+  tracer(tracer&&) = delete;
+  auto operator=(tracer&&) -> tracer& = delete;
+  ~tracer() = default;
+
+  void record(const event& ev) { local_buffer().push(ev); }
+
+  // All events recorded so far, ordered by start time.
+  [[nodiscard]]
+  auto snapshot() const -> std::vector<event> {
+    auto events = std::vector<event>{};
+    {
+      auto lock = std::scoped_lock{registry_->mutex};
+      for (const auto& buffer : registry_->buffers) {
+        buffer->snapshot(events);
+      }
+    }
+    std::ranges::sort(events, {}, &event::begin_ns);
+    return events;
+  }
+
+  [[nodiscard]]
+  auto dropped() const -> std::uint64_t {
+    auto lock = std::scoped_lock{registry_->mutex};
+    std::uint64_t total = 0;
+    for (const auto& buffer : registry_->buffers) {
+      total += buffer->dropped();
+    }
+    return total;
+  }
+
+  // Writes the events in Chrome trace-event JSON ("X" complete events),
+  // loadable by chrome://tracing and Perfetto.
+  void write_chrome_trace(std::ostream& os) const {
+    auto const pid = ::getpid();
+    os << R"({"displayTimeUnit":"ns","traceEvents":[)";
+    auto first = true;
+    for (const auto& ev : snapshot()) {
+      if (!first) {
+        os << ',';
+      }
+      first = false;
+      os << R"({"name":")" << to_string(ev.op) << R"(","cat":"mfile","ph":"X")"
+         << R"(,"pid":)" << pid << R"(,"tid":)" << ev.tid << R"(,"ts":)";
+      write_us(os, ev.begin_ns);
+      os << R"(,"dur":)";
+      write_us(os, ev.end_ns - ev.begin_ns);
+      os << R"(,"args":{"offset":)" << ev.offset << R"(,"bytes":)" << ev.bytes
+         << R"(,"result":)" << ev.result << "}}";
+    }
+    os << "]}";
+  }
+
+  [[nodiscard]]
+  static auto now_ns() noexcept -> std::uint64_t {
+    return static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch())
+            .count());
+  }
+
+ private:
+  struct registry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ring_buffer>> buffers;
+    // Buffers of exited threads; capacity for all of them is reserved
+    std::vector<ring_buffer*> free;
+  };
+
+  struct cache_entry {
+    std::uint64_t tracer_id;
+    std::weak_ptr<registry> owner;
+    ring_buffer* buffer;
+  };
+
+  // The buffers a thread records into, returned to their tracers when the
+  // thread exits.
+  struct thread_cache {
+    std::vector<cache_entry> entries;
+
+    thread_cache() = default;
+    thread_cache(const thread_cache&) = delete;
+    thread_cache(thread_cache&&) = delete;
+    auto operator=(const thread_cache&) -> thread_cache& = delete;
+    auto operator=(thread_cache&&) -> thread_cache& = delete;
+
+    ~thread_cache() {
+      for (auto& entry : entries) {
+        if (auto owner = entry.owner.lock()) {
+          auto lock = std::scoped_lock{owner->mutex};
+          owner->free.push_back(entry.buffer);
+        }
+      }
+    }
+  };
+
+  std::size_t capacity_;
+  std::uint64_t id_;
+  std::shared_ptr<registry> registry_;
+
+  static auto next_id() noexcept -> std::uint64_t {
+    static std::atomic<std::uint64_t> counter{0};
+    return counter.fetch_add(1, std::memory_order_relaxed) + 1;
+  }
+
+  // The registry lock is only taken the first time a thread records into
+  // this tracer; afterwards the buffer is found through a thread-local cache.
+  // Entries of destroyed tracers are dropped then too.
+  auto local_buffer() -> ring_buffer& {
+    thread_local thread_cache cache;
+    for (auto const& entry : cache.entries) {
+      if (entry.tracer_id == id_) {
+        return *entry.buffer;
+      }
+    }
+    std::erase_if(cache.entries,
+                  [](const cache_entry& e) { return e.owner.expired(); });
+    cache.entries.reserve(cache.entries.size() + 1);
+    auto& reg = *registry_;
+    auto lock = std::scoped_lock{reg.mutex};
+    ring_buffer* buffer = nullptr;
+    if (!reg.free.empty()) {
+      buffer = reg.free.back();
+      reg.free.pop_back();
+    } else {
+      reg.free.reserve(reg.buffers.size() + 1);
+      auto& added =
+          reg.buffers.emplace_back(std::make_unique<ring_buffer>(capacity_));
+      buffer = added.get();
+    }
+    cache.entries.push_back({id_, registry_, buffer});
+    return *buffer;
+  }
+
+  static void write_us(std::ostream& os, std::uint64_t ns) {
+    constexpr std::uint64_t ns_per_us = 1000;
+    auto const frac = ns % ns_per_us;
+    os << ns / ns_per_us << '.';
+    if (frac < 100) {
+      os << '0';
+    }
+    if (frac < 10) {
+      os << '0';
+    }
+    os << frac;
+  }
+};
+
+// Hook policy for file<Handle, Hooks> that records every system call into a
+// tracer. A null tracer disables recording.
+class trace_hooks {
+ public:
+  constexpr trace_hooks() noexcept = default;
+  constexpr explicit trace_hooks(tracer* t) noexcept : tracer_{t} {}
+
+  void on_begin(io_op /*op*/,
+                std::size_t /*bytes*/,
+                std::uint64_t /*offset*/) const noexcept {
+    if (tracer_ != nullptr) {
+      begin_ns() = tracer::now_ns();
+    }
+  }
+
+  void on_end(io_op op,
+              std::size_t bytes,
+              std::uint64_t offset,
+              std::int64_t result) const {
+    if (tracer_ == nullptr) {
+      return;
+    }
+    tracer_->record({
+        .op = op,
+        .tid = thread_id(),
+        .begin_ns = begin_ns(),
+        .end_ns = tracer::now_ns(),
+        .offset = offset,
+        .bytes = bytes,
+        .result = result,
+    });
+  }
+
+ private:
+  tracer* tracer_{};
+
+  // A thread issues one system call at a time, so the start timestamp can be
+  // kept per thread rather than per call.
+  static auto begin_ns() noexcept -> std::uint64_t& {
+    thread_local std::uint64_t ns{};
+    return ns;
+  }
+
+  static auto thread_id() noexcept -> std::uint32_t {
+    thread_local auto const tid = static_cast<std::uint32_t>(::gettid());
+    return tid;
+  }
+};
+
+}  // namespace mfile::trace
@@ -0,0 +1,430 @@
+// mfile - A modern C++20 file handling library
+// (https://github.com/range3/mfile)
+// Licensed under MIT License
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "mfile/crc32c.hpp"
+#include "mfile/endian.hpp"
+#include "mfile/lz.hpp"
+#include "mfile/mfile.hpp"
+
+// Transformed block files: data is cut into fixed-size blocks, each passed
+// through a transform (e.g. compression) on write and back on read:
+//
+//   auto writer = mfile::transformed_writer{f, mfile::lz_transform{}};
+//   writer.write(data);
+//   writer.finish();
+//
+//   auto reader = mfile::transformed_reader{f, mfile::lz_transform{}};
+//   reader.pread(out, offset);  // decodes only the blocks covering out
+//
+// The file is self-describing:
+//
+//   header  "MFTB" | version u8 | transform u8 | 0 u16 | block size u32 LE
+//           | crc32c of the preceding 12 bytes
+//   blocks  stored size u32 | raw size u32 | encoded u8 | 0 u8[3]
+//           | crc32c of the stored bytes | stored bytes
+//   index   file offset u64 LE of every block
+//   footer  index offset u64 | raw size u64 | block count u32
+//           | crc32c of the index and the preceding 20 bytes | "MFTI"
+//
+// A block whose transform does not shrink it is stored as is (encoded 0).
+// Every block but the last holds exactly block size raw bytes, so the
+// block for a raw offset is found without a search.
+
+namespace mfile {
+
+// encode() writes at most encode_bound(in.size()) bytes and returns the
+// encoded size; decode() returns the decoded size and throws on malformed
+// input. id identifies the transform in the file header.
+template <typename T>
+concept block_transform = requires(T& t,
+                                   cbyte_view in,
+                                   byte_view out,
+                                   std::size_t n) {
+  { T::id } -> std::convertible_to<std::uint8_t>;
+  { t.encode_bound(n) } -> std::same_as<std::size_t>;
+  { t.encode(in, out) } -> std::same_as<std::size_t>;
+  { t.decode(in, out) } -> std::same_as<std::size_t>;
+};
+
+struct identity_transform {
+  static constexpr std::uint8_t id = 0;
+
+  [[nodiscard]]
+  static auto encode_bound(std::size_t n) noexcept -> std::size_t {
+    return n;
+  }
+  static auto encode(cbyte_view in, byte_view out) noexcept -> std::size_t {
+    std::memcpy(out.data(), in.data(), in.size());
+    return in.size();
+  }
+  static auto decode(cbyte_view in, byte_view out) -> std::size_t {
+    if (in.size() > out.size()) {
+      throw mfile_system_error{EBADMSG, "corrupt block"};
+    }
+    std::memcpy(out.data(), in.data(), in.size());
+    return in.size();
+  }
+};
+
+// The in-tree LZ codec (mfile/lz.hpp).
+class lz_transform {
+ public:
+  static constexpr std::uint8_t id = 1;
+
+  [[nodiscard]]
+  static auto encode_bound(std::size_t n) noexcept -> std::size_t {
+    return lz_compress_bound(n);
+  }
+  auto encode(cbyte_view in, byte_view out) -> std::size_t {
+    return compressor_.compress(in, out);
+  }
+  static auto decode(cbyte_view in, byte_view out) -> std::size_t {
+    return lz_decompress(in, out);
+  }
+
+ private:
+  lz_compressor compressor_;
+};
+
+namespace detail {
+inline constexpr std::array<char, 4> tb_magic = {'M', 'F', 'T', 'B'};
+inline constexpr std::array<char, 4> tb_index_magic = {'M', 'F', 'T', 'I'};
+inline constexpr std::uint8_t tb_version = 2;
+inline constexpr std::size_t tb_header_size = 16;
+inline constexpr std::size_t tb_block_header_size = 16;
+inline constexpr std::size_t tb_footer_size = 28;
+
+inline auto tb_corrupt(const char* what) -> mfile_system_error {
+  return mfile_system_error{EBADMSG, what};
+}
+
+// Checked before the writer allocates its block buffers
+inline auto tb_checked_block_size(std::size_t block_size) -> std::size_t {
+  if (block_size == 0
+      || block_size > std::numeric_limits<std::uint32_t>::max()) {
+    throw std::invalid_argument{"invalid block size"};
+  }
+  return block_size;
+}
+}  // namespace detail
+
+inline constexpr std::size_t default_transform_block_size = std::size_t{64}
+                                                            << 10U;
+
+// Writes a transformed block file from offset 0 of f, which must outlive
+// the writer. finish() writes the index; the destructor calls it if needed,
+// ignoring errors.
+template <typename File, block_transform Transform>
+class transformed_writer {
+ public:
+  explicit transformed_writer(
+      const File& f,
+      Transform transform = {},
+      std::size_t block_size = default_transform_block_size)
+      : file_{&f},
+        transform_{std::move(transform)},
+        block_size_{detail::tb_checked_block_size(block_size)},
+        raw_(block_size_),
+        stored_(detail::tb_block_header_size
+                + transform_.encode_bound(block_size_)) {
+    auto header = std::array<std::byte, detail::tb_header_size>{};
+    std::memcpy(header.data(), detail::tb_magic.data(), 4);
+    header[4] = std::byte{detail::tb_version};
+    header[5] = std::byte{Transform::id};
+    detail::store_le32(header.data() + 8,
+                       static_cast<std::uint32_t>(block_size));
+    detail::store_le32(header.data() + 12, crc32c({header.data(), 12}));
+    file_->pwrite_exact(header, 0);
+    offset_ = header.size();
+  }
+
+  transformed_writer(const transformed_writer&) = delete;
+  transformed_writer(transformed_writer&&) = delete;
+  auto operator=(const transformed_writer&) -> transformed_writer& = delete;
+  auto operator=(transformed_writer&&) -> transformed_writer& = delete;
+
+  ~transformed_writer() noexcept {
+    if (!finished_) {
+      try {
+        finish();
+      } catch (...) {  // NOLINT(bugprone-empty-catch)
+      }
+    }
+  }
+
+  void write(cbyte_view data) {
+    while (!data.empty()) {
+      auto const n = std::min(data.size(), block_size_ - used_);
+      std::memcpy(raw_.data() + used_, data.data(), n);
+      used_ += n;
+      data = data.subspan(n);
+      if (used_ == block_size_) {
+        write_block();
+      }
+    }
+  }
+
+  // Writes the last partial block, the index and the footer.
+  void finish() {
+    finished_ = true;
+    if (used_ != 0) {
+      write_block();
+    }
+    auto index = std::vector<std::byte>(
+        (index_.size() * 8) + detail::tb_footer_size);
+    for (std::size_t i = 0; i < index_.size(); ++i) {
+      detail::store_le64(index.data() + (i * 8), index_[i]);
+    }
+    auto* footer = index.data() + (index_.size() * 8);
+    detail::store_le64(footer, offset_);
+    detail::store_le64(footer + 8, raw_size_);  // NOLINT
+    detail::store_le32(footer + 16,  // NOLINT
+                       static_cast<std::uint32_t>(index_.size()));
+    detail::store_le32(footer + 20,  // NOLINT
+                       crc32c({index.data(), index.size() - 8}));
+    std::memcpy(footer + 24, detail::tb_index_magic.data(), 4);  // NOLINT
+    file_->pwrite_exact(index, offset_);
+    offset_ += index.size();
+  }
+
+  // Bytes passed to write() so far.
+  [[nodiscard]]
+  auto raw_size() const noexcept -> std::uint64_t {
+    return raw_size_ + used_;
+  }
+
+  // Bytes written to the file so far.
+  [[nodiscard]]
+  auto stored_size() const noexcept -> std::uint64_t {
+    return offset_;
+  }
+
+ private:
+  const File* file_;
+  Transform transform_;
+  std::size_t block_size_;
+  std::vector<std::byte> raw_;
+  std::vector<std::byte> stored_;
+  std::size_t used_{};
+  std::uint64_t offset_{};
+  std::uint64_t raw_size_{};
+  std::vector<std::uint64_t> index_;
+  bool finished_{};
+
+  void write_block() {
+    auto const raw = cbyte_view{raw_.data(), used_};
+    auto* header = stored_.data();
+    auto payload = byte_view{stored_}.subspan(detail::tb_block_header_size);
+    auto size = transform_.encode(raw, payload);
+    auto encoded = std::byte{1};
+    if (size >= raw.size()) {
+      std::memcpy(payload.data(), raw.data(), raw.size());
+      size = raw.size();
+      encoded = std::byte{0};
+    }
+    std::memset(header, 0, detail::tb_block_header_size);
+    detail::store_le32(header, static_cast<std::uint32_t>(size));
+    detail::store_le32(header + 4,  // NOLINT
+                       static_cast<std::uint32_t>(raw.size()));
+    header[8] = encoded;  // NOLINT
+    detail::store_le32(header + 12, crc32c(payload.first(size)));  // NOLINT
+    auto const total = detail::tb_block_header_size + size;
+    file_->pwrite_exact(cbyte_view{stored_.data(), total}, offset_);
+    index_.push_back(offset_);
+    offset_ += total;
+    raw_size_ += raw.size();
+    used_ = 0;
+  }
+};
+
+// Reads a transformed block file, sequentially or at any raw offset. f must
+// outlive the reader. The most recently decoded block is cached.
+template <typename File, block_transform Transform>
+class transformed_reader {
+ public:
+  explicit transformed_reader(const File& f, Transform transform = {})
+      : file_{&f}, transform_{std::move(transform)} {
+    auto header = std::array<std::byte, detail::tb_header_size>{};
+    f.pread_exact(header, 0);
+    if (std::memcmp(header.data(), detail::tb_magic.data(), 4) != 0
+        || header[4] != std::byte{detail::tb_version}
+        || detail::load_le32(header.data() + 12)
+               != crc32c({header.data(), 12})) {
+      throw detail::tb_corrupt("not a transformed block file");
+    }
+    if (header[5] != std::byte{Transform::id}) {
+      throw mfile_system_error{EINVAL, "file uses a different transform"};
+    }
+    block_size_ = detail::load_le32(header.data() + 8);
+    if (block_size_ == 0) {
+      throw detail::tb_corrupt("invalid block size");
+    }
+
+    auto const file_size = f.size();
+    if (file_size < detail::tb_header_size + detail::tb_footer_size) {
+      throw detail::tb_corrupt("truncated transformed block file");
+    }
+    auto footer = std::array<std::byte, detail::tb_footer_size>{};
+    f.pread_exact(footer, file_size - footer.size());
+    if (std::memcmp(footer.data() + 24, detail::tb_index_magic.data(), 4)
+        != 0) {
+      throw detail::tb_corrupt("missing block index");
+    }
+    auto const index_offset = detail::load_le64(footer.data());
+    raw_size_ = detail::load_le64(footer.data() + 8);
+    auto const count = detail::load_le32(footer.data() + 16);
+    auto const index_size = std::uint64_t{count} * 8;
+    auto const blocks =
+        (raw_size_ / block_size_) + (raw_size_ % block_size_ != 0 ? 1 : 0);
+    if (index_size > file_size - footer.size() - detail::tb_header_size
+        || index_offset != file_size - footer.size() - index_size
+        || count != blocks) {
+      throw detail::tb_corrupt("corrupt block index");
+    }
+    auto index = std::vector<std::byte>(static_cast<std::size_t>(index_size));
+    f.pread_exact(index, index_offset);
+    auto const crc =
+        crc32c(cbyte_view{footer}.first(20), crc32c(cbyte_view{index}));
+    if (crc != detail::load_le32(footer.data() + 20)) {
+      throw detail::tb_corrupt("block index checksum mismatch");
+    }
+    // Blocks follow the header in order, each at least a block header long,
+    // and end where the index starts
+    index_.resize(count + std::size_t{1});
+    index_[count] = index_offset;
+    auto previous = std::uint64_t{detail::tb_header_size};
+    for (std::size_t i = 0; i < count; ++i) {
+      index_[i] = detail::load_le64(index.data() + (i * 8));
+      if (index_[i] < previous
+          || index_[i] > index_offset - detail::tb_block_header_size) {
+        throw detail::tb_corrupt("corrupt block index");
+      }
+      previous = index_[i] + detail::tb_block_header_size;
+    }
+    block_.resize(block_size_);
+  }
+
+  // Total number of raw bytes.
+  [[nodiscard]]
+  auto size() const noexcept -> std::uint64_t {
+    return raw_size_;
+  }
+
+  [[nodiscard]]
+  auto block_size() const noexcept -> std::size_t {
+    return block_size_;
+  }
+
+  [[nodiscard]]
+  auto block_count() const noexcept -> std::size_t {
+    return index_.size() - 1;
+  }
+
+  // Reads raw bytes at offset until data is full or the end.
+  [[nodiscard]]
+  auto pread(byte_view data, std::uint64_t offset) -> std::size_t {
+    std::size_t done = 0;
+    while (done < data.size() && offset + done < raw_size_) {
+      auto const pos = offset + done;
+      auto const block = load(static_cast<std::size_t>(pos / block_size_));
+      auto const in_block = static_cast<std::size_t>(pos % block_size_);
+      if (in_block >= block.size()) {
+        throw detail::tb_corrupt("short block");
+      }
+      auto const n = std::min(block.size() - in_block, data.size() - done);
+      std::memcpy(data.data() + done, block.data() + in_block, n);
+      done += n;
+    }
+    return done;
+  }
+
+  void pread_exact(byte_view data, std::uint64_t offset) {
+    auto const n = pread(data, offset);
+    if (n != data.size()) {
+      throw end_of_file_error{n, "Failed to read exact amount of bytes"};
+    }
+  }
+
+  // Sequential reads from the position left by the previous read().
+  [[nodiscard]]
+  auto read(byte_view data) -> std::size_t {
+    auto const n = pread(data, position_);
+    position_ += n;
+    return n;
+  }
+
+  void seek(std::uint64_t position) noexcept { position_ = position; }
+
+  [[nodiscard]]
+  auto tell() const noexcept -> std::uint64_t {
+    return position_;
+  }
+
+ private:
+  static constexpr auto no_block = std::numeric_limits<std::size_t>::max();
+
+  const File* file_;
+  Transform transform_;
+  std::size_t block_size_{};
+  std::uint64_t raw_size_{};
+  // File offset of every block, then of the index
+  std::vector<std::uint64_t> index_;
+  std::vector<std::byte> stored_;
+  std::vector<std::byte> block_;
+  std::size_t block_len_{};
+  std::size_t cached_{no_block};
+  std::uint64_t position_{};
+
+  // Decodes block i into block_ unless it is already there.
+  auto load(std::size_t i) -> cbyte_view {
+    if (i == cached_) {
+      return {block_.data(), block_len_};
+    }
+    if (i >= block_count()) {
+      throw detail::tb_corrupt("block index out of range");
+    }
+    auto const extent = index_[i + 1] - index_[i];
+    if (extent < detail::tb_block_header_size) {
+      throw detail::tb_corrupt("corrupt block index");
+    }
+    stored_.resize(static_cast<std::size_t>(extent));
+    file_->pread_exact(stored_, index_[i]);
+    auto const* header = stored_.data();
+    auto const size = detail::load_le32(header);
+    auto const raw = detail::load_le32(header + 4);  // NOLINT
+    auto const payload =
+        cbyte_view{stored_}.subspan(detail::tb_block_header_size);
+    if (size != payload.size() || raw > block_size_
+        || detail::load_le32(header + 12) != crc32c(payload)) {  // NOLINT
+      throw mfile_error{make_error_code(errc::checksum_mismatch),
+                        "block checksum mismatch"};
+    }
+    cached_ = no_block;
+    auto const decoded = header[8] == std::byte{0}  // NOLINT
+                             ? identity_transform::decode(payload, block_)
+                             : transform_.decode(payload, block_);
+    if (decoded != raw) {
+      throw detail::tb_corrupt("block decodes to the wrong size");
+    }
+    block_len_ = decoded;
+    cached_ = i;
+    return {block_.data(), block_len_};
+  }
+};
+
+}  // namespace mfile
@@ -0,0 +1,425 @@
+// mfile - A modern C++20 file handling library
+// (https://github.com/range3/mfile)
+// Licensed under MIT License
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "mfile/directory.hpp"
+#include "mfile/mfile.hpp"
+
+// Parallel recursive directory traversal:
+//
+//   std::atomic<std::uint64_t> total{};
+//   auto result = mfile::walk_tree("/data", [&](const mfile::walk_entry& e) {
+//     if (e.name == ".git") return mfile::walk_action::prune;
+//     if (e.stx) total += e.stx->stx_size;  // nullptr when statx failed
+//     return mfile::walk_action::descend;
+//   }, {.statx_mask = mfile::statx_mask::size});
+//
+// Directories are distributed over worker threads through per-thread
+// queues; an idle thread steals from the others. Every thread lists with
+// its own getdents64 buffer, and subdirectories are opened relative to
+// their parent, so each open walks a single path component. Symbolic
+// links are reported but never followed.
+
+namespace mfile {
+
+enum class walk_action : std::uint8_t {
+  descend,  // visit the directory's contents (ignored for non-directories)
+  prune,    // skip them
+};
+
+struct walk_entry {
+  // Relative to the root, e.g. "a/b/c"; valid only during the callback.
+  std::string_view path;
+  std::string_view name;
+  std::uint64_t ino;
+  entry_type type;
+  // 0 for entries directly in the root.
+  std::uint32_t depth;
+  // The fields of walk_options::statx_mask; nullptr if no mask was given or
+  // statx failed (the failure is reported in walk_result::errors).
+  const statx_result* stx;
+};
+
+struct walk_options {
+  // Worker threads; 0 uses std::thread::hardware_concurrency().
+  unsigned threads = 0;
+  // statx fields to retrieve for every entry, or 0 for none.
+  std::uint32_t statx_mask = 0;
+  // Directories deeper than this are not entered.
+  std::uint32_t max_depth = std::numeric_limits<std::uint32_t>::max();
+  // getdents64 buffer of each thread.
+  std::size_t buffer_size = dir_entries::default_buffer_size;
+  // Entries per call of the walk_tree_batched() consumer.
+  std::size_t batch_size = 1024;
+};
+
+struct walk_error {
+  std::string path;
+  std::error_code code;
+};
+
+struct walk_result {
+  std::uint64_t entries{};
+  std::uint64_t directories{};
+  // Directories that could not be listed and entries that could not be
+  // stat'ed. They do not stop the walk.
+  std::vector<walk_error> errors;
+};
+
+// An owning copy of a walk_entry, as delivered by walk_tree_batched().
+struct walk_record {
+  std::string path;
+  std::uint64_t ino{};
+  entry_type type{};
+  std::uint32_t depth{};
+  bool has_stx{};
+  statx_result stx{};
+
+  [[nodiscard]]
+  auto name() const noexcept -> std::string_view {
+    auto const slash = path.rfind('/');
+    return std::string_view{path}.substr(
+        slash == std::string::npos ? 0 : slash + 1);
+  }
+};
+
+namespace detail {
+
+// Visit is called as visit(worker_index, const walk_entry&) and returns a
+// walk_action.
+template <typename Visit>
+class tree_walk {
+ public:
+  tree_walk(const char* root, const walk_options& options, Visit& visit)
+      : options_{options},
+        visit_{&visit},
+        root_{std::make_shared<const directory>(open_directory(root))} {
+    if (options_.threads == 0) {
+      options_.threads = std::max(1U, std::thread::hardware_concurrency());
+    }
+    queues_ = std::make_unique<worker_queue[]>(options_.threads);  // NOLINT
+  }
+
+  [[nodiscard]]
+  auto threads() const noexcept -> unsigned {
+    return options_.threads;
+  }
+
+  auto run() -> walk_result {
+    push(0, task{});
+    {
+      auto workers = std::vector<std::jthread>{};
+      workers.reserve(options_.threads - 1);
+      for (unsigned i = 1; i < options_.threads; ++i) {
+        workers.emplace_back([this, i] { work(i); });
+      }
+      work(0);
+    }
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+    result_.entries = entries_.load(std::memory_order_relaxed);
+    result_.directories = directories_.load(std::memory_order_relaxed);
+    return std::move(result_);
+  }
+
+ private:
+  struct task {
+    // nullptr for the root itself
+    std::shared_ptr<const directory> parent;
+    std::string path;
+    std::uint32_t depth{};
+  };
+
+  struct alignas(64) worker_queue {
+    std::mutex mutex;
+    std::deque<task> tasks;
+  };
+
+  walk_options options_;
+  Visit* visit_;
+  std::shared_ptr<const directory> root_;
+  std::unique_ptr<worker_queue[]> queues_;  // NOLINT(*-avoid-c-arrays)
+
+  // Directories queued or being listed; the walk ends when it drops to 0
+  std::atomic<std::size_t> pending_{};
+  std::atomic<std::size_t> queued_{};
+  std::atomic<unsigned> sleeping_{};
+  std::atomic<bool> stop_{};
+  std::mutex idle_mutex_;
+  std::condition_variable idle_;
+
+  std::atomic<std::uint64_t> entries_{};
+  std::atomic<std::uint64_t> directories_{};
+  std::mutex result_mutex_;
+  walk_result result_;
+  std::exception_ptr error_;
+
+  void push(unsigned worker, task t) {
+    pending_.fetch_add(1);
+    {
+      auto const lock = std::scoped_lock{queues_[worker].mutex};
+      queues_[worker].tasks.push_back(std::move(t));
+    }
+    queued_.fetch_add(1);
+    if (sleeping_.load() > 0) {
+      { auto const lock = std::scoped_lock{idle_mutex_}; }
+      idle_.notify_one();
+    }
+  }
+
+  // Own queue LIFO for locality, others FIFO so that thieves take the
+  // largest remaining subtrees.
+  auto pop(unsigned worker) -> std::optional<task> {
+    for (unsigned i = 0; i < options_.threads; ++i) {
+      auto& queue = queues_[(worker + i) % options_.threads];
+      auto const lock = std::scoped_lock{queue.mutex};
+      if (queue.tasks.empty()) {
+        continue;
+      }
+      auto t = std::optional<task>{};
+      if (i == 0) {
+        t.emplace(std::move(queue.tasks.back()));
+        queue.tasks.pop_back();
+      } else {
+        t.emplace(std::move(queue.tasks.front()));
+        queue.tasks.pop_front();
+      }
+      queued_.fetch_sub(1);
+      return t;
+    }
+    return std::nullopt;
+  }
+
+  void work(unsigned worker) {
+    auto buffer = std::make_unique_for_overwrite<std::byte[]>(  // NOLINT
+        options_.buffer_size);
+    auto path = std::string{};
+    while (true) {
+      auto t = pop(worker);
+      if (!t) {
+        auto lock = std::unique_lock{idle_mutex_};
+        sleeping_.fetch_add(1);
+        idle_.wait(lock, [this] {
+          return queued_.load() > 0 || pending_.load() == 0 || stop_.load();
+        });
+        sleeping_.fetch_sub(1);
+        if (pending_.load() == 0 || stop_.load()) {
+          return;
+        }
+        continue;
+      }
+      if (!stop_.load(std::memory_order_relaxed)) {
+        try {
+          list(worker, *t, byte_view{buffer.get(), options_.buffer_size},
+               path);
+        } catch (...) {
+          auto const lock = std::scoped_lock{result_mutex_};
+          if (!error_) {
+            error_ = std::current_exception();
+          }
+          stop_.store(true);
+        }
+      }
+      if (pending_.fetch_sub(1) == 1 || stop_.load()) {
+        { auto const lock = std::scoped_lock{idle_mutex_}; }
+        idle_.notify_all();
+      }
+    }
+  }
+
+  void report(std::string_view path, int err) {
+    auto const lock = std::scoped_lock{result_mutex_};
+    result_.errors.push_back(
+        {std::string{path}, std::error_code{err, std::system_category()}});
+  }
+
+  void list(unsigned worker, const task& t, byte_view buffer,
+            std::string& path) {
+    auto dir = root_;
+    if (t.parent) {
+      auto const slash = t.path.rfind('/');
+      auto const name = slash == std::string::npos
+                            ? t.path
+                            : t.path.substr(slash + 1);
+      auto fd = ::openat(t.parent->native(), name.c_str(),  // NOLINT
+                         directory::default_flags | O_NOFOLLOW);
+      if (fd == -1) {
+        report(t.path, errno);
+        return;
+      }
+      dir = std::make_shared<const directory>(
+          file_handle{weak_file_handle{fd}});
+    }
+    directories_.fetch_add(1, std::memory_order_relaxed);
+
+    auto entries = dir_entries{dir->native(), buffer};
+    auto it = dir_entries::iterator{};
+    // A listing error ends this directory only
+    auto const step = [&](auto&& advance) {
+      try {
+        advance();
+        return it != entries.end();
+      } catch (const mfile_system_error& e) {
+        report(t.path, e.code().value());
+        return false;
+      }
+    };
+    auto const child_depth = t.parent ? t.depth + 1 : 0;
+    for (auto more = step([&] { it = entries.begin(); }); more;
+         more = step([&] { ++it; })) {
+      if (stop_.load(std::memory_order_relaxed)) {
+        return;
+      }
+      auto const& e = *it;
+      path.assign(t.path);
+      if (!path.empty()) {
+        path.push_back('/');
+      }
+      path.append(e.name);
+
+      auto type = e.type;
+      auto stx = statx_result{};
+      auto has_stx = false;
+      auto mask = options_.statx_mask;
+      if (type == entry_type::unknown) {
+        mask |= statx_mask::type;
+      }
+      if (mask != 0) {
+        auto const name = std::string{e.name};
+        if (::statx(dir->native(), name.c_str(),
+                    AT_SYMLINK_NOFOLLOW | AT_STATX_SYNC_AS_STAT, mask,
+                    reinterpret_cast<struct statx*>(&stx))  // NOLINT
+            == -1) {
+          report(path, errno);
+        } else {
+          has_stx = true;
+          if (type == entry_type::unknown) {
+            type = static_cast<entry_type>(IFTODT(stx.stx_mode));
+          }
+        }
+      }
+
+      entries_.fetch_add(1, std::memory_order_relaxed);
+      auto const entry = walk_entry{
+          .path = path,
+          .name = e.name,
+          .ino = e.ino,
+          .type = type,
+          .depth = child_depth,
+          .stx = has_stx && options_.statx_mask != 0 ? &stx : nullptr,
+      };
+      auto const action = (*visit_)(worker, entry);
+      if (type == entry_type::directory && action == walk_action::descend
+          && child_depth < options_.max_depth) {
+        push(worker, task{dir, path, child_depth});
+      }
+    }
+  }
+};
+
+template <typename Fn>
+auto walk_action_of(Fn& fn, const walk_entry& entry) -> walk_action {
+  if constexpr (std::is_void_v<std::invoke_result_t<Fn&, const walk_entry&>>) {
+    fn(entry);
+    return walk_action::descend;
+  } else {
+    return fn(entry);
+  }
+}
+
+}  // namespace detail
+
+// Calls visit(const walk_entry&) for every entry below root, concurrently
+// from several threads. visit may return walk_action::prune to skip a
+// directory's contents. Throws if root cannot be opened or visit throws;
+// other failures are collected in the result.
+template <typename Visit>
+auto walk_tree(const char* root, Visit&& visit, const walk_options& options = {})
+    -> walk_result {
+  auto adapter = [&visit](unsigned /*worker*/, const walk_entry& entry) {
+    return detail::walk_action_of(visit, entry);
+  };
+  return detail::tree_walk{root, options, adapter}.run();
+}
+
+// Like walk_tree, but calls consume(std::span<const walk_record>) with up
+// to options.batch_size entries at a time, each batch gathered by a single
+// thread. Like visit, consume is called concurrently from the worker
+// threads, so whatever it shares must be synchronized; the last partial
+// batches are passed on the calling thread after the walk. prune(const
+// walk_entry&) returns true for directories not to enter and is also
+// called concurrently.
+template <typename Consume, typename Prune>
+auto walk_tree_batched(const char* root,
+                       Consume&& consume,
+                       Prune&& prune,
+                       const walk_options& options = {}) -> walk_result {
+  auto batches = std::vector<std::vector<walk_record>>{};
+  auto flush = [&consume](std::vector<walk_record>& batch) {
+    if (!batch.empty()) {
+      consume(std::span<const walk_record>{batch});
+      batch.clear();
+    }
+  };
+  auto adapter = [&](unsigned worker, const walk_entry& entry) {
+    auto& batch = batches[worker];
+    auto& record = batch.emplace_back();
+    record.path.assign(entry.path);
+    record.ino = entry.ino;
+    record.type = entry.type;
+    record.depth = entry.depth;
+    record.has_stx = entry.stx != nullptr;
+    if (entry.stx != nullptr) {
+      record.stx = *entry.stx;
+    }
+    if (batch.size() >= options.batch_size) {
+      flush(batch);
+    }
+    return prune(entry) ? walk_action::prune : walk_action::descend;
+  };
+  auto walk = detail::tree_walk{root, options, adapter};
+  batches.resize(walk.threads());
+  auto result = walk.run();
+  for (auto& batch : batches) {
+    flush(batch);
+  }
+  return result;
+}
+
+template <typename Consume>
+auto walk_tree_batched(const char* root,
+                       Consume&& consume,
+                       const walk_options& options = {}) -> walk_result {
+  return walk_tree_batched(
+      root, std::forward<Consume>(consume),
+      [](const walk_entry& /*entry*/) { return false; }, options);
+}
+
+}  // namespace mfile
@@ -0,0 +1,112 @@
+// mfile - A modern C++20 file handling library
+// (https://github.com/range3/mfile)
+// Licensed under MIT License
+#pragma once
+
+// USDT (SystemTap SDT) probe points for bpftrace, perf and friends.
+//
+// Probes are only emitted when MFILE_ENABLE_USDT is defined; otherwise
+// MFILE_USDT_PROBE3/4 expand to nothing. When enabled, each probe site costs a
+// single nop plus an entry in the .note.stapsdt ELF section, which tracers
+// patch at attach time:
+//
+//   bpftrace -e 'usdt:./app:mfile:pread_once_return { @[arg3] = count(); }'
+//
+// <sys/sdt.h> is used when available; otherwise an equivalent note is
+// emitted directly on x86-64 and AArch64.
+
+#include <cstdint>
+#include <type_traits>
+
+#if defined(MFILE_ENABLE_USDT) && __has_include(<sys/sdt.h>)
+
+#  include <sys/sdt.h>
+
+#  define MFILE_USDT_PROBE3(name, a1, a2, a3) \
+    DTRACE_PROBE3(mfile, name, a1, a2, a3)
+#  define MFILE_USDT_PROBE4(name, a1, a2, a3, a4) \
+    DTRACE_PROBE4(mfile, name, a1, a2, a3, a4)
+
+#elif defined(MFILE_ENABLE_USDT) \
+    && (defined(__x86_64__) || defined(__aarch64__))
+
+// Mirrors the note layout produced by <sys/sdt.h>. Every argument is widened
+// to 64 bits; its signedness is encoded as "-8@" or "8@" through the %n
+// (negate) operand modifier, as <sys/sdt.h> does.
+#  define MFILE_USDT_STR_(x) #x
+#  define MFILE_USDT_STR(x) MFILE_USDT_STR_(x)
+
+#  define MFILE_USDT_NOTE_(name, args, ...)                  \
+    __asm__ __volatile__(                                     \
+        "990: nop\n"                                          \
+        ".pushsection .note.stapsdt,\"?\",\"note\"\n"         \
+        ".balign 4\n"                                         \
+        ".4byte 992f-991f, 994f-993f, 3\n"                    \
+        "991: .asciz \"stapsdt\"\n"                           \
+        "992: .balign 4\n"                                    \
+        "993: .8byte 990b\n"                                  \
+        ".8byte _.stapsdt.base\n"                             \
+        ".8byte 0\n"                                          \
+        ".asciz \"mfile\"\n"                                  \
+        ".asciz \"" MFILE_USDT_STR(name) "\"\n"               \
+        ".asciz \"" args "\"\n"                               \
+        "994: .balign 4\n"                                    \
+        ".popsection\n"                                       \
+        ".ifndef _.stapsdt.base\n"                            \
+        ".pushsection .stapsdt.base,\"aG\",\"progbits\","     \
+        ".stapsdt.base,comdat\n"                              \
+        ".weak _.stapsdt.base\n"                              \
+        ".hidden _.stapsdt.base\n"                            \
+        "_.stapsdt.base: .space 1\n"                          \
+        ".size _.stapsdt.base, 1\n"                           \
+        ".popsection\n"                                       \
+        ".endif\n" ::__VA_ARGS__)
+
+#  define MFILE_USDT_ARG_(n, x)                                      \
+    [s##n] "n"(::mfile::detail::usdt_size<decltype(x)>()),          \
+        [a##n] "nor"(::mfile::detail::usdt_arg(x))
+
+#  define MFILE_USDT_PROBE3(name, a1, a2, a3)                               \
+    MFILE_USDT_NOTE_(name, "%n[s1]@%[a1] %n[s2]@%[a2] %n[s3]@%[a3]",        \
+                     MFILE_USDT_ARG_(1, a1), MFILE_USDT_ARG_(2, a2),        \
+                     MFILE_USDT_ARG_(3, a3))
+#  define MFILE_USDT_PROBE4(name, a1, a2, a3, a4)                          \
+    MFILE_USDT_NOTE_(name,                                                 \
+                     "%n[s1]@%[a1] %n[s2]@%[a2] %n[s3]@%[a3] %n[s4]@%[a4]", \
+                     MFILE_USDT_ARG_(1, a1), MFILE_USDT_ARG_(2, a2),       \
+                     MFILE_USDT_ARG_(3, a3), MFILE_USDT_ARG_(4, a4))
+
+namespace mfile::detail {
+// Negated argument size; printed back through %n.
+template <typename T>
+consteval auto usdt_size() noexcept -> int {
+  using type = std::remove_cvref_t<T>;
+  return std::is_signed_v<type> ? 8 : -8;
+}
+
+template <typename T>
+constexpr auto usdt_arg(T value) noexcept {
+  if constexpr (std::is_pointer_v<T>) {
+    return reinterpret_cast<std::uint64_t>(value);  // NOLINT
+  } else if constexpr (std::is_signed_v<T>) {
+    return static_cast<std::int64_t>(value);
+  } else {
+    return static_cast<std::uint64_t>(value);
+  }
+}
+}  // namespace mfile::detail
+
+#else
+
+#  define MFILE_USDT_PROBE3(name, a1, a2, a3) ((void)0)
+#  define MFILE_USDT_PROBE4(name, a1, a2, a3, a4) ((void)0)
+
+#endif
+
+#if defined(MFILE_ENABLE_USDT) \
+    && (__has_include(<sys/sdt.h>) || defined(__x86_64__) \
+        || defined(__aarch64__))
+#  define MFILE_USDT_ENABLED 1
+#else
+#  define MFILE_USDT_ENABLED 0
+#endif
@@ -0,0 +1,474 @@
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <stop_token>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <poll.h>
+#include <unistd.h>
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+
+#include "coroutine_helper.hpp"
+#include "mfile/async.hpp"
+#include "mfile/io_context.hpp"
+#include "mfile/mfile.hpp"
+#include "test_helpers.hpp"
+
+using namespace std::string_view_literals;
+using mfile_test::detached;
+using mfile_test::io_uring_available;
+
+namespace {
+template <typename File>
+auto write_then_read(std::exception_ptr& /*error*/,
+                     mfile::io_context& ctx,
+                     const File& f,
+                     std::vector<std::byte>& out) -> detached {
+  co_await mfile::async_pwrite_exact(ctx, f, "Hello, async"sv, 100);
+  co_await mfile::async_sync(ctx, f);
+  out.resize(12);
+  co_await mfile::async_pread_exact(ctx, f, out, 100);
+}
+
+template <typename File>
+auto read_past_eof(std::exception_ptr& /*error*/,
+                   mfile::io_context& ctx,
+                   const File& f,
+                   std::size_t& got) -> detached {
+  auto buffer = std::array<std::byte, 16>{};
+  got = co_await mfile::async_pread(ctx, f, buffer, 0);
+  co_await mfile::async_pread_exact(ctx, f, buffer, 0);
+}
+
+template <typename File>
+auto read_block(std::exception_ptr& /*error*/,
+                mfile::io_context& ctx,
+                const File& f,
+                std::byte* dest,
+                std::uint64_t offset) -> detached {
+  co_await mfile::async_pread_exact(ctx, f, mfile::byte_view{dest, 8}, offset);
+}
+
+auto fixed_round_trip(std::exception_ptr& /*error*/,
+                      mfile::io_context& ctx,
+                      mfile::registered_file f,
+                      mfile::registered_buffer in,
+                      mfile::registered_buffer out) -> detached {
+  co_await mfile::async_pwrite_exact(ctx, f, in, 4096);
+  co_await mfile::async_sync(ctx, f);
+  co_await mfile::async_pread_exact(ctx, f, out, 4096);
+}
+
+auto read_with(std::exception_ptr& /*error*/,
+               mfile::io_context& ctx,
+               const mfile::file<mfile::file_handle>& f,
+               mfile::async_options options) -> detached {
+  auto buffer = std::array<std::byte, 8>{};
+  co_await mfile::async_pread_exact(ctx, f, buffer, 0, std::move(options));
+}
+
+auto make_pipe()
+    -> std::array<mfile::file<mfile::file_handle>, 2> {
+  auto fds = std::array<int, 2>{};
+  REQUIRE(::pipe2(fds.data(), O_CLOEXEC) == 0);
+  return {mfile::file{mfile::file_handle{mfile::weak_file_handle{fds[0]}}},
+          mfile::file{mfile::file_handle{mfile::weak_file_handle{fds[1]}}}};
+}
+
+auto error_code_of(const std::exception_ptr& error) -> std::error_code {
+  try {
+    std::rethrow_exception(error);
+  } catch (const mfile::mfile_error& e) {
+    return e.code();
+  }
+}
+
+auto run_chain(std::exception_ptr& /*error*/,
+               mfile::io_context& ctx,
+               const mfile::io_chain& chain,
+               std::stop_token stop = {}) -> detached {
+  co_await mfile::async_chain(ctx, chain, std::move(stop));
+}
+
+auto failed_link(const std::exception_ptr& error)
+    -> std::pair<std::size_t, std::error_code> {
+  try {
+    std::rethrow_exception(error);
+  } catch (const mfile::link_error& e) {
+    return {e.link(), e.code()};
+  }
+}
+}  // namespace
+
+// NOLINTNEXTLINE
+TEST_CASE("Coroutine positional I/O", "[async]") {
+  auto backend = GENERATE(mfile::io_backend::io_uring,
+                          mfile::io_backend::thread_pool);
+  if (backend == mfile::io_backend::io_uring && !io_uring_available()) {
+    SKIP("io_uring is not available on this host");
+  }
+  auto ctx = mfile::io_context{{.backend = backend}};
+  REQUIRE(ctx.backend() == backend);
+  auto file = mfile::make_tmpfile("/tmp/mfile_async_test_");
+
+  SECTION("write, sync and read back") {
+    std::exception_ptr error;
+    auto out = std::vector<std::byte>{};
+    write_then_read(error, ctx, file, out);
+    ctx.run();
+    REQUIRE_FALSE(error);
+    REQUIRE(std::memcmp(out.data(), "Hello, async", 12) == 0);
+    REQUIRE(file.size() == 112);
+  }
+
+  SECTION("EOF semantics match the synchronous API") {
+    file.write_exact("short"sv);
+    std::exception_ptr error;
+    std::size_t got = 0;
+    read_past_eof(error, ctx, file, got);
+    ctx.run();
+    REQUIRE(got == 5);
+    REQUIRE(error);
+    try {
+      std::rethrow_exception(error);
+    } catch (const mfile::end_of_file_error& e) {
+      REQUIRE(e.bytes_read() == 5);
+    }
+  }
+
+  SECTION("system errors are thrown as mfile_system_error") {
+    auto ro = mfile::file{mfile::weak_file_handle{-1}};
+    std::exception_ptr error;
+    auto out = std::vector<std::byte>{};
+    write_then_read(error, ctx, ro, out);
+    ctx.run();
+    REQUIRE(error);
+    REQUIRE_THROWS_AS(std::rethrow_exception(error),
+                      mfile::mfile_system_error);
+  }
+
+  SECTION("many concurrent reads overlap") {
+    constexpr std::size_t blocks = 1024;
+    auto data = std::vector<std::byte>(blocks * 8);
+    for (std::size_t i = 0; i < data.size(); ++i) {
+      data[i] = static_cast<std::byte>(i % 251);
+    }
+    file.pwrite_exact(data, 0);
+
+    auto out = std::vector<std::byte>(data.size());
+    auto errors = std::vector<std::exception_ptr>(blocks);
+    for (std::size_t i = 0; i < blocks; ++i) {
+      read_block(errors[i], ctx, file, out.data() + (i * 8), i * 8);
+    }
+    REQUIRE(ctx.outstanding() == blocks);
+    REQUIRE(ctx.run() == blocks);
+    REQUIRE(ctx.outstanding() == 0);
+    for (const auto& e : errors) {
+      REQUIRE_FALSE(e);
+    }
+    REQUIRE(out == data);
+  }
+}
+
+// NOLINTNEXTLINE
+TEST_CASE("Registered files and buffers", "[async]") {
+  auto backend = GENERATE(mfile::io_backend::io_uring,
+                          mfile::io_backend::thread_pool);
+  if (backend == mfile::io_backend::io_uring && !io_uring_available()) {
+    SKIP("io_uring is not available on this host");
+  }
+  auto ctx = mfile::io_context{{.backend = backend, .fixed_files = 2}};
+  auto storage = std::vector<std::byte>(8192);
+  auto buffers = ctx.register_buffers(std::array{mfile::byte_view{storage}});
+  REQUIRE(buffers.size() == 1);
+  auto const in = buffers[0].subspan(0, 4096);
+  auto const out = buffers[0].subspan(4096);
+  std::memcpy(in.data().data(), "fixed", 5);
+
+  auto slot = ctx.register_file(
+      mfile::open("/tmp", mfile::open_flags::rp().tmpfile()));
+
+  SECTION("round trip through READ_FIXED/WRITE_FIXED") {
+    std::exception_ptr error;
+    fixed_round_trip(error, ctx, slot, in, out);
+    ctx.run();
+    REQUIRE_FALSE(error);
+    REQUIRE(std::memcmp(out.data().data(), "fixed", 5) == 0);
+    REQUIRE(ctx.registered(slot).size() == 8192);
+  }
+
+  SECTION("a file with operations in flight cannot be unregistered") {
+    std::exception_ptr error;
+    fixed_round_trip(error, ctx, slot, in, out);
+    REQUIRE_THROWS_AS(ctx.unregister_file(slot), mfile::mfile_system_error);
+    REQUIRE_THROWS_AS(ctx.unregister_buffers(), mfile::mfile_system_error);
+    ctx.run();
+    REQUIRE_FALSE(error);
+    auto f = ctx.unregister_file(slot);
+    REQUIRE(f.size() == 8192);
+    REQUIRE_THROWS_AS(ctx.registered(slot), mfile::mfile_system_error);
+    ctx.unregister_buffers();
+  }
+
+  SECTION("the table size is bounded") {
+    ctx.register_file(mfile::open("/tmp", mfile::open_flags::rp().tmpfile()));
+    REQUIRE_THROWS_AS(
+        ctx.register_file(
+            mfile::open("/tmp", mfile::open_flags::rp().tmpfile())),
+        mfile::mfile_system_error);
+  }
+
+  SECTION("transfers must stay inside the registered buffer") {
+    auto other = std::vector<std::byte>(4096);
+    auto const outside = mfile::registered_buffer{0, other};
+    std::exception_ptr error;
+    fixed_round_trip(error, ctx, slot, outside, out);
+    ctx.run();
+    REQUIRE(error);
+  }
+}
+
+// NOLINTNEXTLINE
+TEST_CASE("Linked chains", "[async]") {
+  auto backend = GENERATE(mfile::io_backend::io_uring,
+                          mfile::io_backend::thread_pool);
+  if (backend == mfile::io_backend::io_uring && !io_uring_available()) {
+    SKIP("io_uring is not available on this host");
+  }
+  auto ctx = mfile::io_context{{.backend = backend}};
+  auto file = mfile::make_tmpfile("/tmp/mfile_async_test_");
+
+  SECTION("write, write, fdatasync complete in order") {
+    auto chain = mfile::io_chain{};
+    chain.pwrite(file, "record"sv, 0)
+        .pwrite(file, "footer"sv, 6)
+        .fdatasync(file);
+    REQUIRE(chain.requests().size() == 3);
+    std::exception_ptr error;
+    run_chain(error, ctx, chain);
+    REQUIRE(ctx.run() == 3);
+    REQUIRE_FALSE(error);
+    auto out = std::array<char, 12>{};
+    file.pread_exact(out, 0);
+    REQUIRE(std::string_view{out.data(), out.size()} == "recordfooter");
+  }
+
+  SECTION("a failed link cancels the rest and is reported") {
+    file.write_exact("abc"sv);
+    auto buffer = std::array<std::byte, 16>{};
+    auto chain = mfile::io_chain{};
+    chain.pwrite(file, "xyz"sv, 0)
+        .pread(file, buffer, 0)
+        .pwrite(file, "zz"sv, 100);
+    std::exception_ptr error;
+    run_chain(error, ctx, chain);
+    REQUIRE(ctx.run() == 3);
+    REQUIRE(error);
+    try {
+      std::rethrow_exception(error);
+    } catch (const mfile::link_error& e) {
+      REQUIRE(e.link() == 1);
+      REQUIRE(e.code() == mfile::errc::end_of_file);
+    }
+    REQUIRE(file.size() == 3);
+  }
+
+  SECTION("system errors name their link") {
+    auto bad = mfile::file{mfile::weak_file_handle{-1}};
+    auto chain = mfile::io_chain{};
+    chain.pwrite(file, "ok"sv, 0).fsync(bad).drain();
+    std::exception_ptr error;
+    run_chain(error, ctx, chain);
+    ctx.run();
+    REQUIRE(error);
+    try {
+      std::rethrow_exception(error);
+    } catch (const mfile::link_error& e) {
+      REQUIRE(e.link() == 1);
+      REQUIRE(e.code() == std::errc::bad_file_descriptor);
+    }
+  }
+}
+
+// NOLINTNEXTLINE
+TEST_CASE("Deadlines and cancellation", "[async]") {
+  using namespace std::chrono_literals;
+  auto backend = GENERATE(mfile::io_backend::io_uring,
+                          mfile::io_backend::thread_pool);
+  if (backend == mfile::io_backend::io_uring && !io_uring_available()) {
+    SKIP("io_uring is not available on this host");
+  }
+  auto ctx = mfile::io_context{{.backend = backend}};
+  auto file = mfile::open("/tmp", mfile::open_flags::rp().tmpfile());
+  file.write_exact("12345678"sv);
+
+  SECTION("operations finishing in time are unaffected") {
+    auto source = std::stop_source{};
+    std::exception_ptr error;
+    read_with(error, ctx, file, {.timeout = 10s, .stop = source.get_token()});
+    ctx.run();
+    REQUIRE_FALSE(error);
+  }
+
+  SECTION("a stop requested up front fails without submitting") {
+    auto source = std::stop_source{};
+    source.request_stop();
+    std::exception_ptr error;
+    read_with(error, ctx, file, {.stop = source.get_token()});
+    REQUIRE(ctx.outstanding() == 0);
+    REQUIRE(error_code_of(error) == mfile::errc::operation_cancelled);
+  }
+
+  SECTION("a chain stopped up front fails without submitting") {
+    auto source = std::stop_source{};
+    source.request_stop();
+    auto chain = mfile::io_chain{};
+    chain.pwrite(file, "abc"sv, 0).fsync(file);
+    std::exception_ptr error;
+    run_chain(error, ctx, chain, source.get_token());
+    REQUIRE(ctx.outstanding() == 0);
+    auto const [link, code] = failed_link(error);
+    REQUIRE(link == 0);
+    REQUIRE(code == mfile::errc::operation_cancelled);
+  }
+
+  if (backend != mfile::io_backend::io_uring) {
+    return;  // running pool requests cannot be interrupted
+  }
+  auto [reader, writer] = make_pipe();
+
+  SECTION("a stuck read times out") {
+    std::exception_ptr error;
+    read_with(error, ctx, reader, {.timeout = 20ms});
+    REQUIRE(ctx.run_one() == 1);
+    REQUIRE(ctx.outstanding() == 0);
+    REQUIRE(error_code_of(error) == mfile::errc::timed_out);
+  }
+
+  SECTION("a stuck read is cancelled from another thread") {
+    auto source = std::stop_source{};
+    std::exception_ptr error;
+    read_with(error, ctx, reader, {.stop = source.get_token()});
+    auto stopper = std::jthread{[&source] {
+      std::this_thread::sleep_for(20ms);
+      source.request_stop();
+    }};
+    // The wake-up and the cancel request complete first, without counting
+    REQUIRE(ctx.run_one() == 1);
+    REQUIRE(ctx.outstanding() == 0);
+    REQUIRE(error_code_of(error) == mfile::errc::operation_cancelled);
+  }
+
+  SECTION("a stuck link is cancelled from another thread") {
+    auto source = std::stop_source{};
+    auto buffer = std::array<std::byte, 8>{};
+    auto chain = mfile::io_chain{};
+    chain.pwrite(file, "abc"sv, 0).pread(reader, buffer, 0).fsync(file);
+    std::exception_ptr error;
+    run_chain(error, ctx, chain, source.get_token());
+    auto stopper = std::jthread{[&source] {
+      std::this_thread::sleep_for(20ms);
+      source.request_stop();
+    }};
+    REQUIRE(ctx.run() == 3);
+    auto const [link, code] = failed_link(error);
+    REQUIRE(link == 1);
+    REQUIRE(code == mfile::errc::operation_cancelled);
+  }
+}
+
+// NOLINTNEXTLINE
+TEST_CASE("Completion notification through an eventfd", "[async]") {
+  auto backend = GENERATE(mfile::io_backend::io_uring,
+                          mfile::io_backend::thread_pool);
+  if (backend == mfile::io_backend::io_uring && !io_uring_available()) {
+    SKIP("io_uring is not available on this host");
+  }
+  auto ctx = mfile::io_context{{.backend = backend}};
+  auto file = mfile::make_tmpfile("/tmp/mfile_async_test_");
+  file.write_exact("0123456789abcdef"sv);
+
+  auto const fd = ctx.completion_fd();
+  REQUIRE(fd == ctx.completion_fd());
+  auto readable = [fd](int timeout_ms) {
+    auto pfd = ::pollfd{.fd = fd, .events = POLLIN, .revents = 0};
+    return ::poll(&pfd, 1, timeout_ms) == 1;
+  };
+  REQUIRE_FALSE(readable(0));
+
+  constexpr std::size_t reads = 2;
+  auto out = std::array<std::byte, 16>{};
+  auto errors = std::vector<std::exception_ptr>(reads);
+  for (std::size_t i = 0; i < reads; ++i) {
+    read_block(errors[i], ctx, file, out.data() + (i * 8), i * 8);
+  }
+  // Hands the submissions to the backend; nothing is ready yet or it is
+  // dispatched right away
+  std::size_t done = ctx.poll_completions(0);
+  while (done < reads) {
+    REQUIRE(readable(5000));
+    done += ctx.poll_completions(1);
+  }
+  REQUIRE(ctx.outstanding() == 0);
+  REQUIRE(std::memcmp(out.data(), "0123456789abcdef", 16) == 0);
+  ctx.poll_completions();
+  REQUIRE_FALSE(readable(0));
+}
+
+// NOLINTNEXTLINE
+TEST_CASE("SQPOLL submission", "[async]") {
+  using namespace std::chrono_literals;
+  if (!io_uring_available()) {
+    SKIP("io_uring is not available on this host");
+  }
+  auto make = []() -> std::unique_ptr<mfile::io_context> {
+    try {
+      return std::make_unique<mfile::io_context>(mfile::io_context_options{
+          .backend = mfile::io_backend::io_uring,
+          .sqpoll = {.enabled = true, .idle = 1ms, .cpu = 0}});
+    } catch (const mfile::mfile_system_error&) {
+      return nullptr;  // e.g. EPERM without CAP_SYS_NICE on old kernels
+    }
+  };
+  auto ctx = make();
+  if (!ctx) {
+    SKIP("SQPOLL is not permitted on this host");
+  }
+  REQUIRE(ctx->ring().sqpoll());
+  auto file = mfile::make_tmpfile("/tmp/mfile_async_test_");
+
+  for (int round = 0; round < 3; ++round) {
+    std::exception_ptr error;
+    auto out = std::vector<std::byte>{};
+    write_then_read(error, *ctx, file, out);
+    ctx->run();
+    REQUIRE_FALSE(error);
+    REQUIRE(std::memcmp(out.data(), "Hello, async", 12) == 0);
+    // Let the poller go idle so the next round has to wake it
+    std::this_thread::sleep_for(20ms);
+  }
+  REQUIRE(ctx->ring().stats().sqpoll_wakeups >= 1);
+}
+
+TEST_CASE("io_context backend selection", "[async]") {
+  SECTION("thread pool can be forced") {
+    auto ctx = mfile::io_context{{.backend = mfile::io_backend::thread_pool,
+                                  .threads = 2}};
+    REQUIRE(ctx.backend() == mfile::io_backend::thread_pool);
+    REQUIRE(ctx.run() == 0);
+  }
+
+  SECTION("automatic picks a working backend") {
+    auto ctx = mfile::io_context{};
+    REQUIRE(ctx.backend() != mfile::io_backend::automatic);
+  }
+}
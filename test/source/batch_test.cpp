@@ -0,0 +1,142 @@
+#include <cerrno>
+#include <iterator>
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+
+#include "mfile/batch.hpp"
+#include "mfile/io_context.hpp"
+#include "mfile/mfile.hpp"
+#include "test_helpers.hpp"
+
+using range3::as_sv;
+using mfile_test::io_uring_available;
+using mfile_test::temp_dir;
+
+namespace {
+
+auto content_of(std::size_t i) -> std::string {
+  return "file " + std::to_string(i) + std::string(i % 7, '*');
+}
+}  // namespace
+
+TEST_CASE("Batched loading of small files", "[batch]") {
+  auto backend = GENERATE(mfile::io_backend::io_uring,
+                          mfile::io_backend::thread_pool);
+  if (backend == mfile::io_backend::io_uring && !io_uring_available()) {
+    SKIP("io_uring is not available on this host");
+  }
+  auto ctx = mfile::io_context{{.entries = 64, .backend = backend}};
+  auto dir = temp_dir{"mfile_batch_test"};
+
+  auto paths = std::vector<std::string>{};
+  for (std::size_t i = 0; i < 300; ++i) {
+    auto path = (dir.path / std::to_string(i)).string();
+    mfile::open(path.c_str(), mfile::open_flags::w()).write_exact(content_of(i));
+    paths.push_back(std::move(path));
+  }
+
+  SECTION("contents are packed in path order") {
+    auto files = mfile::load_files(ctx, paths, {.max_in_flight = 16});
+    REQUIRE(files.size() == paths.size());
+    std::size_t total = 0;
+    for (std::size_t i = 0; i < files.size(); ++i) {
+      REQUIRE_FALSE(files.error(i));
+      REQUIRE(as_sv(files.data(i)) == content_of(i));
+      total += files.data(i).size();
+    }
+    REQUIRE(files.total_size() == total);
+  }
+
+  SECTION("files larger than a block get their own") {
+    auto files = mfile::load_files(ctx, std::span{paths}.first(20),
+                                   {.block_size = 12});
+    for (std::size_t i = 0; i < files.size(); ++i) {
+      REQUIRE(as_sv(files.data(i)) == content_of(i));
+    }
+  }
+
+  SECTION("no descriptor is left open") {
+    auto const open_fds = [] {
+      auto const entries =
+          std::filesystem::directory_iterator{"/proc/self/fd"};
+      return std::distance(begin(entries), end(entries));
+    };
+    auto const before = open_fds();
+    auto names = std::vector<std::string>{paths.begin(), paths.end()};
+    names.push_back((dir.path / "missing").string());
+    names.push_back(dir.path.string());
+    auto files = mfile::load_files(ctx, names, {.max_file_size = 7});
+    REQUIRE(files.error(9) == std::errc::file_too_large);
+    REQUIRE(files.error(names.size() - 1) == std::errc::is_a_directory);
+    REQUIRE(open_fds() == before);
+  }
+
+  SECTION("failures are reported per file") {
+    auto const empty =
+        mfile::open((dir.path / "empty").c_str(), mfile::open_flags::w());
+    std::filesystem::create_directory(dir.path / "subdir");
+    auto const names = std::vector<std::string>{
+        paths[3], (dir.path / "missing").string(), (dir.path / "subdir").string(),
+        (dir.path / "empty").string(), paths[4]};
+    auto files = mfile::load_files(ctx, names);
+    REQUIRE(files.size() == 5);
+    REQUIRE(as_sv(files.data(0)) == content_of(3));
+    REQUIRE(files.error(1) == std::errc::no_such_file_or_directory);
+    REQUIRE(files.data(1).empty());
+    REQUIRE(files.error(2) == std::errc::is_a_directory);
+    REQUIRE_FALSE(files.error(3));
+    REQUIRE(files.data(3).empty());
+    REQUIRE(as_sv(files.data(4)) == content_of(4));
+  }
+
+  SECTION("paths are resolved against dirfd") {
+    auto const dirfd = ::open(dir.path.c_str(), O_RDONLY | O_DIRECTORY);
+    REQUIRE(dirfd >= 0);
+    const char* const names[] = {"10", "20"};  // NOLINT
+    auto files = mfile::load_files(ctx, names, {.dirfd = dirfd});
+    ::close(dirfd);
+    REQUIRE(as_sv(files.data(0)) == content_of(10));
+    REQUIRE(as_sv(files.data(1)) == content_of(20));
+  }
+
+  SECTION("files reporting size 0 are read to EOF") {
+    // NOLINTNEXTLINE
+    const char* const names[] = {"/proc/self/status", "/proc/version"};
+    auto files = mfile::load_files(ctx, names);
+    REQUIRE_FALSE(files.error(0));
+    REQUIRE(as_sv(files.data(0)).starts_with("Name:"));
+    REQUIRE_FALSE(files.error(1));
+    REQUIRE(as_sv(files.data(1)).starts_with("Linux version"));
+    REQUIRE(files.total_size()
+            == files.data(0).size() + files.data(1).size());
+    auto big = mfile::load_files(ctx, names, {.max_file_size = 4});
+    REQUIRE(big.error(0) == std::errc::file_too_large);
+  }
+
+  SECTION("files shorter than fstat reports end at EOF") {
+    // sysfs attributes report a page but hold a line
+    const char* const names[] = {  // NOLINT
+        "/sys/kernel/mm/transparent_hugepage/enabled"};
+    if (!std::filesystem::exists(names[0])) {
+      SKIP("no transparent huge page attributes in sysfs");
+    }
+    auto files = mfile::load_files(ctx, names);
+    REQUIRE_FALSE(files.error(0));
+    REQUIRE(as_sv(files.data(0)).ends_with("never\n"));
+  }
+
+  SECTION("files over max_file_size fail with EFBIG") {
+    auto files = mfile::load_files(ctx, std::span{paths}.first(10),
+                                   {.max_file_size = 7});
+    REQUIRE_FALSE(files.error(0));
+    REQUIRE(files.error(9) == std::errc::file_too_large);
+  }
+}
@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <set>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "coroutine_helper.hpp"
+#include "mfile/async.hpp"
+#include "mfile/buffer_pool.hpp"
+#include "mfile/buffered.hpp"
+#include "mfile/io_context.hpp"
+#include "mfile/mfile.hpp"
+
+using namespace std::string_view_literals;
+using mfile_test::detached;
+using range3::as_sv;
+
+namespace {
+auto read_into(std::exception_ptr& /*error*/,
+               mfile::io_context& ctx,
+               const mfile::file<mfile::tmpfile_handle>& f,
+               mfile::buffer_lease& lease) -> detached {
+  lease.resize(5);
+  co_await mfile::async_pread_exact(ctx, f, lease, 7);
+}
+}  // namespace
+
+TEST_CASE("Buffer pool leases", "[buffer_pool]") {
+  auto pool = mfile::buffer_pool{
+      {.buffer_size = 1000, .alignment = 512, .count = 4, .thread_cache = 2}};
+  REQUIRE(pool.buffer_size() == 1000);
+  REQUIRE(pool.count() == 4);
+  REQUIRE(pool.memory().size() == 4 * 1024);
+
+  auto leases = std::vector<mfile::buffer_lease>{};
+  auto addresses = std::set<const std::byte*>{};
+  for (int i = 0; i < 4; ++i) {
+    auto& lease = leases.emplace_back(pool.lease());
+    REQUIRE(lease);
+    REQUIRE(lease.size() == 1000);
+    REQUIRE(lease.capacity() == 1000);
+    REQUIRE(reinterpret_cast<std::uintptr_t>(lease.data()) % 512 == 0);
+    REQUIRE(lease.data() == pool.memory().data() + lease.offset());
+    addresses.insert(lease.data());
+  }
+  REQUIRE(addresses.size() == 4);
+  REQUIRE_FALSE(pool.try_lease().has_value());
+  try {
+    (void)pool.lease();
+    FAIL("expected ENOBUFS");
+  } catch (const mfile::mfile_system_error& e) {
+    REQUIRE(e.code().value() == ENOBUFS);
+  }
+
+  auto view = mfile::byte_view{leases[0]};
+  REQUIRE(view.data() == leases[0].data());
+  leases[0].resize(10);
+  REQUIRE(mfile::cbyte_view{leases[0]}.size() == 10);
+  leases[0].resize(5000);
+  REQUIRE(leases[0].size() == 1000);
+
+  auto const* returned = leases[1].data();
+  leases[1].reset();
+  REQUIRE_FALSE(leases[1]);
+  auto again = pool.lease();
+  REQUIRE(again.data() == returned);
+
+  leases.clear();
+  again = mfile::buffer_lease{};
+  for (int i = 0; i < 4; ++i) {
+    leases.push_back(pool.lease());
+  }
+}
+
+TEST_CASE("Buffer pool across threads", "[buffer_pool]") {
+  constexpr std::size_t count = 16;
+  auto pool = mfile::buffer_pool{
+      {.buffer_size = 64, .count = count, .thread_cache = 4}};
+  auto overlaps = std::atomic<int>{0};
+
+  auto threads = std::vector<std::thread>{};
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&, t] {
+      auto const mark = static_cast<std::byte>(t + 1);
+      for (int i = 0; i < 20000; ++i) {
+        auto lease = pool.try_lease();
+        if (!lease) {
+          continue;
+        }
+        std::fill_n(lease->data(), lease->size(), mark);
+        if (std::any_of(lease->data(), lease->data() + lease->size(),
+                        [&](std::byte b) { return b != mark; })) {
+          overlaps.fetch_add(1);
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  REQUIRE(overlaps.load() == 0);
+
+  // Exiting threads gave their cached buffers back
+  auto leases = std::vector<mfile::buffer_lease>{};
+  for (std::size_t i = 0; i < count; ++i) {
+    leases.push_back(pool.lease());
+  }
+}
+
+TEST_CASE("Buffer pool exhaustion across threads", "[buffer_pool]") {
+  auto pool = mfile::buffer_pool{{.buffer_size = 64, .count = 4}};
+  REQUIRE(pool.count() == 4);
+
+  // The first lease pulls free buffers into this thread's cache
+  auto held = pool.lease();
+  auto others = std::vector<mfile::buffer_lease>{};
+  std::thread{[&] {
+    for (int i = 0; i < 3; ++i) {
+      auto lease = pool.try_lease();
+      REQUIRE(lease.has_value());
+      others.push_back(std::move(*lease));
+    }
+    REQUIRE_FALSE(pool.try_lease().has_value());
+  }}.join();
+
+  // Returned to this thread's cache, then leased by another one
+  others.clear();
+  held.reset();
+  auto count = std::atomic<int>{0};
+  std::thread{[&] {
+    auto leases = std::vector<mfile::buffer_lease>{};
+    while (auto lease = pool.try_lease()) {
+      leases.push_back(std::move(*lease));
+    }
+    count = static_cast<int>(leases.size());
+  }}.join();
+  REQUIRE(count.load() == 4);
+
+  REQUIRE_THROWS_AS(
+      (mfile::buffer_pool{{.alignment = 0}}), std::invalid_argument);
+}
+
+TEST_CASE("Buffer pool I/O", "[buffer_pool]") {
+  auto tmp = mfile::make_tmpfile("/tmp/mfile_buffer_pool_test_");
+  auto pool = mfile::buffer_pool{{.buffer_size = 4096, .count = 4}};
+
+  SECTION("buffered writer and reader") {
+    {
+      auto writer = mfile::buffered_writer{tmp, 0, mfile::no_digest{},
+                                           pool.lease()};
+      for (int i = 0; i < 1000; ++i) {
+        writer.write("0123456789"sv);
+      }
+    }
+    REQUIRE(tmp.size() == 10000);
+
+    auto reader =
+        mfile::buffered_reader{tmp, 0, mfile::no_digest{}, pool.lease()};
+    REQUIRE(reader.capacity() == 4096);
+    auto out = std::vector<std::byte>(10000);
+    reader.read_exact(out);
+    REQUIRE(as_sv(mfile::cbyte_view{out}.subspan(9990)) == "0123456789");
+  }
+
+  SECTION("reads into leases") {
+    tmp.write_exact("Hello, pooled world"sv);
+    auto lease = pool.pread(tmp, 100, 7);
+    REQUIRE(as_sv(mfile::cbyte_view{lease}) == "pooled world");
+    tmp.seek(0, SEEK_SET);
+    REQUIRE(as_sv(mfile::cbyte_view{pool.read(tmp, 5)}) == "Hello");
+    REQUIRE_THROWS_AS(pool.pread(tmp, 4097, 0), mfile::mfile_system_error);
+  }
+
+  SECTION("async reads into leases") {
+    tmp.write_exact("Hello, pooled world"sv);
+    auto ctx = mfile::io_context{{.backend = mfile::io_backend::thread_pool}};
+    auto lease = pool.lease();
+    std::exception_ptr error;
+    read_into(error, ctx, tmp, lease);
+    ctx.run();
+    REQUIRE_FALSE(error);
+    REQUIRE(as_sv(mfile::cbyte_view{lease}) == "poole");
+  }
+}
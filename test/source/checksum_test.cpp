@@ -0,0 +1,160 @@
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "mfile/buffered.hpp"
+#include "mfile/checksum.hpp"
+#include "mfile/crc32c.hpp"
+#include "mfile/mfile.hpp"
+#include "test_helpers.hpp"
+
+using mfile_test::bytes_of;
+
+namespace {
+template <typename Digest>
+auto digest_of(mfile::cbyte_view data, Digest d = {}) {
+  d.update(data);
+  return d.value();
+}
+
+auto pattern(std::size_t size) -> std::vector<std::byte> {
+  auto data = std::vector<std::byte>(size);
+  for (std::size_t i = 0; i < size; ++i) {
+    data[i] = static_cast<std::byte>((i * 131) + (i >> 9U));
+  }
+  return data;
+}
+}  // namespace
+
+TEST_CASE("Streaming digests", "[checksum]") {
+  SECTION("xxh64 reference values") {
+    using mfile::xxh64_digest;
+    REQUIRE(digest_of<xxh64_digest>({}) == 0xef46db3751d8e999ULL);
+    REQUIRE(digest_of<xxh64_digest>(bytes_of("a")) == 0xd24ec4f1a98c6e5bULL);
+    REQUIRE(digest_of<xxh64_digest>(bytes_of("abc")) == 0x44bc2cf5ad770999ULL);
+    REQUIRE(digest_of(bytes_of("abc"), xxh64_digest{12345})
+            == 0x01700e64f6f23509ULL);
+
+    auto data = std::vector<std::byte>{};
+    for (int r = 0; r < 4; ++r) {
+      for (int i = 0; i < 256; ++i) {
+        data.push_back(static_cast<std::byte>(i));
+      }
+    }
+    for (char c : std::string_view{"xyz"}) {
+      data.push_back(static_cast<std::byte>(c));
+    }
+    REQUIRE(digest_of<xxh64_digest>(data) == 0xe146cb31b65bc21aULL);
+    REQUIRE(digest_of(mfile::cbyte_view{data}, xxh64_digest{12345})
+            == 0xe323a559c0f2ee86ULL);
+  }
+
+  SECTION("digests do not depend on how the data is split") {
+    auto const data = pattern(100'000);
+    auto const whole_crc = digest_of<mfile::crc32c_digest>(data);
+    auto const whole_xxh = digest_of<mfile::xxh64_digest>(data);
+    auto const sw = ~mfile::detail::crc32c_sw(~0U, data.data(), data.size());
+    REQUIRE(whole_crc == sw);
+    for (std::size_t piece : {1U, 5U, 31U, 32U, 33U, 4096U, 12289U}) {
+      auto crc = mfile::crc32c_digest{};
+      auto xxh = mfile::xxh64_digest{};
+      for (std::size_t pos = 0; pos < data.size(); pos += piece) {
+        auto const part = mfile::cbyte_view{data}.subspan(
+            pos, std::min(piece, data.size() - pos));
+        crc.update(part);
+        xxh.update(part);
+      }
+      REQUIRE(crc.value() == whole_crc);
+      REQUIRE(xxh.value() == whole_xxh);
+    }
+  }
+}
+
+TEST_CASE("Checksummed buffered I/O", "[checksum]") {
+  auto tmp = mfile::make_tmpfile("/tmp/mfile_checksum_test_");
+  auto const data = pattern(1'000'000);
+  auto const expected = digest_of<mfile::crc32c_digest>(data);
+
+  SECTION("the writer digests what it writes") {
+    {
+      auto writer = mfile::buffered_writer{tmp, 0, mfile::crc32c_digest{},
+                                           4096};
+      auto const view = mfile::cbyte_view{data};
+      writer.write(view.first(10));
+      writer.write(view.subspan(10, 100'000));
+      writer.write(view.subspan(100'010, 1000));
+      writer.write(view.subspan(101'010));
+      REQUIRE(writer.digest().value() == expected);
+      REQUIRE(writer.offset() == data.size());
+    }
+    REQUIRE(tmp.pread(0) == data);
+  }
+
+  SECTION("the reader digests what is consumed") {
+    tmp.pwrite_exact(data, 0);
+    auto reader = mfile::buffered_reader{tmp, 0, mfile::crc32c_digest{}, 4096};
+    auto out = std::vector<std::byte>(data.size());
+    auto const view = mfile::byte_view{out};
+    reader.read_exact(view.first(7));
+    reader.read_exact(view.subspan(7, 50'000));
+    REQUIRE(reader.read(view.subspan(50'007)) == data.size() - 50'007);
+    REQUIRE(out == data);
+    REQUIRE(reader.digest().value() == expected);
+
+    auto extra = std::byte{};
+    REQUIRE(reader.read({&extra, 1}) == 0);
+    REQUIRE_THROWS_AS(reader.read_exact({&extra, 1}), mfile::end_of_file_error);
+  }
+
+  SECTION("refill keeps unconsumed bytes") {
+    tmp.pwrite_exact(data, 0);
+    auto reader = mfile::buffered_reader{tmp, 100, mfile::no_digest{}, 64};
+    REQUIRE(reader.fill().size() == 64);
+    reader.consume(60);
+    REQUIRE(reader.refill() == 60);
+    auto const window = reader.buffered();
+    REQUIRE(window.size() == 64);
+    REQUIRE(window[0] == data[160]);
+    REQUIRE(window[63] == data[223]);
+    REQUIRE(reader.offset() == 160);
+  }
+}
+
+TEST_CASE("Block verification", "[checksum]") {
+  auto tmp = mfile::make_tmpfile("/tmp/mfile_checksum_test_");
+  constexpr std::size_t block = 4096;
+  auto const data = pattern((block * 200) + 100);
+  tmp.pwrite_exact(data, 0);
+  auto const sums = mfile::block_digests(data, block);
+  REQUIRE(sums.size() == 201);
+  REQUIRE_FALSE(mfile::find_mismatched_block(data, block,
+                                             std::span{sums}));
+
+  auto out = std::vector<std::byte>(data.size());
+  mfile::pread_verified(tmp, out, 0, block, std::span{sums});
+  REQUIRE(out == data);
+
+  tmp.pwrite_exact(bytes_of("corrupt"), (block * 150) + 17);
+  try {
+    mfile::pread_verified(tmp, out, 0, block, std::span{sums});
+    FAIL("corruption was not detected");
+  } catch (const mfile::checksum_error& e) {
+    REQUIRE(e.block() == 150);
+    REQUIRE(e.code() == mfile::errc::checksum_mismatch);
+  }
+
+  auto const xxh = mfile::block_digests<mfile::xxh64_digest>(data, block);
+  auto tail = std::vector<std::byte>(block);
+  mfile::pread_verified<mfile::xxh64_digest>(
+      tmp, tail, block * 3, block, std::span{xxh}.subspan(3));
+
+  REQUIRE_THROWS_AS(mfile::block_digests(data, 0), mfile::mfile_system_error);
+  REQUIRE_THROWS_AS(mfile::find_mismatched_block(data, 0, std::span{sums}),
+                    mfile::mfile_system_error);
+  REQUIRE_THROWS_AS(mfile::pread_verified(tmp, out, 0, 0, std::span{sums}),
+                    mfile::mfile_system_error);
+}
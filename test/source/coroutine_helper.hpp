@@ -0,0 +1,27 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <utility>
+
+namespace mfile_test {
+
+// Eagerly started, self-destroying coroutine used to drive awaitables in
+// tests. An escaping exception is stored in *error.
+struct detached {
+  struct promise_type {
+    std::exception_ptr* error{};
+
+    template <typename... Args>
+    explicit promise_type(std::exception_ptr& e, Args&&... /*args*/)
+        : error{&e} {}
+
+    auto get_return_object() noexcept -> detached { return {}; }
+    auto initial_suspend() noexcept -> std::suspend_never { return {}; }
+    auto final_suspend() noexcept -> std::suspend_never { return {}; }
+    void return_void() noexcept {}
+    void unhandled_exception() noexcept { *error = std::current_exception(); }
+  };
+};
+
+}  // namespace mfile_test
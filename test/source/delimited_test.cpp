@@ -0,0 +1,113 @@
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "mfile/buffered.hpp"
+#include "mfile/delimited.hpp"
+#include "mfile/mfile.hpp"
+#include "test_helpers.hpp"
+
+using namespace std::string_view_literals;
+using range3::as_sv;
+using mfile_test::bytes_of;
+
+namespace {
+// Reference split: like getline, a trailing delimiter ends the last record
+auto split(std::string_view s, char delimiter) -> std::vector<std::string> {
+  auto records = std::vector<std::string>{};
+  while (!s.empty()) {
+    auto const pos = s.find(delimiter);
+    records.emplace_back(s.substr(0, pos));
+    s = pos == std::string_view::npos ? std::string_view{} : s.substr(pos + 1);
+  }
+  return records;
+}
+
+auto lines_of(std::size_t count) -> std::string {
+  auto data = std::string{};
+  for (std::size_t i = 0; i < count; ++i) {
+    data += std::string(i % 97, static_cast<char>('a' + (i % 26)));
+    data += '\n';
+  }
+  return data;
+}
+}  // namespace
+
+TEST_CASE("Delimiter search", "[delimited]") {
+  auto data = std::vector<std::byte>(300, std::byte{'x'});
+  for (std::size_t size = 0; size <= data.size(); size += 7) {
+    auto const view = mfile::cbyte_view{data}.first(size);
+    REQUIRE(mfile::find_delimiter(view, std::byte{'\n'}) == size);
+    for (std::size_t pos = 0; pos < size; ++pos) {
+      data[pos] = std::byte{'\n'};
+      if (pos + 1 < size) {
+        data[pos + 1] = std::byte{'\n'};
+      }
+      REQUIRE(mfile::find_delimiter(view, std::byte{'\n'}) == pos);
+      REQUIRE(mfile::detail::find_byte_sw(view.data(), size, std::byte{'\n'})
+              == pos);
+      data[pos] = std::byte{'x'};
+      if (pos + 1 < size) {
+        data[pos + 1] = std::byte{'x'};
+      }
+    }
+  }
+  // Bytes that differ from the delimiter only in the high bit
+  auto high = std::vector<std::byte>(64, std::byte{0x80});
+  high[40] = std::byte{0};
+  REQUIRE(mfile::find_delimiter(high, std::byte{0}) == 40);
+  REQUIRE(mfile::detail::find_byte_sw(high.data(), high.size(), std::byte{0})
+          == 40);
+}
+
+TEST_CASE("Delimited records in memory", "[delimited]") {
+  auto collect = [](std::string_view s, char delimiter) {
+    auto records = std::vector<std::string>{};
+    for (auto record : mfile::delimited_records{bytes_of(s),
+                                                std::byte(delimiter)}) {
+      records.emplace_back(as_sv(record));
+    }
+    return records;
+  };
+
+  REQUIRE(collect("", '\n').empty());
+  REQUIRE(collect("\n", '\n') == std::vector<std::string>{""});
+  REQUIRE(collect("a\n\nbc", '\n') == std::vector<std::string>{"a", "", "bc"});
+  REQUIRE(collect("a\0b\0"sv, '\0') == std::vector<std::string>{"a", "b"});
+  auto const data = lines_of(500);
+  REQUIRE(collect(data, '\n') == split(data, '\n'));
+
+  SECTION("from a mapped file") {
+    auto tmp = mfile::make_tmpfile("/tmp/mfile_delimited_test_");
+    tmp.write_exact(bytes_of(data));
+    auto records = std::vector<std::string>{};
+    for (auto record : mfile::delimited_records{tmp}) {
+      records.emplace_back(as_sv(record));
+    }
+    REQUIRE(records == split(data, '\n'));
+  }
+}
+
+TEST_CASE("Delimited records through a buffered reader", "[delimited]") {
+  auto tmp = mfile::make_tmpfile("/tmp/mfile_delimited_test_");
+  auto data = lines_of(300);
+  // Longer than the buffer and unterminated
+  data += std::string(200, 'z');
+  tmp.write_exact(bytes_of(data));
+
+  for (std::size_t buffer_size : {1U, 7U, 64U, 4096U}) {
+    auto reader =
+        mfile::buffered_reader{tmp, 0, mfile::no_digest{}, buffer_size};
+    auto delimited = mfile::delimited_reader{reader};
+    auto records = std::vector<std::string>{};
+    for (auto record : delimited) {
+      records.emplace_back(as_sv(record));
+    }
+    REQUIRE(records == split(data, '\n'));
+    REQUIRE(delimited.offset() == data.size());
+    REQUIRE_FALSE(delimited.next().has_value());
+  }
+}
@@ -0,0 +1,109 @@
+#include <cerrno>
+#include <set>
+#include <string>
+#include <string_view>
+
+#include <fcntl.h>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "mfile/directory.hpp"
+#include "mfile/mfile.hpp"
+#include "test_helpers.hpp"
+
+using namespace std::string_view_literals;
+using mfile_test::temp_dir;
+
+namespace {
+
+auto error_of(auto&& fn) -> int {
+  try {
+    fn();
+  } catch (const mfile::mfile_system_error& e) {
+    return e.code().value();
+  }
+  return 0;
+}
+}  // namespace
+
+TEST_CASE("Directory handle", "[directory]") {
+  auto tmp = temp_dir{"mfile_directory_test"};
+  auto dir = mfile::open_directory(tmp.path.c_str());
+  REQUIRE(dir);
+
+  SECTION("files are opened relative to the directory") {
+    dir.make_directory_at("sub");
+    dir.open_at("sub/a", mfile::open_flags::w()).write_exact("hello"sv);
+
+    auto sub = dir.open_directory_at("sub");
+    auto f = sub.open_at("a", mfile::open_flags::r());
+    REQUIRE(f.size() == 5);
+    REQUIRE(sub.stat_at("a", mfile::statx_mask::size).stx_size == 5);
+    REQUIRE(S_ISDIR(dir.stat_at("sub").stx_mode));
+  }
+
+  SECTION("rename_at and unlink_at") {
+    dir.make_directory_at("other");
+    auto other = dir.open_directory_at("other");
+    dir.open_at("a", mfile::open_flags::w()).write_exact("x"sv);
+
+    dir.rename_at("a", "b");
+    REQUIRE(error_of([&] { (void)dir.stat_at("a"); }) == ENOENT);
+    dir.rename_at("b", other, "c");
+    REQUIRE(other.stat_at("c").stx_size == 1);
+
+    other.unlink_at("c");
+    REQUIRE(error_of([&] { (void)other.stat_at("c"); }) == ENOENT);
+    dir.unlink_at("other", AT_REMOVEDIR);
+    REQUIRE(error_of([&] { (void)dir.stat_at("other"); }) == ENOENT);
+  }
+
+  SECTION("errors name the path") {
+    REQUIRE(error_of([&] { (void)dir.open_directory_at("missing"); })
+            == ENOENT);
+    REQUIRE(error_of([&] {
+              (void)mfile::open_directory((tmp.path / "missing").c_str());
+            })
+            == ENOENT);
+    (void)dir.open_at("file", mfile::open_flags::w());
+    REQUIRE(error_of([&] { (void)dir.open_directory_at("file"); })
+            == ENOTDIR);
+  }
+
+  SECTION("entries are listed with few getdents64 calls") {
+    auto expected = std::set<std::string>{};
+    for (int i = 0; i < 1000; ++i) {
+      auto name = "entry_" + std::to_string(i);
+      (void)dir.open_at(name.c_str(), mfile::open_flags::w());
+      expected.insert(std::move(name));
+    }
+    dir.make_directory_at("sub");
+    expected.insert("sub");
+
+    auto entries = dir.entries();
+    auto seen = std::set<std::string>{};
+    for (auto const& entry : entries) {
+      seen.emplace(entry.name);
+      REQUIRE(entry.ino != 0);
+      if (entry.name == "sub") {
+        REQUIRE((entry.type == mfile::entry_type::directory
+                 || entry.type == mfile::entry_type::unknown));
+      }
+    }
+    REQUIRE(seen == expected);
+    REQUIRE(entries.reads() <= 3);
+
+    SECTION("iteration restarts from the beginning") {
+      std::size_t count = 0;
+      for ([[maybe_unused]] auto const& entry : entries) {
+        ++count;
+      }
+      REQUIRE(count == expected.size());
+    }
+  }
+
+  SECTION("an empty directory has no entries") {
+    auto entries = dir.entries(1024);
+    REQUIRE(entries.begin() == entries.end());
+  }
+}
@@ -19,6 +19,10 @@ TEST_CASE("mfile error category", "[error]") {
     REQUIRE(cat.message(mfile::errc::end_of_file) == "End of file reached");
     REQUIRE(cat.message(mfile::errc::insufficient_space)
             == "Insufficient space");
+    REQUIRE(cat.message(mfile::errc::timed_out) == "Operation timed out");
+    REQUIRE(cat.message(mfile::errc::operation_cancelled)
+            == "Operation cancelled");
+    REQUIRE(cat.message(mfile::errc::checksum_mismatch) == "Checksum mismatch");
     REQUIRE(cat.message(999) == "Unknown mfile error");
   }
 }
@@ -49,6 +53,12 @@ TEST_CASE("mfile error code and condition", "[error]") {
     auto ec_space = make_error_code(mfile::errc::insufficient_space);
     REQUIRE(ec_space.default_error_condition()
             == std::make_error_condition(std::errc::no_space_on_device));
+
+    REQUIRE(make_error_code(mfile::errc::timed_out) == std::errc::timed_out);
+    REQUIRE(make_error_code(mfile::errc::operation_cancelled)
+            == std::errc::operation_canceled);
+    REQUIRE(make_error_code(mfile::errc::checksum_mismatch)
+            == std::errc::bad_message);
   }
 
   SECTION("comparison operators") {
@@ -0,0 +1,136 @@
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <string_view>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "mfile/mfile.hpp"
+
+namespace {
+struct hook_event {
+  bool begin;
+  mfile::io_op op;
+  std::size_t bytes;
+  std::uint64_t offset;
+  std::int64_t result;
+};
+
+struct recording_hooks {
+  std::vector<hook_event>* events;
+
+  void on_begin(mfile::io_op op,
+                std::size_t bytes,
+                std::uint64_t offset) const {
+    events->push_back({true, op, bytes, offset, 0});
+  }
+  void on_end(mfile::io_op op,
+              std::size_t bytes,
+              std::uint64_t offset,
+              std::int64_t result) const {
+    events->push_back({false, op, bytes, offset, result});
+  }
+};
+
+struct failing_pwrite_hooks {
+  void on_begin(mfile::io_op op,
+                std::size_t /*bytes*/,
+                std::uint64_t /*offset*/) const {
+    if (op == mfile::io_op::pwrite) {
+      throw mfile::mfile_system_error{EIO, "injected fault"};
+    }
+  }
+  void on_end(mfile::io_op /*op*/,
+              std::size_t /*bytes*/,
+              std::uint64_t /*offset*/,
+              std::int64_t /*result*/) const {}
+};
+}  // namespace
+
+static_assert(sizeof(mfile::file<mfile::file_handle>)
+              == sizeof(mfile::file_handle));
+static_assert(sizeof(mfile::file<mfile::weak_file_handle>)
+              == sizeof(mfile::weak_file_handle));
+
+// NOLINTNEXTLINE
+TEST_CASE("File hooks observe system calls", "[file][hooks]") {
+  using namespace std::string_view_literals;
+  auto tmp = mfile::make_tmpfile("/tmp/mfile_hooks_test_");
+  auto events = std::vector<hook_event>{};
+  auto file = mfile::file{mfile::weak_file_handle{tmp.handle().get()},
+                          recording_hooks{&events}};
+
+  SECTION("pwrite and pread report offset, size and result") {
+    file.pwrite_exact("hello"sv, 10);
+    REQUIRE(events.size() == 2);
+    REQUIRE(events[0].begin);
+    REQUIRE(events[0].op == mfile::io_op::pwrite);
+    REQUIRE(events[0].bytes == 5);
+    REQUIRE(events[0].offset == 10);
+    REQUIRE_FALSE(events[1].begin);
+    REQUIRE(events[1].result == 5);
+
+    events.clear();
+    auto data = file.pread(5, 10);
+    REQUIRE(data.size() == 5);
+    REQUIRE(events.front().op == mfile::io_op::pread);
+    REQUIRE(events.back().result == 5);
+  }
+
+  SECTION("failures are reported as negative errno") {
+    auto buffer = std::vector<std::byte>(4);
+    REQUIRE_THROWS_AS(
+        file.pread_once(buffer, (std::numeric_limits<std::uint64_t>::max)()),
+        mfile::mfile_system_error);
+    REQUIRE(events.size() == 2);
+    REQUIRE(events[1].result == -EINVAL);
+  }
+
+  SECTION("metadata calls are reported") {
+    file.truncate(100);
+    file.sync();
+    REQUIRE(file.size() == 100);
+    REQUIRE(events.size() == 6);
+    REQUIRE(events[0].op == mfile::io_op::truncate);
+    REQUIRE(events[0].offset == 100);
+    REQUIRE(events[2].op == mfile::io_op::sync);
+    REQUIRE(events[4].op == mfile::io_op::stat);
+
+    file.allocate(0, 4096);
+    REQUIRE(events[6].op == mfile::io_op::allocate);
+    REQUIRE(events[6].offset == 0);
+    REQUIRE(events[6].bytes == 4096);
+  }
+
+  SECTION("seeks report their target and the resulting position") {
+    file.truncate(100);
+    events.clear();
+    REQUIRE(file.seek(40, SEEK_SET) == 40);
+    REQUIRE(events[0].op == mfile::io_op::seek);
+    REQUIRE(events[0].offset == 40);
+    REQUIRE(events[1].result == 40);
+
+    events.clear();
+    REQUIRE(file.seek(-3, SEEK_END) == 97);
+    REQUIRE(events[0].offset == 0);
+    REQUIRE(events[1].result == 97);
+
+    events.clear();
+    REQUIRE_THROWS_AS(file.seek(-1, SEEK_SET), mfile::mfile_system_error);
+    REQUIRE(events[0].offset == 0);
+    REQUIRE(events[1].result == -EINVAL);
+  }
+}
+
+TEST_CASE("File hooks can inject faults", "[file][hooks]") {
+  using namespace std::string_view_literals;
+  auto tmp = mfile::make_tmpfile("/tmp/mfile_hooks_test_");
+  auto file = mfile::file{mfile::weak_file_handle{tmp.handle().get()},
+                          failing_pwrite_hooks{}};
+
+  REQUIRE_THROWS_AS(file.pwrite_exact("data"sv, 0), mfile::mfile_system_error);
+  REQUIRE(file.size() == 0);
+}
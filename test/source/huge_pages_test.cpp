@@ -0,0 +1,87 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "mfile/aligned_buffer.hpp"
+#include "mfile/huge_pages.hpp"
+#include "mfile/mapped_file.hpp"
+#include "mfile/mfile.hpp"
+
+namespace {
+auto is_zero(mfile::cbyte_view data) -> bool {
+  return std::all_of(data.begin(), data.end(),
+                     [](std::byte b) { return b == std::byte{}; });
+}
+}  // namespace
+
+TEST_CASE("Huge-page backed aligned_buffer", "[huge_pages]") {
+  auto const page = mfile::detail::huge_page_size();
+  constexpr std::size_t size = (std::size_t{3} << 20U) + 123;
+
+  SECTION("regular pages unless asked") {
+    auto buffer = mfile::aligned_buffer{size, 4096};
+    REQUIRE(buffer.huge_pages().mode == mfile::huge_page_mode::off);
+  }
+
+  // Either mode falls back when the host has no huge pages; the buffer
+  // behaves the same whatever it got
+  for (auto mode :
+       {mfile::huge_page_mode::transparent, mfile::huge_page_mode::hugetlb}) {
+    auto buffer = mfile::aligned_buffer{size, 4096, mode};
+    REQUIRE(buffer.size() == size);
+    REQUIRE(buffer.alignment() == 4096);
+    REQUIRE(is_zero(buffer));
+    std::fill_n(buffer.data(), buffer.size(), std::byte{0x5a});
+
+    auto const stats = buffer.huge_pages();
+    REQUIRE(stats.mode <= mode);
+    REQUIRE(stats.huge_bytes <= size);
+    if (stats.mode != mfile::huge_page_mode::off) {
+      auto const address = reinterpret_cast<std::uintptr_t>(buffer.data());
+      REQUIRE(address % page == 0);
+    }
+    if (stats.mode == mfile::huge_page_mode::hugetlb) {
+      REQUIRE(stats.huge_bytes == size);
+    }
+
+    auto moved = std::move(buffer);
+    REQUIRE(moved.huge_pages().mode == stats.mode);
+    REQUIRE(moved.data()[size - 1] == std::byte{0x5a});
+  }
+}
+
+TEST_CASE("Huge-page aligned file mapping", "[huge_pages]") {
+  auto tmp = mfile::make_tmpfile("/tmp/mfile_huge_pages_test_");
+  auto data = std::vector<std::byte>((std::size_t{4} << 20U) + 100);
+  for (std::size_t i = 0; i < data.size(); ++i) {
+    data[i] = static_cast<std::byte>(i * 31);
+  }
+  tmp.write_exact(data);
+
+  for (auto mode :
+       {mfile::huge_page_mode::transparent, mfile::huge_page_mode::hugetlb}) {
+    auto mapping = mfile::mapped_file{
+        tmp, {.populate = true, .huge_pages = mode}};
+    REQUIRE(mapping.size() == data.size());
+    REQUIRE(std::equal(data.begin(), data.end(), mapping.data()));
+    // Not on hugetlbfs
+    auto const stats = mapping.huge_pages();
+    REQUIRE(stats.mode != mfile::huge_page_mode::hugetlb);
+    REQUIRE(stats.huge_bytes <= data.size());
+    mapping.advise(MADV_RANDOM);
+  }
+
+  auto const offset = std::uint64_t{1} << 20U;
+  auto mapping = mfile::mapped_file{
+      tmp, offset, 4096,
+      {.huge_pages = mfile::huge_page_mode::transparent}};
+  REQUIRE(std::equal(mapping.data(), mapping.data() + 4096,
+                     data.begin() + static_cast<std::ptrdiff_t>(offset)));
+  // Lined up so that file huge pages can map at PMD granularity
+  auto const address = reinterpret_cast<std::uintptr_t>(mapping.data());
+  REQUIRE(address % mfile::detail::huge_page_size()
+          == offset % mfile::detail::huge_page_size());
+}
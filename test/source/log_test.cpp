@@ -0,0 +1,243 @@
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+#include <unistd.h>
+
+#include "mfile/crc32c.hpp"
+#include "mfile/log.hpp"
+#include "mfile/mfile.hpp"
+#include "test_helpers.hpp"
+
+using namespace std::string_view_literals;
+using range3::as_sv;
+using mfile_test::bytes_of;
+using mfile_test::call_counts;
+using mfile_test::counting_hooks;
+
+namespace {
+auto le32_at(const std::vector<std::byte>& data, std::size_t offset)
+    -> std::uint32_t {
+  return mfile::detail::load_le32(data.data() + offset);
+}
+
+}  // namespace
+
+TEST_CASE("CRC-32C", "[log]") {
+  REQUIRE(mfile::crc32c(bytes_of("123456789")) == 0xe3069283U);
+  REQUIRE(mfile::crc32c({}) == 0);
+
+  auto data = std::string{};
+  for (int i = 0; i < 1000; ++i) {
+    data.push_back(static_cast<char>(i * 7));
+  }
+  auto const whole = mfile::crc32c(bytes_of(data));
+  for (std::size_t split : {0U, 1U, 7U, 8U, 9U, 500U, 999U, 1000U}) {
+    auto const view = std::string_view{data};
+    REQUIRE(mfile::crc32c(bytes_of(view.substr(split)),
+                          mfile::crc32c(bytes_of(view.substr(0, split))))
+            == whole);
+  }
+  auto const reg = ~0U;
+  REQUIRE(mfile::detail::crc32c_sw(
+              reg, bytes_of(data).data(), data.size())
+          == mfile::detail::crc32c_hw(reg, bytes_of(data).data(),
+                                      data.size()));
+}
+
+TEST_CASE("Log writer", "[log]") {
+  auto tmp = mfile::make_tmpfile("/tmp/mfile_log_test_");
+  auto const fd = tmp.handle()->native();
+  auto f = mfile::file{mfile::weak_file_handle{fd}};
+
+  SECTION("records are framed as [len | crc32c | payload]") {
+    auto log = mfile::log_writer{f, 0, {.preallocate = 0}};
+    REQUIRE(log.append(bytes_of("hello")) == 0);
+    REQUIRE(log.append(bytes_of("")) == 13);
+    REQUIRE(log.end() == 21);
+    REQUIRE(log.committed() == 0);
+    REQUIRE(tmp.size() == 0);
+    log.commit();
+    REQUIRE(log.committed() == 21);
+
+    auto const data = tmp.pread(0);
+    REQUIRE(data.size() == 21);
+    REQUIRE(le32_at(data, 0) == 5);
+    REQUIRE(le32_at(data, 4)
+            == mfile::crc32c(bytes_of("hello"),
+                             mfile::crc32c({data.data(), 4})));
+    REQUIRE(std::string_view{reinterpret_cast<const char*>(  // NOLINT
+                                 data.data() + 8),
+                             5}
+            == "hello");
+    REQUIRE(le32_at(data, 13) == 0);
+    REQUIRE(le32_at(data, 17) != 0);
+  }
+
+  SECTION("a batch costs one pwrite and one fdatasync") {
+    auto counts = call_counts{};
+    auto log = mfile::log_writer{
+        mfile::file{mfile::weak_file_handle{fd},
+                    counting_hooks{&counts}},
+        0, {.preallocate = 0}};
+    for (int i = 0; i < 100; ++i) {
+      log.append(bytes_of("record"));
+    }
+    REQUIRE(counts[mfile::io_op::pwrite] == 0);
+    log.commit();
+    REQUIRE(counts[mfile::io_op::pwrite] == 1);
+    REQUIRE(counts[mfile::io_op::sync] == 1);
+    log.commit();
+    REQUIRE(counts[mfile::io_op::sync] == 1);
+  }
+
+  SECTION("segments are preallocated") {
+    auto log = mfile::log_writer{f, 0, {.preallocate = 1 << 16}};
+    log.append(bytes_of("x"));
+    log.commit();
+    REQUIRE(tmp.size() == 1 << 16);
+    auto const data = tmp.pread(0);
+    REQUIRE(le32_at(data, 9) == 0);
+    REQUIRE(le32_at(data, 13) == 0);
+  }
+
+  SECTION("records larger than the buffer are written directly") {
+    auto log = mfile::log_writer{f, 0,
+                                 {.buffer_size = 16, .preallocate = 0}};
+    auto const big = std::string(100, 'b');
+    log.append(bytes_of("small"));
+    REQUIRE(log.append(bytes_of(big)) == 13);
+    log.append(bytes_of("tail"));
+    log.commit();
+    auto const data = tmp.pread(0);
+    REQUIRE(data.size() == 13 + 108 + 12);
+    REQUIRE(le32_at(data, 13) == 100);
+    REQUIRE(le32_at(data, 121) == 4);
+  }
+
+  SECTION("writing resumes at the given end") {
+    tmp.write_exact("garbage garbage garbage"sv);
+    auto log = mfile::log_writer{f, 7, {.preallocate = 0}};
+    REQUIRE(tmp.size() == 7);
+    REQUIRE(log.append(bytes_of("abc")) == 7);
+    log.commit();
+    REQUIRE(tmp.size() == 18);
+    REQUIRE(le32_at(tmp.pread(0), 7) == 3);
+  }
+}
+
+TEST_CASE("Log writer on an append-mode segment", "[log]") {
+  auto const path = std::string{"/tmp/mfile_log_append_test"};
+  ::unlink(path.c_str());
+  {
+    auto log = mfile::log_writer{mfile::open(path.c_str(),
+                                             mfile::open_flags::a()),
+                                 0, {.preallocate = 1 << 16}};
+    REQUIRE(log.append(bytes_of("appended")) == 0);
+    log.commit();
+  }
+  auto reader = mfile::log_reader{mfile::open(path.c_str(),
+                                              mfile::open_flags::r())};
+  auto records = std::vector<std::string>{};
+  for (auto const& record : reader) {
+    records.emplace_back(as_sv(record.payload));
+  }
+  REQUIRE(records == std::vector<std::string>{"appended"});
+  REQUIRE(reader.tail() == mfile::log_tail::clean);
+  ::unlink(path.c_str());
+}
+
+TEST_CASE("Log reader", "[log]") {
+  auto tmp = mfile::make_tmpfile("/tmp/mfile_log_test_");
+  auto const f = mfile::file{mfile::weak_file_handle{tmp.handle()->native()}};
+  auto const payload_of = [](int i) {
+    return std::string(static_cast<std::size_t>(i % 50),
+                       static_cast<char>('a' + (i % 26)));
+  };
+
+  auto log = mfile::log_writer{f, 0, {.buffer_size = 4096,
+                                      .preallocate = 1 << 16}};
+  auto offsets = std::vector<std::uint64_t>{};
+  for (int i = 0; i < 1000; ++i) {
+    auto const payload = payload_of(i);
+    offsets.push_back(log.append(bytes_of(payload)));
+  }
+  log.commit();
+
+  SECTION("records are read back from the mapping") {
+    auto reader = mfile::log_reader{f};
+    int i = 0;
+    for (auto const& record : reader) {
+      REQUIRE(record.offset == offsets[static_cast<std::size_t>(i)]);
+      REQUIRE(as_sv(record.payload) == payload_of(i));
+      ++i;
+    }
+    REQUIRE(i == 1000);
+    REQUIRE(reader.tail() == mfile::log_tail::clean);
+    REQUIRE(reader.valid_end() == log.end());
+    REQUIRE(tmp.size() > log.end());
+  }
+
+  SECTION("a partial record ends the log") {
+    tmp.truncate(log.end() - 3);
+    auto reader = mfile::log_reader{f};
+    REQUIRE(reader.recover() == offsets.back());
+    REQUIRE(reader.tail() == mfile::log_tail::truncated);
+
+    tmp.truncate(offsets.back() + 5);
+    REQUIRE(reader.recover() == offsets.back());
+  }
+
+  SECTION("a corrupted record ends the log") {
+    auto const victim = offsets[510] + 8;
+    tmp.pwrite_exact("X"sv, victim);
+    auto reader = mfile::log_reader{f};
+    REQUIRE(reader.recover() == offsets[510]);
+    REQUIRE(reader.tail() == mfile::log_tail::checksum_mismatch);
+
+    SECTION("and writing resumes at the last valid offset") {
+      auto resumed = mfile::log_writer{f, reader.valid_end()};
+      resumed.append(bytes_of("resumed"));
+      resumed.commit();
+      auto again = mfile::log_reader{f};
+      auto count = 0;
+      auto last = std::string{};
+      for (auto const& record : again) {
+        ++count;
+        last = as_sv(record.payload);
+      }
+      REQUIRE(count == 511);
+      REQUIRE(last == "resumed");
+    }
+
+    SECTION("and records past it are not read back") {
+      auto resumed = mfile::log_writer{f, reader.valid_end()};
+      auto const payload = std::string(payload_of(510).size(), '!');
+      resumed.append(bytes_of(payload));
+      resumed.commit();
+      auto again = mfile::log_reader{f};
+      auto count = 0;
+      auto last = std::string{};
+      for (auto const& record : again) {
+        ++count;
+        last = as_sv(record.payload);
+      }
+      REQUIRE(count == 511);
+      REQUIRE(last == payload);
+      REQUIRE(again.tail() == mfile::log_tail::clean);
+    }
+  }
+
+  SECTION("reading can start at a record offset") {
+    auto const data = tmp.pread(0);
+    auto reader = mfile::log_reader{mfile::cbyte_view{data}, offsets[998]};
+    auto count = 0;
+    for ([[maybe_unused]] auto const& record : reader) {
+      ++count;
+    }
+    REQUIRE(count == 2);
+  }
+}
@@ -0,0 +1,106 @@
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <byte_span/byte_span.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <fcntl.h>
+
+#include "mfile/mfile.hpp"
+#include "test_helpers.hpp"
+
+using range3::as_sv;
+using range3::byte_span;
+using namespace std::string_view_literals;
+using mfile_test::call_counts;
+using mfile_test::counting_hooks;
+
+// NOLINTNEXTLINE
+TEST_CASE("Cached metadata tracks size and position", "[file][cache]") {
+  auto tmp = mfile::make_tmpfile("/tmp/mfile_cache_test_");
+  auto counts = call_counts{};
+  tmp.write_exact("0123456789"sv);
+  auto file = mfile::file{mfile::weak_file_handle{tmp.handle().get()},
+                          counting_hooks{&counts}}
+                  .with_metadata_cache();
+  REQUIRE(file.metadata_cached());
+  REQUIRE_FALSE(tmp.metadata_cached());
+  counts = {};
+
+  SECTION("size and tell without system calls") {
+    REQUIRE(file.size() == 10);
+    REQUIRE(file.tell() == 10);
+    REQUIRE_FALSE(file.empty());
+    REQUIRE(counts[mfile::io_op::stat] == 0);
+    REQUIRE(counts[mfile::io_op::seek] == 0);
+  }
+
+  SECTION("writes, pwrite and truncate update the size") {
+    file.write_exact("abc"sv);
+    REQUIRE(file.size() == 13);
+    REQUIRE(file.tell() == 13);
+    file.pwrite_exact("z"sv, 99);
+    REQUIRE(file.size() == 100);
+    REQUIRE(file.tell() == 13);
+    file.truncate(5);
+    REQUIRE(file.size() == 5);
+    REQUIRE(counts[mfile::io_op::stat] == 0);
+    REQUIRE(file.statx(mfile::statx_mask::size).stx_size == 5);
+  }
+
+  SECTION("read() of the rest of the file issues only reads") {
+    file.seek(2, SEEK_SET);
+    REQUIRE(file.tell() == 2);
+    counts[mfile::io_op::seek] = 0;
+    auto data = file.read();
+    REQUIRE(as_sv(byte_span{data}) == "23456789");
+    REQUIRE(file.tell() == 10);
+    REQUIRE(counts[mfile::io_op::stat] == 0);
+    REQUIRE(counts[mfile::io_op::seek] == 0);
+  }
+
+  SECTION("refresh picks up external changes") {
+    tmp.pwrite_exact("external"sv, 100);
+    REQUIRE(file.size() == 10);
+    file.refresh();
+    REQUIRE(file.size() == 108);
+  }
+
+  SECTION("copies share the cache") {
+    auto copy = file;
+    copy.write_exact("x"sv);
+    REQUIRE(file.tell() == 11);
+    REQUIRE(file.size() == 11);
+  }
+
+  SECTION("max_age expires cached values") {
+    file.enable_metadata_cache({.max_age = std::chrono::nanoseconds{0}});
+    tmp.pwrite_exact("external"sv, 100);
+    REQUIRE(file.size() == 108);
+  }
+
+  SECTION("disable") {
+    file.disable_metadata_cache();
+    REQUIRE_FALSE(file.metadata_cached());
+    REQUIRE(file.size() == 10);
+    REQUIRE(counts[mfile::io_op::stat] == 1);
+  }
+}
+
+TEST_CASE("Cached metadata with O_APPEND", "[file][cache]") {
+  auto tmp = mfile::make_tmpfile("/tmp/mfile_cache_test_");
+  tmp.write_exact("0123456789"sv);
+  auto file = mfile::file{mfile::file_handle{mfile::weak_file_handle{
+      ::open(("/proc/self/fd/" + std::to_string(tmp.handle()->native())).c_str(),
+             mfile::open_flags::a().flags())}}}
+                  .with_metadata_cache();
+  REQUIRE(file.tell() == 0);
+  file.write_exact("abc"sv);
+  REQUIRE(file.size() == 13);
+  REQUIRE(file.tell() == 13);
+  REQUIRE(tmp.size() == 13);
+}
@@ -0,0 +1,102 @@
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "mfile/mfile.hpp"
+#include "mfile/readiness.hpp"
+
+using namespace std::string_view_literals;
+using namespace std::chrono_literals;
+
+namespace {
+auto make_pipe() {
+  auto fds = std::array<int, 2>{};
+  REQUIRE(::pipe2(fds.data(), O_CLOEXEC) == 0);
+  return std::array{
+      mfile::file{mfile::file_handle{mfile::weak_file_handle{fds[0]}}},
+      mfile::file{mfile::file_handle{mfile::weak_file_handle{fds[1]}}}};
+}
+}  // namespace
+
+// NOLINTNEXTLINE
+TEST_CASE("Non-blocking reads and writes", "[nonblocking]") {
+  auto [reader, writer] = make_pipe();
+  REQUIRE_FALSE(reader.nonblocking());
+  reader.set_nonblocking(true);
+  writer.set_nonblocking(true);
+  REQUIRE(reader.nonblocking());
+
+  SECTION("would-block is a result, not an error") {
+    auto buffer = std::array<std::byte, 16>{};
+    REQUIRE(reader.try_read_once(buffer) == std::nullopt);
+    REQUIRE(reader.try_read(buffer) == std::nullopt);
+    REQUIRE_THROWS_AS(reader.read_once(buffer), mfile::mfile_system_error);
+  }
+
+  SECTION("try_read returns what is available") {
+    writer.write_exact("hello"sv);
+    auto buffer = std::array<char, 16>{};
+    REQUIRE(reader.try_read(buffer) == 5);
+    REQUIRE(std::string_view{buffer.data(), 5} == "hello");
+    REQUIRE(reader.try_read(buffer) == std::nullopt);
+  }
+
+  SECTION("EOF is still 0") {
+    auto buffer = std::array<std::byte, 16>{};
+    writer = {};
+    REQUIRE(reader.try_read_once(buffer) == 0);
+  }
+
+  SECTION("a full pipe stops writes without throwing") {
+    auto chunk = std::vector<std::byte>(64 * 1024);
+    std::size_t total = 0;
+    while (auto n = writer.try_write(chunk)) {
+      total += *n;
+    }
+    REQUIRE(total > 0);
+    REQUIRE(writer.try_write_once(chunk) == std::nullopt);
+    REQUIRE_FALSE(mfile::wait_ready(writer, mfile::readiness::writable, 0ms));
+
+    auto sink = std::vector<std::byte>(total);
+    REQUIRE(reader.try_read(sink) == total);
+    REQUIRE(mfile::wait_ready(writer, mfile::readiness::writable, 0ms));
+  }
+
+  SECTION("clearing the flag restores blocking mode") {
+    reader.set_nonblocking(false);
+    REQUIRE_FALSE(reader.nonblocking());
+  }
+}
+
+TEST_CASE("Readiness waiting", "[nonblocking]") {
+  auto [reader, writer] = make_pipe();
+
+  SECTION("poll") {
+    REQUIRE_FALSE(mfile::wait_ready(reader, mfile::readiness::readable, 10ms));
+    writer.write_exact("x"sv);
+    REQUIRE(mfile::wait_ready(reader, mfile::readiness::readable, 10ms));
+    REQUIRE(mfile::wait_ready(reader, mfile::readiness::readable));
+  }
+
+  SECTION("epoll") {
+    auto set = mfile::epoll_set{};
+    set.add(reader, mfile::readiness::readable, 42);
+    auto events = std::array<::epoll_event, 4>{};
+    REQUIRE(set.wait(events, 0ms).empty());
+
+    writer.write_exact("x"sv);
+    auto ready = set.wait(events, 1000ms);
+    REQUIRE(ready.size() == 1);
+    REQUIRE(ready[0].data.u64 == 42);
+
+    set.remove(reader);
+    REQUIRE(set.wait(events, 0ms).empty());
+  }
+}
@@ -0,0 +1,146 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "mfile/mfile.hpp"
+#include "mfile/page_cache.hpp"
+
+namespace {
+auto page_size() -> std::uint64_t {
+  return static_cast<std::uint64_t>(::sysconf(_SC_PAGESIZE));
+}
+}  // namespace
+
+// NOLINTNEXTLINE
+TEST_CASE("cache residency", "[file][page_cache]") {
+  auto file = mfile::make_tmpfile("/tmp/mfile_page_cache_test_");
+  auto const page = page_size();
+  auto data = std::vector<std::byte>(static_cast<std::size_t>(64 * page),
+                                     std::byte{'x'});
+  file.write_exact(data);
+  file.datasync();
+
+  SECTION("whole file") {
+    auto res = file.cache_residency();
+    REQUIRE(res.pages == 64);
+    REQUIRE(res.cached <= res.pages);
+    REQUIRE(res.ratio() >= 0.0);
+    REQUIRE(res.ratio() <= 1.0);
+    if (res.detailed) {
+      REQUIRE(res.writeback <= res.cached);
+    }
+  }
+
+  SECTION("partial and unaligned ranges") {
+    REQUIRE(file.cache_residency(page, 2 * page).pages == 2);
+    REQUIRE(file.cache_residency(page - 1, 2).pages == 2);
+    REQUIRE(file.cache_residency(60 * page, 100 * page).pages == 4);
+  }
+
+  SECTION("past the end") {
+    auto res = file.cache_residency(64 * page, page);
+    REQUIRE(res.pages == 0);
+    REQUIRE(res.cached == 0);
+    REQUIRE(res.ratio() >= 1.0);
+  }
+
+  SECTION("uncached ranges") {
+    file.advise(POSIX_FADV_DONTNEED, 8 * page, 8 * page);
+    auto const missing = mfile::detail::uncached_ranges(
+        file.handle()->native(), 4 * page + 1, 16 * page);
+    for (auto const& [begin, end] : missing) {
+      REQUIRE(begin >= 8 * page);
+      REQUIRE(end <= 16 * page);
+      REQUIRE(begin < end);
+    }
+    REQUIRE(mfile::detail::uncached_ranges(file.handle()->native(), 0, 0)
+                .empty());
+  }
+
+  SECTION("mincore agrees with cachestat") {
+    auto res = file.cache_residency();
+    std::uint64_t cached = 0;
+    REQUIRE(mfile::detail::mincore_pages(file.handle()->native(), 0, res.pages,
+                                         static_cast<std::size_t>(page),
+                                         cached)
+            == 0);
+    if (res.detailed) {
+      REQUIRE(cached == res.cached);
+    }
+  }
+}
+
+// NOLINTNEXTLINE
+TEST_CASE("page cache warming and eviction", "[page_cache]") {
+  auto const page = page_size();
+  auto const path = std::string{"/tmp/mfile_page_cache_warm_test"};
+  {
+    auto file = mfile::open(path.c_str(), mfile::open_flags::w());
+    auto data = std::vector<std::byte>(static_cast<std::size_t>(256 * page),
+                                       std::byte{'y'});
+    file.write_exact(data);
+  }
+  auto const targets = std::vector<mfile::cache_target>{
+      {path},
+      {path, 16 * page, 32 * page},
+      {"/tmp/mfile_page_cache_missing"},
+  };
+  auto const options = mfile::page_cache_options{
+      .threads = 4,
+      .chunk_size = 8 * page,
+  };
+
+  auto reports = mfile::evict_page_cache(targets, options);
+  REQUIRE(reports.size() == 3);
+  REQUIRE(!reports[0].error);
+  REQUIRE(reports[0].path == path);
+  REQUIRE(reports[0].before.pages == 256);
+  REQUIRE(reports[1].before.pages == 32);
+  REQUIRE(reports[2].error == std::errc::no_such_file_or_directory);
+  REQUIRE(reports[0].after.cached <= reports[0].before.cached);
+
+  auto const evicted = mfile::query_page_cache(targets, options);
+  REQUIRE(evicted[0].before.cached == evicted[0].after.cached);
+
+  reports = mfile::warm_page_cache(std::span{targets}.first(2), options);
+  REQUIRE(reports.size() == 2);
+  REQUIRE(!reports[0].error);
+  REQUIRE(reports[0].before.cached == evicted[0].before.cached);
+  REQUIRE(reports[0].after.cached == 256);
+  REQUIRE(reports[1].after.cached == 32);
+
+  ::unlink(path.c_str());
+}
+
+// NOLINTNEXTLINE
+TEST_CASE("page cache targets beyond the descriptor limit", "[page_cache]") {
+  auto const path = std::string{"/tmp/mfile_page_cache_many_test"};
+  mfile::open(path.c_str(), mfile::open_flags::w())
+      .write_exact(std::vector<std::byte>(
+          static_cast<std::size_t>(4 * page_size()), std::byte{'z'}));
+  auto const targets = std::vector<mfile::cache_target>(300, {path});
+
+  auto limit = rlimit{};
+  REQUIRE(::getrlimit(RLIMIT_NOFILE, &limit) == 0);
+  auto lowered = limit;
+  lowered.rlim_cur = std::min<rlim_t>(limit.rlim_cur, 128);
+  REQUIRE(::setrlimit(RLIMIT_NOFILE, &lowered) == 0);
+  auto const reports = mfile::warm_page_cache(
+      targets, {.threads = 4, .max_open_files = 32});
+  ::setrlimit(RLIMIT_NOFILE, &limit);
+
+  for (auto const& report : reports) {
+    REQUIRE(!report.error);
+    REQUIRE(report.after.pages == 4);
+  }
+  ::unlink(path.c_str());
+}
@@ -0,0 +1,82 @@
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+
+#include <catch2/catch_test_macros.hpp>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "mfile/aligned_buffer.hpp"
+#include "mfile/mfile.hpp"
+
+using namespace std::string_view_literals;
+
+// NOLINTNEXTLINE
+TEST_CASE("statx metadata", "[file][statx]") {
+  auto file = mfile::make_tmpfile("/tmp/mfile_statx_test_");
+  file.write_exact("0123456789"sv);
+
+  SECTION("size only") {
+    auto stx = file.statx(mfile::statx_mask::size);
+    REQUIRE((stx.stx_mask & mfile::statx_mask::size) != 0);
+    REQUIRE(stx.stx_size == 10);
+    REQUIRE(file.size() == 10);
+  }
+
+  SECTION("basic stats agree with fstat") {
+    auto stx = file.statx();
+    auto st = file.stat();
+    REQUIRE(stx.stx_ino == st.st_ino);
+    REQUIRE(stx.stx_mode == st.st_mode);
+    REQUIRE(S_ISREG(stx.stx_mode));
+  }
+
+  SECTION("dio alignment") {
+    auto align = file.dio_alignment();
+    if (align.reported) {
+      INFO("kernel reported DIO alignment");
+      REQUIRE((align.memory == 0 || (align.memory & (align.memory - 1)) == 0));
+    } else {
+      REQUIRE(align.memory == mfile::dio_alignment::fallback);
+      REQUIRE(align.offset == mfile::dio_alignment::fallback);
+    }
+  }
+}
+
+TEST_CASE("aligned_buffer", "[aligned_buffer]") {
+  SECTION("alignment and size") {
+    constexpr std::size_t alignment = 4096;
+    auto buffer = mfile::aligned_buffer{10000, alignment};
+    REQUIRE(buffer.size() == 10000);
+    REQUIRE(reinterpret_cast<std::uintptr_t>(buffer.data()) % alignment == 0);
+    auto view = mfile::byte_view{buffer};
+    REQUIRE(view.size() == buffer.size());
+  }
+
+  SECTION("invalid alignment") {
+    REQUIRE_THROWS_AS((mfile::aligned_buffer{16, 3}), std::invalid_argument);
+  }
+
+  SECTION("direct I/O round trip") {
+    auto file = mfile::make_tmpfile("/tmp/mfile_statx_test_");
+    auto align = file.dio_alignment();
+    if (align.memory == 0) {
+      SKIP("direct I/O not supported on /tmp");
+    }
+    auto buffer = mfile::aligned_buffer::for_direct_io(file, 100);
+    REQUIRE(buffer.size() % align.offset == 0);
+    REQUIRE(reinterpret_cast<std::uintptr_t>(buffer.data()) % align.memory
+            == 0);
+    std::memset(buffer.data(), 'x', buffer.size());
+
+    auto flags = ::fcntl(file.handle()->native(), F_GETFL);
+    if (::fcntl(file.handle()->native(), F_SETFL, flags | O_DIRECT) == -1) {
+      SKIP("O_DIRECT not supported on /tmp");
+    }
+    file.pwrite_exact(buffer, 0);
+    REQUIRE(file.size() == buffer.size());
+  }
+}
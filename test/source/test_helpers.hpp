@@ -0,0 +1,67 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "mfile/io_context.hpp"
+#include "mfile/mfile.hpp"
+
+namespace mfile_test {
+
+inline auto io_uring_available() -> bool {
+  return mfile::io_context{}.backend() == mfile::io_backend::io_uring;
+}
+
+inline auto bytes_of(std::string_view s) -> mfile::cbyte_view {
+  return {reinterpret_cast<const std::byte*>(s.data()), s.size()};  // NOLINT
+}
+
+// Fresh directory /tmp/<prefix>_XXXXXX, removed with its contents.
+struct temp_dir {
+  std::filesystem::path path;
+
+  explicit temp_dir(std::string_view prefix) {
+    auto name = "/tmp/" + std::string{prefix} + "_XXXXXX";
+    REQUIRE(::mkdtemp(name.data()) != nullptr);
+    path = name;
+  }
+  temp_dir(const temp_dir&) = delete;
+  temp_dir(temp_dir&&) = delete;
+  auto operator=(const temp_dir&) -> temp_dir& = delete;
+  auto operator=(temp_dir&&) -> temp_dir& = delete;
+  ~temp_dir() { std::filesystem::remove_all(path); }
+};
+
+// System calls seen by counting_hooks, per io_op.
+struct call_counts {
+  std::array<std::size_t, static_cast<std::size_t>(mfile::io_op::allocate) + 1>
+      calls{};
+
+  auto operator[](mfile::io_op op) -> std::size_t& {
+    return calls.at(static_cast<std::size_t>(op));
+  }
+};
+
+// File hooks counting every system call issued through the file.
+struct counting_hooks {
+  call_counts* counts;
+
+  void on_begin(mfile::io_op op,
+                std::size_t /*bytes*/,
+                std::uint64_t /*offset*/) const noexcept {
+    ++(*counts)[op];
+  }
+  void on_end(mfile::io_op /*op*/,
+              std::size_t /*bytes*/,
+              std::uint64_t /*offset*/,
+              std::int64_t /*result*/) const noexcept {}
+};
+
+}  // namespace mfile_test
@@ -0,0 +1,123 @@
+#include <cstddef>
+#include <cstdint>
+#include <latch>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "mfile/mfile.hpp"
+#include "mfile/trace.hpp"
+
+using namespace std::string_view_literals;
+
+// NOLINTNEXTLINE
+TEST_CASE("Tracer records file operations", "[trace]") {
+  auto tmp = mfile::make_tmpfile("/tmp/mfile_trace_test_");
+  auto tracer = mfile::trace::tracer{};
+  auto file = mfile::file{mfile::weak_file_handle{tmp.handle().get()},
+                          mfile::trace::trace_hooks{&tracer}};
+
+  SECTION("events carry operation, offset and result") {
+    file.pwrite_exact("0123456789"sv, 4096);
+    file.sync();
+    auto buffer = std::vector<std::byte>(4);
+    REQUIRE(file.pread(buffer, 4096) == 4);
+
+    auto events = tracer.snapshot();
+    REQUIRE(events.size() == 3);
+    REQUIRE(events[0].op == mfile::io_op::pwrite);
+    REQUIRE(events[0].offset == 4096);
+    REQUIRE(events[0].bytes == 10);
+    REQUIRE(events[0].result == 10);
+    REQUIRE(events[1].op == mfile::io_op::sync);
+    REQUIRE(events[2].op == mfile::io_op::pread);
+    REQUIRE(events[2].begin_ns <= events[2].end_ns);
+    REQUIRE(events[0].tid == events[2].tid);
+  }
+
+  SECTION("chrome trace output") {
+    file.pwrite_exact("x"sv, 0);
+    auto os = std::ostringstream{};
+    tracer.write_chrome_trace(os);
+    auto json = os.str();
+    REQUIRE(json.starts_with(R"({"displayTimeUnit":"ns","traceEvents":[)"));
+    REQUIRE(json.find(R"("name":"pwrite")") != std::string::npos);
+    REQUIRE(json.find(R"("ph":"X")") != std::string::npos);
+    REQUIRE(json.ends_with("]}"));
+  }
+
+  SECTION("null tracer records nothing") {
+    auto untraced = mfile::file{mfile::weak_file_handle{tmp.handle().get()},
+                                mfile::trace::trace_hooks{}};
+    untraced.pwrite_exact("x"sv, 0);
+    REQUIRE(tracer.snapshot().empty());
+  }
+}
+
+TEST_CASE("Tracer buffers are per thread and bounded", "[trace]") {
+  constexpr std::size_t capacity = 8;
+  constexpr int threads = 4;
+  constexpr int writes_per_thread = 20;
+  auto tmp = mfile::make_tmpfile("/tmp/mfile_trace_test_");
+  auto tracer = mfile::trace::tracer{capacity};
+
+  // All record at once, so none can take over another's buffer
+  auto recording = std::latch{threads};
+  auto workers = std::vector<std::thread>{};
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([&, t] {
+      auto file = mfile::file{mfile::weak_file_handle{tmp.handle().get()},
+                              mfile::trace::trace_hooks{&tracer}};
+      for (int i = 0; i < writes_per_thread; ++i) {
+        file.pwrite_exact("y"sv, static_cast<std::uint64_t>(t));
+      }
+      recording.arrive_and_wait();
+    });
+  }
+  for (auto& w : workers) {
+    w.join();
+  }
+
+  auto events = tracer.snapshot();
+  REQUIRE(events.size() == capacity * threads);
+  REQUIRE(tracer.dropped() == (writes_per_thread - capacity) * threads);
+}
+
+TEST_CASE("Tracer buffers of exited threads are reused", "[trace]") {
+  constexpr std::size_t capacity = 8;
+  auto tmp = mfile::make_tmpfile("/tmp/mfile_trace_test_");
+  auto tracer = mfile::trace::tracer{capacity};
+  auto record = [&](int writes) {
+    std::thread{[&] {
+      auto file = mfile::file{mfile::weak_file_handle{tmp.handle().get()},
+                              mfile::trace::trace_hooks{&tracer}};
+      for (int i = 0; i < writes; ++i) {
+        file.pwrite_exact("z"sv, 0);
+      }
+    }}.join();
+  };
+
+  record(3);
+  // Events of an exited thread stay until its buffer is reused
+  REQUIRE(tracer.snapshot().size() == 3);
+  for (int i = 0; i < 10; ++i) {
+    record(2);
+  }
+  REQUIRE(tracer.snapshot().size() == capacity);
+  REQUIRE(tracer.dropped() == 3 + (10 * 2) - capacity);
+
+  // A thread exiting after its tracer was destroyed
+  auto outlived = std::thread{[&] {
+    auto other = std::make_unique<mfile::trace::tracer>(capacity);
+    mfile::file{mfile::weak_file_handle{tmp.handle().get()},
+                mfile::trace::trace_hooks{other.get()}}
+        .pwrite_exact("z"sv, 0);
+    other.reset();
+  }};
+  outlived.join();
+}
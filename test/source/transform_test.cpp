@@ -0,0 +1,198 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_template_test_macros.hpp>
+
+#include "mfile/lz.hpp"
+#include "mfile/mfile.hpp"
+#include "mfile/transform.hpp"
+
+namespace {
+// Text-like data: words drawn from a small vocabulary
+auto compressible(std::size_t size) -> std::vector<std::byte> {
+  static constexpr std::string_view words[] = {  // NOLINT
+      "alpha ", "beta ", "gamma ", "delta\n", "epsilon ", "zeta, "};
+  auto rng = std::mt19937{42};
+  auto data = std::vector<std::byte>{};
+  while (data.size() < size) {
+    for (char c : words[rng() % 6]) {
+      data.push_back(static_cast<std::byte>(c));
+    }
+  }
+  data.resize(size);
+  return data;
+}
+
+auto random_bytes(std::size_t size) -> std::vector<std::byte> {
+  auto rng = std::mt19937{7};
+  auto data = std::vector<std::byte>(size);
+  for (auto& b : data) {
+    b = static_cast<std::byte>(rng());
+  }
+  return data;
+}
+
+auto round_trip(const std::vector<std::byte>& data) -> std::size_t {
+  auto compressor = mfile::lz_compressor{};
+  auto packed = std::vector<std::byte>(mfile::lz_compress_bound(data.size()));
+  auto const size = compressor.compress(data, packed);
+  auto out = std::vector<std::byte>(data.size());
+  REQUIRE(mfile::lz_decompress(mfile::cbyte_view{packed}.first(size), out)
+          == data.size());
+  REQUIRE(out == data);
+  return size;
+}
+}  // namespace
+
+TEST_CASE("LZ block codec", "[transform]") {
+  SECTION("round trips") {
+    for (std::size_t size : {0U, 1U, 12U, 13U, 100U, 65536U, 300000U}) {
+      round_trip(compressible(size));
+      round_trip(random_bytes(size));
+    }
+    round_trip(std::vector<std::byte>(100000, std::byte{'x'}));
+  }
+
+  SECTION("compresses redundant data") {
+    REQUIRE(round_trip(compressible(1 << 20)) < (1 << 20) / 2);
+    REQUIRE(round_trip(std::vector<std::byte>(1 << 20)) < 5000);
+    REQUIRE(round_trip(random_bytes(1 << 16))
+            <= mfile::lz_compress_bound(1 << 16));
+  }
+
+  SECTION("malformed input is rejected") {
+    auto const data = compressible(10000);
+    auto compressor = mfile::lz_compressor{};
+    auto packed = std::vector<std::byte>(mfile::lz_compress_bound(data.size()));
+    packed.resize(compressor.compress(data, packed));
+    auto out = std::vector<std::byte>(data.size());
+
+    // Cut at a sequence boundary, truncation only shows as a short result
+    auto const truncated = mfile::cbyte_view{packed}.first(packed.size() / 2);
+    auto short_result = true;
+    try {
+      short_result = mfile::lz_decompress(truncated, out) < data.size();
+    } catch (const mfile::mfile_system_error&) {  // NOLINT
+    }
+    REQUIRE(short_result);
+    REQUIRE_THROWS_AS(
+        mfile::lz_decompress(packed, mfile::byte_view{out}.first(100)),
+        mfile::mfile_system_error);
+    REQUIRE_THROWS_AS(mfile::lz_decompress({}, out),
+                      mfile::mfile_system_error);
+    // A match reaching before the start of the output
+    auto const bad_offset = std::vector<std::byte>{
+        std::byte{0x10}, std::byte{'a'}, std::byte{0x05}, std::byte{0x00}};
+    REQUIRE_THROWS_AS(mfile::lz_decompress(bad_offset, out),
+                      mfile::mfile_system_error);
+  }
+}
+
+TEMPLATE_TEST_CASE("Transformed block files",
+                   "[transform]",
+                   mfile::lz_transform,
+                   mfile::identity_transform) {
+  auto tmp = mfile::make_tmpfile("/tmp/mfile_transform_test_");
+  constexpr std::size_t block = 4096;
+  auto data = compressible(100'000);
+  auto const noise = random_bytes(block);
+  data.insert(data.begin() + 50'000, noise.begin(), noise.end());
+
+  {
+    auto writer = mfile::transformed_writer{tmp, TestType{}, block};
+    auto const view = mfile::cbyte_view{data};
+    writer.write(view.first(1));
+    writer.write(view.subspan(1, 10'000));
+    writer.write(view.subspan(10'001));
+    REQUIRE(writer.raw_size() == data.size());
+    writer.finish();
+    REQUIRE(writer.stored_size() == tmp.size());
+    if constexpr (TestType::id != 0) {
+      REQUIRE(tmp.size() < data.size() / 2);
+    }
+  }
+
+  auto reader = mfile::transformed_reader{tmp, TestType{}};
+  REQUIRE(reader.size() == data.size());
+  REQUIRE(reader.block_size() == block);
+  REQUIRE(reader.block_count() == (data.size() + block - 1) / block);
+
+  SECTION("sequential reads") {
+    auto out = std::vector<std::byte>(data.size() + 10);
+    auto const view = mfile::byte_view{out};
+    REQUIRE(reader.read(view.first(5000)) == 5000);
+    REQUIRE(reader.read(view.subspan(5000)) == data.size() - 5000);
+    out.resize(data.size());
+    REQUIRE(out == data);
+  }
+
+  SECTION("random access decodes only the covering blocks") {
+    auto out = std::vector<std::byte>(3000);
+    for (std::uint64_t offset : {0U, 4095U, 50'001U, 90'000U}) {
+      reader.pread_exact(out, offset);
+      REQUIRE(std::equal(out.begin(), out.end(),
+                         data.begin() + static_cast<std::ptrdiff_t>(offset)));
+    }
+    REQUIRE_THROWS_AS(reader.pread_exact(out, data.size() - 10),
+                      mfile::end_of_file_error);
+  }
+
+  SECTION("corrupted blocks are detected") {
+    tmp.pwrite_exact(mfile::cbyte_view{noise}.first(8), 100);
+    auto out = std::vector<std::byte>(10);
+    auto fresh = mfile::transformed_reader{tmp, TestType{}};
+    REQUIRE_THROWS_AS(fresh.pread_exact(out, 0), mfile::mfile_error);
+  }
+
+  SECTION("corrupted indexes are detected") {
+    auto const size = tmp.size();
+    // A block offset, the block count, then the index checksum
+    for (std::uint64_t offset : {size - 28 - 8, size - 12, size - 8}) {
+      auto const saved = tmp.pread(1, offset);
+      tmp.pwrite_exact(std::vector<std::byte>(1, ~saved[0]), offset);
+      try {
+        (void)mfile::transformed_reader{tmp, TestType{}};
+        FAIL("expected EBADMSG");
+      } catch (const mfile::mfile_system_error& e) {
+        REQUIRE(e.code().value() == EBADMSG);
+      }
+      tmp.pwrite_exact(saved, offset);
+    }
+  }
+}
+
+TEST_CASE("Transformed block files are self-describing", "[transform]") {
+  auto tmp = mfile::make_tmpfile("/tmp/mfile_transform_test_");
+  {
+    auto writer = mfile::transformed_writer{tmp, mfile::lz_transform{}};
+    writer.write(compressible(10));
+  }
+  REQUIRE_THROWS_AS(
+      (mfile::transformed_reader{tmp, mfile::identity_transform{}}),
+      mfile::mfile_system_error);
+  tmp.pwrite_exact(std::vector<std::byte>(4), 0);
+  REQUIRE_THROWS_AS((mfile::transformed_reader{tmp, mfile::lz_transform{}}),
+                    mfile::mfile_system_error);
+}
+
+TEST_CASE("Transformed block writers validate the block size", "[transform]") {
+  auto tmp = mfile::make_tmpfile("/tmp/mfile_transform_test_");
+  for (auto const block_size :
+       {std::size_t{0},
+        std::size_t{std::numeric_limits<std::uint32_t>::max()} + 1,
+        std::numeric_limits<std::size_t>::max()}) {
+    REQUIRE_THROWS_AS(
+        (mfile::transformed_writer{tmp, mfile::lz_transform{}, block_size}),
+        std::invalid_argument);
+  }
+  REQUIRE(tmp.size() == 0);
+}
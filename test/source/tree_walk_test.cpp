@@ -0,0 +1,168 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <set>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include <unistd.h>
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+
+#include "mfile/directory.hpp"
+#include "mfile/mfile.hpp"
+#include "mfile/tree_walk.hpp"
+#include "test_helpers.hpp"
+
+using namespace std::string_view_literals;
+using mfile_test::temp_dir;
+
+namespace {
+
+// d0..d3/{e0..e3}/f0..f4 with "dN" files of N+1 bytes, plus a symlink loop
+auto make_tree(const std::filesystem::path& path) -> std::set<std::string> {
+  auto const root = mfile::open_directory(path.c_str());
+  auto expected = std::set<std::string>{};
+  for (int d = 0; d < 4; ++d) {
+    auto const dname = "d" + std::to_string(d);
+    root.make_directory_at(dname.c_str());
+    expected.insert(dname);
+    for (int e = 0; e < 4; ++e) {
+      auto const ename = dname + "/e" + std::to_string(e);
+      root.make_directory_at(ename.c_str());
+      expected.insert(ename);
+      for (int f = 0; f < 5; ++f) {
+        auto const fname = ename + "/f" + std::to_string(f);
+        root.open_at(fname.c_str(), mfile::open_flags::w())
+            .write_exact(std::string(static_cast<std::size_t>(d + 1), 'x'));
+        expected.insert(fname);
+      }
+    }
+  }
+  std::filesystem::create_directory_symlink(".", path / "loop");
+  expected.insert("loop");
+  return expected;
+}
+}  // namespace
+
+TEST_CASE("Parallel tree walk", "[tree_walk]") {
+  auto tmp = temp_dir{"mfile_tree_walk_test"};
+  auto const expected = make_tree(tmp.path);
+  auto const threads = GENERATE(1U, 4U);
+
+  SECTION("every entry is visited once") {
+    auto mutex = std::mutex{};
+    auto seen = std::multiset<std::string>{};
+    auto bytes = std::atomic<std::uint64_t>{};
+    auto unexpected = std::atomic<int>{};
+    auto result = mfile::walk_tree(
+        tmp.path.c_str(),
+        [&](const mfile::walk_entry& e) {
+          if (e.stx == nullptr) {
+            ++unexpected;
+            return;
+          }
+          if (e.type == mfile::entry_type::regular) {
+            bytes += e.stx->stx_size;
+            if (e.depth != 2 || !e.name.starts_with("f")) {
+              ++unexpected;
+            }
+          }
+          auto const lock = std::scoped_lock{mutex};
+          seen.emplace(e.path);
+        },
+        {.threads = threads, .statx_mask = mfile::statx_mask::size});
+    REQUIRE(std::set<std::string>(seen.begin(), seen.end()) == expected);
+    REQUIRE(seen.size() == expected.size());
+    REQUIRE(unexpected == 0);
+    REQUIRE(result.entries == expected.size());
+    REQUIRE(result.directories == 1 + 4 + 16);
+    REQUIRE(result.errors.empty());
+    REQUIRE(bytes == 4 * 5 * (1 + 2 + 3 + 4));
+  }
+
+  SECTION("pruning and max_depth") {
+    auto count = std::atomic<int>{};
+    auto result = mfile::walk_tree(
+        tmp.path.c_str(),
+        [&](const mfile::walk_entry& e) {
+          ++count;
+          return e.name == "d0" ? mfile::walk_action::prune
+                                : mfile::walk_action::descend;
+        },
+        {.threads = threads, .max_depth = 1});
+    // root entries, then the e* directories of d1..d3 but not their files
+    REQUIRE(count == 5 + 3 * 4);
+    REQUIRE(result.directories == 1 + 3);
+  }
+
+  SECTION("batched output") {
+    auto mutex = std::mutex{};
+    auto seen = std::set<std::string>{};
+    auto batches = 0;
+    auto largest = std::size_t{};
+    auto unexpected = 0;
+    mfile::walk_tree_batched(
+        tmp.path.c_str(),
+        [&](std::span<const mfile::walk_record> batch) {
+          auto const lock = std::scoped_lock{mutex};
+          ++batches;
+          largest = std::max(largest, batch.size());
+          for (auto const& r : batch) {
+            if (!r.has_stx || !r.path.ends_with(r.name())) {
+              ++unexpected;
+            }
+            seen.insert(r.path);
+          }
+        },
+        [](const mfile::walk_entry& e) { return e.name == "d3"; },
+        {.threads = threads,
+         .statx_mask = mfile::statx_mask::mode,
+         .batch_size = 7});
+    REQUIRE(largest <= 7);
+    REQUIRE(unexpected == 0);
+    REQUIRE(seen.size() == expected.size() - 4 * 6);
+    REQUIRE(seen.contains("d3"));
+    REQUIRE_FALSE(seen.contains("d3/e0"));
+    REQUIRE(batches >= static_cast<int>(seen.size() / 7));
+  }
+
+  SECTION("exceptions from the callback stop the walk") {
+    REQUIRE_THROWS_AS(mfile::walk_tree(
+                          tmp.path.c_str(),
+                          [](const mfile::walk_entry& e) {
+                            if (e.depth == 2) {
+                              throw std::runtime_error{"stop"};
+                            }
+                          },
+                          {.threads = threads}),
+                      std::runtime_error);
+  }
+
+  SECTION("unreadable directories are reported") {
+    if (::geteuid() == 0) {
+      SKIP("permissions are not enforced for root");
+    }
+    std::filesystem::permissions(tmp.path / "d1",
+                                 std::filesystem::perms::none);
+    auto result = mfile::walk_tree(
+        tmp.path.c_str(), [](const mfile::walk_entry&) {},
+        {.threads = threads});
+    std::filesystem::permissions(tmp.path / "d1",
+                                 std::filesystem::perms::owner_all);
+    REQUIRE(result.errors.size() == 1);
+    REQUIRE(result.errors[0].path == "d1");
+  }
+
+  SECTION("a missing root throws") {
+    REQUIRE_THROWS_AS(
+        mfile::walk_tree((tmp.path / "missing").c_str(),
+                         [](const mfile::walk_entry&) {}),
+        mfile::mfile_system_error);
+  }
+}
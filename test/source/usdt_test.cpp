@@ -0,0 +1,90 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+#include <elf.h>
+
+#include "mfile/mfile.hpp"
+
+#if MFILE_USDT_ENABLED
+
+namespace {
+// Returns "provider:name" for every stapsdt note in the running executable.
+auto read_stapsdt_probes() -> std::vector<std::string> {
+  auto in = std::ifstream{"/proc/self/exe", std::ios::binary};
+  auto const image = std::vector<char>{std::istreambuf_iterator<char>{in},
+                                       std::istreambuf_iterator<char>{}};
+  auto probes = std::vector<std::string>{};
+
+  auto header = Elf64_Ehdr{};
+  std::memcpy(&header, image.data(), sizeof(header));
+  auto section_at = [&](std::size_t i) {
+    auto sh = Elf64_Shdr{};
+    std::memcpy(&sh, image.data() + header.e_shoff + (i * header.e_shentsize),
+                sizeof(sh));
+    return sh;
+  };
+  auto const strtab = section_at(header.e_shstrndx);
+
+  for (std::size_t i = 0; i < header.e_shnum; ++i) {
+    auto const sh = section_at(i);
+    auto const name =
+        std::string_view{image.data() + strtab.sh_offset + sh.sh_name};
+    if (name != ".note.stapsdt") {
+      continue;
+    }
+    auto pos = sh.sh_offset;
+    auto const end = sh.sh_offset + sh.sh_size;
+    auto align4 = [](std::size_t n) { return (n + 3) & ~std::size_t{3}; };
+    while (pos < end) {
+      auto note = Elf64_Nhdr{};
+      std::memcpy(&note, image.data() + pos, sizeof(note));
+      auto const desc = pos + sizeof(note) + align4(note.n_namesz);
+      // pc, base and semaphore addresses precede the strings
+      auto const* strings = image.data() + desc + (3 * sizeof(std::uint64_t));
+      auto const provider = std::string_view{strings};
+      auto const probe = std::string_view{strings + provider.size() + 1};
+      probes.push_back(std::string{provider} + ":" + std::string{probe});
+      pos = desc + align4(note.n_descsz);
+    }
+  }
+  return probes;
+}
+}  // namespace
+
+// NOLINTNEXTLINE
+TEST_CASE("USDT probes are present in the ELF notes", "[usdt]") {
+  using namespace std::string_view_literals;
+  // instantiate every probed wrapper
+  auto file = mfile::make_tmpfile("/tmp/mfile_usdt_test_");
+  auto buffer = std::vector<std::byte>(4);
+  file.write_exact("data"sv);
+  file.pwrite_exact("data"sv, 0);
+  REQUIRE(file.pread(buffer, 0) == 4);
+  file.seek(0, SEEK_SET);
+  REQUIRE(file.read(buffer) == 4);
+  file.truncate(0);
+  file.allocate(0, 4096);
+  file.sync();
+  REQUIRE_THROWS(mfile::open("/non/existent/file", mfile::open_flags::r()));
+
+  auto const probes = read_stapsdt_probes();
+  for (auto const* name :
+       {"read_once", "write_once", "pread_once", "pwrite_once", "truncate",
+        "allocate", "sync", "open"}) {
+    for (auto const* suffix : {"_entry", "_return"}) {
+      auto const expected = std::string{"mfile:"} + name + suffix;
+      INFO(expected);
+      REQUIRE(std::ranges::find(probes, expected) != probes.end());
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,170 @@
+// mfile-pagecache: query, warm or evict the page cache for a set of files.
+//
+//   mfile-pagecache [-w | -e] [-t THREADS] [-o OFFSET] [-l LENGTH] FILE...
+//
+// -o and -l restrict the files that follow them to a range. Prints the
+// residency of each file before and after.
+
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include "mfile/page_cache.hpp"
+
+namespace {
+
+void usage() {
+  std::fputs(
+      "usage: mfile-pagecache [-w | -e] [-t THREADS] [-o OFFSET] [-l LENGTH] "
+      "FILE...\n"
+      "  -w  warm: read the files into the page cache\n"
+      "  -e  evict: drop the files from the page cache\n"
+      "  -t  worker threads (default: one per CPU)\n"
+      "  -o  start of the range for the following files, in bytes\n"
+      "  -l  length of the range for the following files (0: up to EOF)\n"
+      "Sizes accept a K, M or G suffix.\n",
+      stderr);
+}
+
+// Parses a byte count such as 4096, 64K or 2G.
+auto parse_size(std::string_view s, std::uint64_t& value) -> bool {
+  auto const* end = s.data() + s.size();  // NOLINT
+  auto [ptr, ec] = std::from_chars(s.data(), end, value);
+  if (ec != std::errc{} || ptr == s.data()) {
+    return false;
+  }
+  if (ptr == end) {
+    return true;
+  }
+  if (ptr + 1 != end) {  // NOLINT
+    return false;
+  }
+  auto shift = 0U;
+  switch (*ptr) {
+    case 'K':
+    case 'k':
+      shift = 10;
+      break;
+    case 'M':
+    case 'm':
+      shift = 20;
+      break;
+    case 'G':
+    case 'g':
+      shift = 30;
+      break;
+    default:
+      return false;
+  }
+  if (value > std::numeric_limits<std::uint64_t>::max() >> shift) {
+    return false;
+  }
+  value <<= shift;
+  return true;
+}
+
+auto percent(const mfile::cache_residency& r) -> double {
+  return r.ratio() * 100.0;
+}
+
+}  // namespace
+
+auto main(int argc, char** argv) -> int {
+  auto action = mfile::cache_action::query;
+  auto options = mfile::page_cache_options{};
+  auto targets = std::vector<mfile::cache_target>{};
+  std::uint64_t offset = 0;
+  std::uint64_t len = 0;
+
+  auto const args =
+      std::vector<std::string_view>(argv + 1, argv + argc);  // NOLINT
+  for (std::size_t i = 0; i < args.size(); ++i) {
+    auto const arg = args[i];
+    auto value = [&](std::uint64_t& out) {
+      return i + 1 < args.size() && parse_size(args[++i], out);
+    };
+    if (arg == "-w") {
+      action = mfile::cache_action::warm;
+    } else if (arg == "-e") {
+      action = mfile::cache_action::evict;
+    } else if (arg == "-t") {
+      std::uint64_t threads = 0;
+      if (!value(threads) || threads > std::numeric_limits<unsigned>::max()) {
+        usage();
+        return 2;
+      }
+      options.threads = static_cast<unsigned>(threads);
+    } else if (arg == "-o") {
+      if (!value(offset)) {
+        usage();
+        return 2;
+      }
+    } else if (arg == "-l") {
+      if (!value(len)) {
+        usage();
+        return 2;
+      }
+    } else if (arg == "-h" || arg == "--help") {
+      usage();
+      return 0;
+    } else if (arg.starts_with('-') && arg != "-") {
+      usage();
+      return 2;
+    } else {
+      targets.push_back({std::string{arg}, offset, len});
+    }
+  }
+  if (targets.empty()) {
+    usage();
+    return 2;
+  }
+
+  try {
+    auto const reports = mfile::apply_page_cache(targets, action, options);
+    auto status = 0;
+    std::uint64_t pages = 0;
+    std::uint64_t before = 0;
+    std::uint64_t after = 0;
+    for (auto const& r : reports) {
+      if (r.error) {
+        std::fprintf(stderr, "mfile-pagecache: %s: %s\n", r.path.c_str(),
+                     r.error.message().c_str());
+        status = 1;
+        continue;
+      }
+      if (action == mfile::cache_action::query) {
+        std::printf("%12llu pages %6.2f%% cached  %s\n",
+                    static_cast<unsigned long long>(r.before.pages),  // NOLINT
+                    percent(r.before), r.path.c_str());
+      } else {
+        std::printf("%12llu pages %6.2f%% -> %6.2f%% cached  %s\n",
+                    static_cast<unsigned long long>(r.before.pages),  // NOLINT
+                    percent(r.before), percent(r.after), r.path.c_str());
+      }
+      pages += r.before.pages;
+      before += r.before.cached;
+      after += r.after.cached;
+    }
+    if (reports.size() > 1) {
+      auto const total = [&](std::uint64_t cached) {
+        return pages == 0 ? 100.0
+                          : static_cast<double>(cached) * 100.0
+                                / static_cast<double>(pages);
+      };
+      std::printf("%12llu pages %6.2f%% -> %6.2f%% cached  total\n",
+                  static_cast<unsigned long long>(pages),  // NOLINT
+                  total(before), total(after));
+    }
+    return status;
+  } catch (const std::exception& e) {
+    std::fprintf(stderr, "mfile-pagecache: %s\n", e.what());
+    return 1;
+  }
+}